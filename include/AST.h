@@ -3,7 +3,9 @@
 
 #include "Token.h"
 #include "Type.h"
+#include <cstdint>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 #include <string>
 #include <ostream>
@@ -29,6 +31,13 @@ public:
     virtual Token getToken() const = 0;
     virtual ExprPtr clone() const = 0; // Added
     Type inferredType = Type::NONE;
+
+protected:
+    // Clones keep the analyzer's type, so copied code stays on the typed paths
+    ExprPtr typed(ExprPtr copy) const {
+        copy->inferredType = inferredType;
+        return copy;
+    }
 };
 
 class LiteralExpr : public Expr {
@@ -43,7 +52,7 @@ public:
     }
     Token getToken() const override { return value; }
     ExprPtr clone() const override {
-        return std::make_unique<LiteralExpr>(value);
+        return typed(std::make_unique<LiteralExpr>(value));
     }
 private:
     static std::string tokenTypeToString(TokenType type) {
@@ -67,7 +76,7 @@ public:
     }
     Token getToken() const override { return name; }
     ExprPtr clone() const override {
-        return std::make_unique<VariableExpr>(name);
+        return typed(std::make_unique<VariableExpr>(name));
     }
 };
 
@@ -76,6 +85,7 @@ public:
     ExprPtr left;
     Token op;
     ExprPtr right;
+    bool overflowChecked = true; // Cleared by the optimizer when the result provably fits
     Type inferredType = Type::NONE;
 
     BinaryExpr(ExprPtr l, Token o, ExprPtr r)
@@ -88,7 +98,9 @@ public:
     }
     Token getToken() const override { return op; }
     ExprPtr clone() const override {
-        return std::make_unique<BinaryExpr>(left->clone(), op, right->clone());
+        auto copy = std::make_unique<BinaryExpr>(left->clone(), op, right->clone());
+        copy->overflowChecked = overflowChecked;
+        return typed(std::move(copy));
     }
 private:
     static std::string tokenTypeToString(TokenType type) {
@@ -121,7 +133,7 @@ public:
     }
     Token getToken() const override { return expr->getToken(); }
     ExprPtr clone() const override {
-        return std::make_unique<ParenExpr>(expr->clone());
+        return typed(std::make_unique<ParenExpr>(expr->clone()));
     }
 };
 
@@ -148,7 +160,7 @@ public:
         for (const auto& elem : elements) {
             clonedElements.push_back(elem->clone());
         }
-        return std::make_unique<ListLiteralExpr>(std::move(clonedElements));
+        return typed(std::make_unique<ListLiteralExpr>(std::move(clonedElements)));
     }
 };
 
@@ -180,7 +192,7 @@ public:
         for (const auto& entry : entries) {
             clonedEntries.emplace_back(entry.first->clone(), entry.second->clone());
         }
-        return std::make_unique<DictLiteralExpr>(std::move(clonedEntries));
+        return typed(std::make_unique<DictLiteralExpr>(std::move(clonedEntries)));
     }
 };
 
@@ -188,6 +200,7 @@ class IndexExpr : public Expr {
 public:
     ExprPtr base;
     ExprPtr index;
+    bool boundsChecked = true; // Cleared by the optimizer when the index is provably in range
     Type inferredType = Type::NONE;
 
     IndexExpr(ExprPtr b, ExprPtr i) : base(std::move(b)), index(std::move(i)) {}
@@ -203,7 +216,9 @@ public:
     }
     Token getToken() const override { return base->getToken(); }
     ExprPtr clone() const override {
-        return std::make_unique<IndexExpr>(base->clone(), index->clone());
+        auto copy = std::make_unique<IndexExpr>(base->clone(), index->clone());
+        copy->boundsChecked = boundsChecked;
+        return typed(std::move(copy));
     }
 };
 
@@ -223,7 +238,7 @@ public:
     }
     Token getToken() const override { return name; }
     ExprPtr clone() const override {
-        return std::make_unique<AssignExpr>(name, value->clone());
+        return typed(std::make_unique<AssignExpr>(name, value->clone()));
     }
 };
 
@@ -246,7 +261,7 @@ public:
     }
     Token getToken() const override { return target->getToken(); }
     ExprPtr clone() const override {
-        return std::make_unique<IndexAssignExpr>(target->clone(), value->clone());
+        return typed(std::make_unique<IndexAssignExpr>(target->clone(), value->clone()));
     }
 };
 
@@ -254,10 +269,11 @@ class CallExpr : public Expr {
 public:
     Token name;
     std::vector<ExprPtr> arguments;
+    int specialization = -1; // Typed version of the callee chosen by SemanticAnalyzer
     Type inferredType = Type::NONE;
 
-    CallExpr(Token n, std::vector<ExprPtr> args)
-        : name(std::move(n)), arguments(std::move(args)) {}
+    CallExpr(Token n, std::vector<ExprPtr> args, int s = -1)
+        : name(std::move(n)), arguments(std::move(args)), specialization(s) {}
     void print(std::ostream& os, int indent) const override {
         printIndent(os, indent);
         os << "CallExpr: " << name.lexeme << "\n";
@@ -275,7 +291,59 @@ public:
         for (const auto& arg : arguments) {
             clonedArgs.push_back(arg->clone());
         }
-        return std::make_unique<CallExpr>(name, std::move(clonedArgs));
+        return typed(std::make_unique<CallExpr>(name, std::move(clonedArgs), specialization));
+    }
+};
+
+class FieldExpr : public Expr {
+public:
+    ExprPtr base;
+    Token field;
+    int slot = -1; // Resolved by SemanticAnalyzer when the base's model is known
+    Type inferredType = Type::NONE;
+
+    FieldExpr(ExprPtr b, Token f, int s = -1) : base(std::move(b)), field(std::move(f)), slot(s) {}
+    void print(std::ostream& os, int indent) const override {
+        printIndent(os, indent);
+        os << "FieldExpr: " << field.lexeme;
+        if (slot >= 0) os << " (slot " << slot << ")";
+        os << "\n";
+        printIndent(os, indent + 1);
+        os << "Base:\n";
+        base->print(os, indent + 2);
+    }
+    Token getToken() const override { return field; }
+    ExprPtr clone() const override {
+        return typed(std::make_unique<FieldExpr>(base->clone(), field, slot));
+    }
+};
+
+class CreateExpr : public Expr {
+public:
+    Token model;
+    std::vector<ExprPtr> arguments;
+    Type inferredType = Type::NONE;
+
+    CreateExpr(Token m, std::vector<ExprPtr> args)
+        : model(std::move(m)), arguments(std::move(args)) {}
+    void print(std::ostream& os, int indent) const override {
+        printIndent(os, indent);
+        os << "CreateExpr: " << model.lexeme << "\n";
+        printIndent(os, indent + 1);
+        os << "Arguments:\n";
+        for (size_t i = 0; i < arguments.size(); ++i) {
+            printIndent(os, indent + 2);
+            os << "Arg " << i << ":\n";
+            arguments[i]->print(os, indent + 3);
+        }
+    }
+    Token getToken() const override { return model; }
+    ExprPtr clone() const override {
+        std::vector<ExprPtr> clonedArgs;
+        for (const auto& arg : arguments) {
+            clonedArgs.push_back(arg->clone());
+        }
+        return typed(std::make_unique<CreateExpr>(model, std::move(clonedArgs)));
     }
 };
 
@@ -283,6 +351,7 @@ class Stmt {
 public:
     virtual ~Stmt() = default;
     virtual void print(std::ostream& os, int indent) const = 0;
+    virtual Token getToken() const = 0; // Representative token, used for line numbers
     virtual StmtPtr clone() const = 0;
 };
 
@@ -292,13 +361,14 @@ public:
     ExprPtr init;
     Token typeHint;
     bool isLong;
+    bool isConst; // Declared with `const`: never reassigned after initialization
     Type declaredType = Type::NONE;
 
-    VarDeclStmt(Token n, ExprPtr i, Token t = Token(TokenType::NONE, "", 0), bool l = false)
-        : name(std::move(n)), init(std::move(i)), typeHint(std::move(t)), isLong(l) {}
+    VarDeclStmt(Token n, ExprPtr i, Token t = Token(TokenType::NONE, "", 0), bool l = false, bool c = false)
+        : name(std::move(n)), init(std::move(i)), typeHint(std::move(t)), isLong(l), isConst(c) {}
     void print(std::ostream& os, int indent) const override {
         printIndent(os, indent);
-        os << "VarDeclStmt: " << name.lexeme;
+        os << (isConst ? "VarDeclStmt (const): " : "VarDeclStmt: ") << name.lexeme;
         if (typeHint.type != TokenType::NONE) {
             os << " (Type: " << tokenTypeToString(typeHint.type);
             if (isLong) os << " LONG";
@@ -311,8 +381,9 @@ public:
             init->print(os, indent + 2);
         }
     }
+    Token getToken() const override { return name; }
     StmtPtr clone() const override {
-        return std::make_unique<VarDeclStmt>(name, init ? init->clone() : nullptr, typeHint, isLong);
+        return std::make_unique<VarDeclStmt>(name, init ? init->clone() : nullptr, typeHint, isLong, isConst);
     }
 private:
     static std::string tokenTypeToString(TokenType type) {
@@ -324,6 +395,28 @@ private:
     }
 };
 
+// `let x, y be call f()`: binds the values of one `return a, b`, in order
+class DestructureStmt : public Stmt {
+public:
+    std::vector<Token> names;
+    ExprPtr init; // Always a CallExpr
+
+    DestructureStmt(std::vector<Token> n, ExprPtr i) : names(std::move(n)), init(std::move(i)) {}
+    void print(std::ostream& os, int indent) const override {
+        printIndent(os, indent);
+        os << "DestructureStmt:";
+        for (size_t i = 0; i < names.size(); ++i) {
+            os << (i > 0 ? ", " : " ") << names[i].lexeme;
+        }
+        os << "\n";
+        init->print(os, indent + 1);
+    }
+    Token getToken() const override { return names.front(); }
+    StmtPtr clone() const override {
+        return std::make_unique<DestructureStmt>(names, init->clone());
+    }
+};
+
 class SetStmt : public Stmt {
 public:
     Token name;
@@ -336,6 +429,7 @@ public:
         os << "Value:\n";
         value->print(os, indent + 2);
     }
+    Token getToken() const override { return name; }
     StmtPtr clone() const override {
         return std::make_unique<SetStmt>(name, value->clone());
     }
@@ -356,11 +450,33 @@ public:
         os << "Value:\n";
         value->print(os, indent + 2);
     }
+    Token getToken() const override { return target->getToken(); }
     StmtPtr clone() const override {
         return std::make_unique<IndexAssignStmt>(target->clone(), value->clone());
     }
 };
 
+class FieldAssignStmt : public Stmt {
+public:
+    ExprPtr target;
+    ExprPtr value;
+    FieldAssignStmt(ExprPtr t, ExprPtr v) : target(std::move(t)), value(std::move(v)) {}
+    void print(std::ostream& os, int indent) const override {
+        printIndent(os, indent);
+        os << "FieldAssignStmt:\n";
+        printIndent(os, indent + 1);
+        os << "Target:\n";
+        target->print(os, indent + 2);
+        printIndent(os, indent + 1);
+        os << "Value:\n";
+        value->print(os, indent + 2);
+    }
+    Token getToken() const override { return target->getToken(); }
+    StmtPtr clone() const override {
+        return std::make_unique<FieldAssignStmt>(target->clone(), value->clone());
+    }
+};
+
 class SayStmt : public Stmt {
 public:
     ExprPtr expr;
@@ -370,6 +486,7 @@ public:
         os << "SayStmt:\n";
         expr->print(os, indent + 1);
     }
+    Token getToken() const override { return expr->getToken(); }
     StmtPtr clone() const override {
         return std::make_unique<SayStmt>(expr->clone());
     }
@@ -406,6 +523,7 @@ public:
             }
         }
     }
+    Token getToken() const override { return branches.front().condition->getToken(); }
     StmtPtr clone() const override {
         std::vector<Branch> clonedBranches;
         for (const auto& branch : branches) {
@@ -429,6 +547,14 @@ public:
     };
     ExprPtr condition;
     std::vector<Case> cases;
+
+    // Set by the optimizer when every pattern is an integer literal, or every
+    // one a string literal: the index of the first case for each value, so
+    // the interpreter looks the case up instead of testing each in turn
+    bool jumpTable = false;
+    std::unordered_map<int64_t, size_t> integerCases;
+    std::unordered_map<std::string, size_t> stringCases;
+
     MatchStmt(ExprPtr c, std::vector<Case> cs)
         : condition(std::move(c)), cases(std::move(cs)) {}
     void print(std::ostream& os, int indent) const override {
@@ -450,6 +576,7 @@ public:
             }
         }
     }
+    Token getToken() const override { return condition->getToken(); }
     StmtPtr clone() const override {
         std::vector<Case> clonedCases;
         for (const auto& c : cases) {
@@ -459,7 +586,11 @@ public:
             }
             clonedCases.emplace_back(c.pattern->clone(), std::move(clonedBody));
         }
-        return std::make_unique<MatchStmt>(condition->clone(), std::move(clonedCases));
+        auto cloned = std::make_unique<MatchStmt>(condition->clone(), std::move(clonedCases));
+        cloned->jumpTable = jumpTable;
+        cloned->integerCases = integerCases;
+        cloned->stringCases = stringCases;
+        return cloned;
     }
 };
 
@@ -481,6 +612,7 @@ public:
             stmt->print(os, indent + 2);
         }
     }
+    Token getToken() const override { return condition->getToken(); }
     StmtPtr clone() const override {
         std::vector<StmtPtr> clonedBody;
         for (const auto& stmt : body) {
@@ -520,6 +652,7 @@ public:
             stmt->print(os, indent + 2);
         }
     }
+    Token getToken() const override { return iterator; }
     StmtPtr clone() const override {
         std::vector<StmtPtr> clonedBody;
         for (const auto& stmt : body) {
@@ -560,6 +693,7 @@ public:
             stmt->print(os, indent + 2);
         }
     }
+    Token getToken() const override { return iterator; }
     StmtPtr clone() const override {
         std::vector<StmtPtr> clonedBody;
         for (const auto& stmt : body) {
@@ -575,12 +709,29 @@ public:
     Token name;
     std::vector<Token> parameters;
     std::vector<StmtPtr> body;
+    int functionId = -1; // Assigned by the interpreter when the definition first runs
+
+    // Typed versions made by SemanticAnalyzer for the argument types seen at
+    // call sites; CallExpr::specialization indexes this list.
+    std::vector<Type> paramTypes; // Empty for the generic version
+    Type returnType = Type::NONE;
+    std::vector<std::shared_ptr<FunctionDefStmt>> specializations;
+
+    // Locals of enclosing functions that the body refers to, found by
+    // SemanticAnalyzer. Their values are copied into the function value when
+    // the definition runs.
+    std::vector<Token> captures;
+    // Nested and refers to itself, so each call binds its name to it: the
+    // function may be called where the name is no longer in scope
+    bool bindsSelf = false;
 
     FunctionDefStmt(Token n, std::vector<Token> params, std::vector<StmtPtr> b)
         : name(std::move(n)), parameters(std::move(params)), body(std::move(b)) {}
 
     FunctionDefStmt(const FunctionDefStmt& other)
-        : name(other.name), parameters(other.parameters) {
+        : name(other.name), parameters(other.parameters), paramTypes(other.paramTypes),
+          returnType(other.returnType), specializations(other.specializations), captures(other.captures),
+          bindsSelf(other.bindsSelf) {
         for (const auto& stmt : other.body) {
             body.push_back(stmt->clone());
         }
@@ -590,6 +741,11 @@ public:
         if (this != &other) {
             name = other.name;
             parameters = other.parameters;
+            paramTypes = other.paramTypes;
+            returnType = other.returnType;
+            specializations = other.specializations;
+            captures = other.captures;
+            bindsSelf = other.bindsSelf;
             body.clear();
             for (const auto& stmt : other.body) {
                 body.push_back(stmt->clone());
@@ -610,12 +766,40 @@ public:
         }
     }
 
+    Token getToken() const override { return name; }
+
     StmtPtr clone() const override {
         std::vector<StmtPtr> clonedBody;
         for (const auto& stmt : body) {
             clonedBody.push_back(stmt->clone());
         }
-        return std::make_unique<FunctionDefStmt>(name, parameters, std::move(clonedBody));
+        auto cloned = std::make_unique<FunctionDefStmt>(name, parameters, std::move(clonedBody));
+        cloned->paramTypes = paramTypes;
+        cloned->returnType = returnType;
+        cloned->specializations = specializations;
+        cloned->captures = captures;
+        cloned->bindsSelf = bindsSelf;
+        return cloned;
+    }
+};
+
+class ModelDefStmt : public Stmt {
+public:
+    Token name;
+    std::vector<Token> fields;
+
+    ModelDefStmt(Token n, std::vector<Token> f) : name(std::move(n)), fields(std::move(f)) {}
+    void print(std::ostream& os, int indent) const override {
+        printIndent(os, indent);
+        os << "ModelDefStmt: " << name.lexeme << "\n";
+        for (size_t i = 0; i < fields.size(); ++i) {
+            printIndent(os, indent + 1);
+            os << "Field " << i << ": " << fields[i].lexeme << "\n";
+        }
+    }
+    Token getToken() const override { return name; }
+    StmtPtr clone() const override {
+        return std::make_unique<ModelDefStmt>(name, fields);
     }
 };
 
@@ -623,8 +807,9 @@ class CallStmt : public Stmt {
 public:
     Token name;
     std::vector<ExprPtr> arguments;
-    CallStmt(Token n, std::vector<ExprPtr> args)
-        : name(std::move(n)), arguments(std::move(args)) {}
+    int specialization = -1;
+    CallStmt(Token n, std::vector<ExprPtr> args, int s = -1)
+        : name(std::move(n)), arguments(std::move(args)), specialization(s) {}
     void print(std::ostream& os, int indent) const override {
         printIndent(os, indent);
         os << "CallStmt: " << name.lexeme << "\n";
@@ -638,12 +823,13 @@ public:
             }
         }
     }
+    Token getToken() const override { return name; }
     StmtPtr clone() const override {
         std::vector<ExprPtr> clonedArgs;
         for (const auto& arg : arguments) {
             clonedArgs.push_back(arg->clone());
         }
-        return std::make_unique<CallStmt>(name, std::move(clonedArgs));
+        return std::make_unique<CallStmt>(name, std::move(clonedArgs), specialization);
     }
 };
 
@@ -656,6 +842,7 @@ public:
         os << "ThrowStmt:\n";
         expr->print(os, indent + 2);
     }
+    Token getToken() const override { return expr->getToken(); }
     StmtPtr clone() const override {
         return std::make_unique<ThrowStmt>(expr->clone());
     }
@@ -684,6 +871,7 @@ public:
             stmt->print(os, indent + 2);
         }
     }
+    Token getToken() const override { return tryBody.empty() ? exceptionVar : tryBody.front()->getToken(); }
     StmtPtr clone() const override {
         std::vector<StmtPtr> clonedTryBody;
         for (const auto& stmt : tryBody) {
@@ -697,19 +885,53 @@ public:
     }
 };
 
+class BlockStmt : public Stmt {
+public:
+    std::vector<StmtPtr> body;
+    bool usesRegion; // Allocate the block's lists and dicts from a region released at 'end'
+
+    explicit BlockStmt(std::vector<StmtPtr> b, bool r = true) : body(std::move(b)), usesRegion(r) {}
+    void print(std::ostream& os, int indent) const override {
+        printIndent(os, indent);
+        os << "BlockStmt" << (usesRegion ? " (region)" : "") << ":\n";
+        for (const auto& stmt : body) {
+            stmt->print(os, indent + 1);
+        }
+    }
+    Token getToken() const override { return body.empty() ? Token() : body.front()->getToken(); }
+    StmtPtr clone() const override {
+        std::vector<StmtPtr> clonedBody;
+        for (const auto& stmt : body) {
+            clonedBody.push_back(stmt->clone());
+        }
+        return std::make_unique<BlockStmt>(std::move(clonedBody), usesRegion);
+    }
+};
+
 class ReturnStmt : public Stmt {
 public:
     ExprPtr value;
+    std::vector<ExprPtr> moreValues; // `return a, b, ...` past the first
+    Token keyword;
     Type returnType = Type::NONE;
 
-    ReturnStmt(ExprPtr value) : value(std::move(value)) {}
+    ReturnStmt(ExprPtr value, Token k = Token(), std::vector<ExprPtr> more = {})
+        : value(std::move(value)), moreValues(std::move(more)), keyword(std::move(k)) {}
     void print(std::ostream& os, int indent) const override {
         printIndent(os, indent);
         os << "ReturnStmt:\n";
         if (value) value->print(os, indent + 1);
+        for (const auto& more : moreValues) {
+            more->print(os, indent + 1);
+        }
     }
+    Token getToken() const override { return value ? value->getToken() : keyword; }
     StmtPtr clone() const override {
-        return std::make_unique<ReturnStmt>(value ? value->clone() : nullptr);
+        std::vector<ExprPtr> clonedMore;
+        for (const auto& more : moreValues) {
+            clonedMore.push_back(more->clone());
+        }
+        return std::make_unique<ReturnStmt>(value ? value->clone() : nullptr, keyword, std::move(clonedMore));
     }
 };
 
@@ -0,0 +1,29 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "Engine.h"
+#include <string>
+#include <vector>
+
+namespace MyCustomLang {
+
+struct BatchEntry {
+    std::string path;
+    RunResult result;
+    double milliseconds = 0; // Reading, compiling (unless cached) and running the script
+};
+
+// Expands command-line batch inputs into script paths, in order. An input
+// with glob characters is matched against the filesystem, one ending in
+// `.ns` is taken as a script, and anything else is read as a manifest of
+// paths or globs, one per line (blank lines and `#` comments skipped).
+std::vector<std::string> expandBatchInputs(const std::vector<std::string>& inputs);
+
+// Runs every script on `jobs` threads. Each run has its own Interpreter;
+// compiled scripts are shared through the engine, so files with the same
+// source compile once. Results come back in the order of `paths`.
+std::vector<BatchEntry> runBatch(Engine& engine, const std::vector<std::string>& paths, size_t jobs);
+
+} // namespace MyCustomLang
+
+#endif // BATCH_H
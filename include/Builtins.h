@@ -0,0 +1,67 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "Type.h"
+#include <string>
+#include <vector>
+
+namespace MyCustomLang {
+
+// Functions provided by the runtime. The parser declares them in a scope
+// around the script's globals, so scripts call them like their own
+// functions, and a script declaration with the same name hides one.
+// Interpreter::callBuiltin implements them.
+struct BuiltinSignature {
+    std::string name;
+    size_t arity;
+    Type returnType;
+    bool pure; // No effects, and the result depends only on the arguments
+};
+
+inline const std::vector<BuiltinSignature>& builtinSignatures() {
+    static const std::vector<BuiltinSignature> signatures = {
+        {"len", 1, Type::INTEGER, true},
+        {"emit", 1, Type::NONE, false},
+        {"call_batch", 2, Type::LIST, false}, // call_batch(f, [xs, ys, ...]): f(xs[i], ys[i], ...) for every i
+        {"spill", 1, Type::LIST, false},      // The integer list moved to a spill file
+        {"load_ints", 1, Type::LIST, false},  // Integers from a text file, spilled when over the threshold
+        {"persist", 1, Type::DICT, true},     // The dictionary as a persistent (structurally shared) one
+        {"assoc", 3, Type::DICT, true},       // assoc(d, key, value): a persistent copy of d with key set
+        {"dissoc", 2, Type::DICT, true},      // dissoc(d, key): a persistent copy of d without key
+        {"map", 2, Type::LIST, false},        // map(xs, f): f of each element, computed lazily
+        {"filter", 2, Type::LIST, false},     // filter(xs, f): the elements f returns non-zero for, lazily
+        {"take", 2, Type::LIST, false},       // take(xs, n): the first n elements, lazily
+        {"skip", 2, Type::LIST, false},       // skip(xs, n): all but the first n elements, lazily
+        {"zip", 2, Type::LIST, false},        // zip(xs, ys): [xs[i], ys[i]] pairs up to the shorter one, lazily
+        {"enumerate", 1, Type::LIST, false},  // enumerate(xs): [i, xs[i]] pairs, lazily
+        {"collect", 1, Type::LIST, false},    // The elements of a lazy sequence, as a list
+        {"group_by", 2, Type::DICT, false},   // group_by(rows, key): the rows with each key, as lists
+        {"aggregate", 4, Type::DICT, false},  // aggregate(rows, key, value, op): op ("sum", "count", ...) per key
+        // Matrix builtins are not folded: a matrix cannot become a literal, and
+        // building one at compile time could allocate without bound. Scripts
+        // that already use these generic names keep their own meaning for them.
+        {"matrix", 1, Type::LIST, false},     // A dense integer matrix from a list of equally long rows
+        {"zeros", 2, Type::LIST, false},      // zeros(rows, cols): a matrix of zeros
+        {"identity", 1, Type::LIST, false},   // identity(n): the n x n identity matrix
+        {"transpose", 1, Type::LIST, false},
+        {"matmul", 2, Type::LIST, false},     // Matrix product
+        {"elementwise", 3, Type::LIST, false}, // elementwise(a, b, op): op ("+", "-", "*", "/", "min", "max") per element; b may be an integer
+        {"reduce", 2, Type::INTEGER, false},  // reduce(m, op): op ("sum", "min", "max") over every element
+        {"reduce_rows", 2, Type::LIST, false}, // reduce(m, op) of each row
+        {"reduce_cols", 2, Type::LIST, false}, // reduce(m, op) of each column
+    };
+    return signatures;
+}
+
+inline const BuiltinSignature* findBuiltin(const std::string& name) {
+    for (const auto& signature : builtinSignatures()) {
+        if (signature.name == name) {
+            return &signature;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace MyCustomLang
+
+#endif // BUILTINS_H
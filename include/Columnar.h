@@ -0,0 +1,51 @@
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+#include "AST.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace MyCustomLang {
+
+// Runs an integer function over many independent rows at once. Instead of
+// running the function for each row, every statement and operator runs once
+// per batch of rows, on columns of values, in loops the compiler
+// vectorizes. Rows that take different branches are handled with masks:
+// each branch runs if its condition holds for any row, and writes only the
+// rows that took it.
+class ColumnKernel {
+public:
+    static constexpr size_t BATCH_ROWS = 1024; // Rows per pass; keeps every column in cache
+
+    // Returns nullptr unless the body only uses integer literals, parameters,
+    // local variables, arithmetic, comparisons, `when` and single-value `return`
+    static std::unique_ptr<ColumnKernel> compile(const FunctionDefStmt& function);
+
+    size_t parameterCount() const { return parameters; }
+
+    // Calls the function for each row; arguments[p][row] is parameter p's
+    // value. Rows that end without returning a value get returned[row] = 0.
+    // An error in any row (overflow, division by zero) throws
+    // std::runtime_error naming the row.
+    void run(const std::vector<const int64_t*>& arguments, size_t rows, int64_t* results, uint8_t* returned) const;
+
+    struct Operation;
+    struct Step;
+    ~ColumnKernel();
+
+private:
+    ColumnKernel() = default;
+
+    size_t parameters = 0;
+    size_t slots = 0; // Parameters first, then one per local declaration
+    size_t temporaries = 0; // One column per operation that computes a value
+    std::vector<std::unique_ptr<Step>> body;
+
+    friend class ColumnCompiler;
+    friend class ColumnRunner;
+};
+
+} // namespace MyCustomLang
+
+#endif // COLUMNAR_H
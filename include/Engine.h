@@ -0,0 +1,103 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "AST.h"
+#include "SymbolTable.h"
+#include "Interpreter.h"
+#include "Optimizer.h"
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+namespace MyCustomLang {
+
+// A parsed, analyzed and optimized script. Immutable once compiled, so one
+// instance can be run any number of times.
+struct CompiledScript {
+    SymbolTable symbols;
+    Program program{{}};
+    Bindings constants; // Host globals this variant was specialized against
+    OptimizerStats stats;
+};
+
+// Outcome of compiling and running a script, with errors reported the way
+// the command-line driver prints them
+struct RunResult {
+    int status = 0; // 0 on success, 1 on any error
+    std::string output;
+    std::string errors;
+};
+
+// Parses a command-line `name=value` binding into `bindings`; values made of
+// digits (with an optional leading '-') become integers. Returns false when
+// there is no name or such an integer does not fit in 64 bits.
+bool parseBinding(const std::string& text, Bindings& bindings);
+
+// Formats an error thrown while compiling (parse, semantic or other) the
+// way the command-line driver prints it, newline included
+std::string formatCompileError(const std::runtime_error& error);
+
+// Embedding API. Scripts refer to host globals by name without declaring
+// them; the host supplies their values through Bindings. Safe to share
+// between threads: compiled scripts are immutable and every run gets its
+// own Interpreter.
+class Engine {
+public:
+    // Keeps at most `cacheCapacity` compiled variants, evicting the least
+    // recently used first; 0 keeps every variant
+    explicit Engine(size_t cacheCapacity = 0) : capacity(cacheCapacity) {}
+
+    // Compiles a variant that reads every global at run time. Only the types
+    // of `globals` matter; the variant is shared by all bindings of those types.
+    std::shared_ptr<const CompiledScript> compile(const std::string& source, const Bindings& globals = {});
+
+    // Compiles a variant in which integer and string `globals` are constants,
+    // with the code paths they rule out removed. Variants are cached per
+    // source and binding fingerprint.
+    std::shared_ptr<const CompiledScript> compileSpecialized(const std::string& source, const Bindings& globals);
+
+    // Runs a compiled script. `globals` must carry the names it was compiled with.
+    void run(const CompiledScript& script, const Bindings& globals, std::ostream& out) const;
+
+    // Compiles (or reuses) the generic variant of `source` and runs it,
+    // capturing its output and any parse, semantic, runtime or other error
+    RunResult execute(const std::string& source, const Bindings& globals);
+
+    // Runs an already compiled script the same way. `configure` is applied
+    // to the interpreter before it starts, e.g. to install an emit handler.
+    RunResult execute(const CompiledScript& script, const Bindings& globals,
+                      const std::function<void(Interpreter&)>& configure = {}) const;
+
+    // Canonical form of a set of bindings: names and types, plus the values
+    // of the bindings a specialized variant folds in
+    static std::string fingerprint(const Bindings& bindings, bool withValues);
+
+    size_t cachedVariants() const;
+
+private:
+    struct CacheEntry {
+        std::string key;
+        std::string source; // Compared on every hit, as different sources can share a key
+        std::shared_ptr<const CompiledScript> script;
+    };
+
+    // Keyed by a hash and the length of the source, then by fingerprint.
+    // Compilation happens outside the lock; when two threads compile the
+    // same variant, the first stored wins.
+    mutable std::mutex cacheMutex;
+    size_t capacity;
+    std::list<CacheEntry> recent; // Most recently used first
+    std::unordered_map<std::string, std::list<CacheEntry>::iterator> cache;
+
+    static std::string cacheKey(const std::string& source, const std::string& variant);
+
+    std::shared_ptr<const CompiledScript> build(const std::string& source, const Bindings& globals, bool specialize);
+};
+
+} // namespace MyCustomLang
+
+#endif // ENGINE_H
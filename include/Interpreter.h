@@ -3,55 +3,278 @@
 
 #include "AST.h"
 #include "SymbolTable.h"
+#include "Region.h"
+#include "SpillList.h"
+#include "Matrix.h"
+#include <array>
 #include <stdexcept>
 #include <unordered_map>
 #include <vector>
 #include <variant>
 #include <cstdint>
+#include <memory_resource>
+#include <map>
+#include <ostream>
+#include <functional>
 namespace MyCustomLang {
 
-using List = std::vector<Value>;
-using Dict = std::unordered_map<std::string, Value>;
-using Value = std::variant<
+struct BuiltinSignature;
+struct Closure;
+struct Value;
+struct Sequence;
+class ColumnKernel;
+
+using List = std::pmr::vector<Value>;
+using Dict = std::pmr::unordered_map<std::string, Value>;
+
+// Instance of a `create model` type: one contiguous slot array laid out in
+// the model's field order, so field access is a constant offset.
+struct Record {
+    std::shared_ptr<ModelDefStmt> model;
+    std::vector<Value> slots;
+};
+
+// Dictionary with structural sharing, as a hash array mapped trie. Copies
+// are O(1) and share every node; an update copies only the O(log n) nodes
+// on the path to its key, so keeping every version of a dictionary costs
+// little more than keeping the latest. A value is switched to this form
+// with `call persist(d)`.
+class PersistentDict {
+public:
+    struct Node;
+
+    size_t size() const { return count; }
+    const Value* find(const std::string& key) const;
+    PersistentDict set(const std::string& key, Value value) const;
+    PersistentDict erase(const std::string& key) const;
+    void forEach(const std::function<void(const std::string&, const Value&)>& visit) const;
+    // True when both are copies of one version, so they hold the same entries
+    bool sameVersion(const PersistentDict& other) const { return root == other.root; }
+
+private:
+    std::shared_ptr<const Node> root;
+    size_t count = 0;
+};
+
+// A struct rather than an alias of the variant, so List, Dict and Record
+// can hold it before it is complete
+struct Value : std::variant<
     std::monostate, 
     int64_t, 
     std::string, 
     std::shared_ptr<FunctionDefStmt>,
     List,
-    Dict
->;
+    Dict,
+    std::shared_ptr<ModelDefStmt>,
+    Record,
+    std::shared_ptr<Closure>,
+    std::shared_ptr<SpillList>, // A list of integers too large to keep in memory; typed as a list
+    PersistentDict,             // Typed as a dictionary
+    std::shared_ptr<const Sequence>, // A lazy chain over a list; typed as a list
+    std::shared_ptr<Matrix>          // Typed as a list of rows; shared until written, like a spill list
+>{
+    using variant::variant;
+    using variant::operator=;
+};
+
+// Value of a function defined inside another that captures enclosing
+// locals: a flat copy of just those values, taken when the definition ran,
+// instead of the scopes they lived in
+struct Closure : std::enable_shared_from_this<Closure> {
+    std::shared_ptr<FunctionDefStmt> function;
+    std::vector<Value> captured; // Parallel to function->captures
+};
+
+// Lazy map/filter/take/skip/zip/enumerate over a list, as a chain of steps
+// that each point at their input. Building a chain copies no elements; the
+// first consumer (collect, len, indexing, say) runs the whole chain as one
+// loop over the source list and keeps the result, which later consumers
+// read. Steps never change, so chains can share a prefix.
+struct Sequence {
+    enum class Step : uint8_t { SOURCE, MAP, FILTER, TAKE, SKIP, ZIP, ENUMERATE };
+    Step step;
+    std::shared_ptr<const Sequence> input; // Null for SOURCE
+    // SOURCE: the list read; MAP, FILTER: the function; TAKE, SKIP: the
+    // count; ZIP: the list or sequence paired with the input
+    Value argument;
+    // The elements as a List, once a consumer has run the chain; on the
+    // default resource, since the sequence may outlive the region that ran
+    // it. Longer chains built on this one start from here.
+    mutable std::shared_ptr<const Value> collected;
+};
+
+// Receives the values a script passes to `call emit(...)`
+using EmitHandler = std::function<void(const Value&)>;
+
+// Globals supplied by the host rather than declared by the script. Ordered,
+// so a set of bindings has one canonical form for fingerprinting.
+using Bindings = std::map<std::string, Value>;
+
+Type valueType(const Value& value);
+std::string valueToString(const Value& value);
+// Structural equality: lists element by element, dictionaries by key in
+// any order, records field by field; functions, models and lazy sequences
+// only equal themselves. Values of different types are unequal.
+bool valuesEqual(const Value& a, const Value& b);
+// Negative, zero or positive as a sorts before, with or after b: integers
+// by value, strings and lists lexicographically. Throws std::runtime_error
+// for any other pair.
+int compareValues(const Value& a, const Value& b);
+
+// Where a name was last found, so the next lookup of it through the same
+// cache can skip the scope walk. It stays valid while the scope it was
+// found in is still live and no name has been newly bound since.
+struct BindingCache {
+    std::string name;
+    Value* value = nullptr;
+    size_t depth = 0;
+    uint64_t serial = 0; // Of the scope at `depth` when the name was found there
+    uint64_t epoch = 0;  // Environment::bindingEpoch when it was found
+};
+
 class Environment {
 private:
     std::vector<std::unordered_map<std::string, Value>> scopes;
+    std::vector<const Closure*> captures; // Parallel to scopes: closure whose captured values the scope sees
+    std::vector<uint64_t> serials;        // Parallel to scopes: distinct for every scope ever entered
+    uint64_t nextSerial = 0;
+    uint64_t bindingEpoch = 1; // Bumped by every new binding, since it may hide a cached one
     size_t currentScope;
+    size_t regionFloor = 0;
+
+    // A name the closure bound to scope `i` captured, or nullptr. Captures
+    // are read in place in the closure, never copied into the scope.
+    const Value* captured(size_t i, const std::string& name) const {
+        const Closure* closure = captures[i];
+        if (!closure) return nullptr;
+        const auto& names = closure->function->captures;
+        for (size_t k = 0; k < names.size(); ++k) {
+            if (names[k].lexeme == name) return &closure->captured[k];
+        }
+        return nullptr;
+    }
 
 public:
     Environment() : currentScope(0) {
         scopes.emplace_back(); // Global scope
+        captures.push_back(nullptr);
+        serials.push_back(++nextSerial);
     }
 
     void enterScope() {
         scopes.emplace_back();
+        captures.push_back(nullptr);
+        serials.push_back(++nextSerial);
         currentScope++;
     }
 
     void exitScope() {
         if (currentScope > 0) {
+            scopes.pop_back();
+            captures.pop_back();
+            serials.pop_back();
             currentScope--;
         } else {
             throw std::runtime_error("Cannot exit global scope");
         }
     }
 
+    size_t depth() const { return currentScope; }
+
+    // Every scope, outermost first, and their wholesale replacement; used
+    // by checkpoints, which are only taken outside any region
+    const std::vector<std::unordered_map<std::string, Value>>& allScopes() const { return scopes; }
+    void restoreScopes(std::vector<std::unordered_map<std::string, Value>> saved) {
+        scopes = std::move(saved);
+        captures.assign(scopes.size(), nullptr);
+        serials.clear();
+        for (size_t i = 0; i < scopes.size(); ++i) {
+            serials.push_back(++nextSerial);
+        }
+        currentScope = scopes.size() - 1;
+        regionFloor = 0;
+    }
+
+    // Drops every scope above `scope`, e.g. those left behind by an error
+    void unwindTo(size_t scope) {
+        while (currentScope > scope) {
+            exitScope();
+        }
+    }
+
+    // Scopes below the floor belong to code outside the innermost `block`
+    // region; values assigned into them are copied out of the region.
+    void setRegionFloor(size_t scope) { regionFloor = scope; }
+    size_t getRegionFloor() const { return regionFloor; }
+
     void define(const std::string& name, Value value) {
-        scopes[currentScope][name] = std::move(value);
+        auto [it, inserted] = scopes[currentScope].try_emplace(name);
+        it->second = std::move(value);
+        if (inserted) bindingEpoch++;
+    }
+
+    // Makes a closure's captured values visible in the current scope. The
+    // closure must outlive the scope.
+    void bindCaptures(const Closure* closure) {
+        captures[currentScope] = closure;
+        bindingEpoch++;
     }
 
     Value get(const std::string& name) const {
+        if (const Value* value = find(name)) {
+            return *value;
+        }
+        throw std::runtime_error("Undefined variable: " + name);
+    }
+
+    // Stored value, or nullptr when the name is unbound
+    const Value* find(const std::string& name) const {
+        for (size_t i = currentScope; ; --i) {
+            auto it = scopes[i].find(name);
+            if (it != scopes[i].end()) {
+                return &it->second;
+            }
+            if (const Value* value = captured(i, name)) {
+                return value;
+            }
+            if (i == 0) break;
+        }
+        return nullptr;
+    }
+
+    // Reference to the stored value, for reads and in-place updates that
+    // should not copy the whole value out of the scope. The analyzer
+    // rejects updates to captured names, so those are only ever read.
+    Value& lookup(const std::string& name) {
+        if (const Value* value = find(name)) {
+            return const_cast<Value&>(*value);
+        }
+        throw std::runtime_error("Undefined variable: " + name);
+    }
+
+    // lookup() that first tries where `cache` last found the name. Values
+    // stay put in their scope's map until the scope is left, so a hit
+    // costs a few integer compares instead of a hash per scope.
+    Value& lookup(const std::string& name, BindingCache& cache) {
+        if (cache.epoch == bindingEpoch && cache.depth <= currentScope && serials[cache.depth] == cache.serial &&
+            cache.name == name) {
+            return *cache.value;
+        }
         for (size_t i = currentScope; ; --i) {
+            Value* value = nullptr;
             auto it = scopes[i].find(name);
             if (it != scopes[i].end()) {
-                return it->second;
+                value = &it->second;
+            } else if (const Value* capture = captured(i, name)) {
+                value = const_cast<Value*>(capture);
+            }
+            if (value) {
+                cache.name = name;
+                cache.value = value;
+                cache.depth = i;
+                cache.serial = serials[i];
+                cache.epoch = bindingEpoch;
+                return *value;
             }
             if (i == 0) break;
         }
@@ -62,25 +285,184 @@ public:
         for (size_t i = currentScope; ; --i) {
             auto it = scopes[i].find(name);
             if (it != scopes[i].end()) {
-                it->second = std::move(value);
+                if (i < regionFloor) {
+                    Value escaped = value; // Copy-constructing drops the region allocator
+                    it->second = std::move(escaped);
+                } else {
+                    it->second = std::move(value);
+                }
                 return;
             }
+            if (captured(i, name)) {
+                throw std::runtime_error("Cannot assign to captured variable: " + name);
+            }
             if (i == 0) break;
         }
         throw std::runtime_error("Undefined variable: " + name);
     }
 };
 
+// One entry of a captured call stack. Names and lines are not resolved at
+// capture time; Interpreter::formatStackTrace does that when it is printed.
+struct StackFrame {
+    uint32_t functionId;  // 0 is the top-level program
+    const Stmt* statement; // Innermost statement running in this frame, at any nesting depth
+};
+
+class RuntimeError : public std::runtime_error {
+public:
+    std::vector<StackFrame> frames; // Outermost first
+
+    RuntimeError(const std::string& message, std::vector<StackFrame> f)
+        : std::runtime_error(message), frames(std::move(f)) {}
+};
+
+// Raised when a sandboxed evaluation runs past its limits. Deliberately not a
+// runtime_error, so a script's own try/catch cannot swallow it.
+class StepLimitExceeded : public std::exception {
+public:
+    const char* what() const noexcept override { return "Step limit exceeded"; }
+};
+
 class Interpreter {
 private:
     Environment env;
     const SymbolTable& symbolTable;
+    std::vector<std::unique_ptr<Region>> regions; // One per `block` nesting level, reused
+    size_t regionDepth = 0;
+    const Program* program = nullptr;
+    std::vector<StackFrame> callStack;
+    std::vector<std::shared_ptr<FunctionDefStmt>> functions; // Indexed by function id, 0 unused
+    std::unordered_map<const FunctionDefStmt*, uint32_t> functionIds;
+    std::vector<const FunctionDefStmt*> functionSources; // Definition each entry of functions was copied from
+    size_t stepBudget = 0;   // Loop iterations and calls allowed per evaluate(); 0 is unlimited
+    size_t maxCallDepth = 0; // 0 is unlimited
+    size_t steps = 0;
+    size_t preemptQuantum = 0; // Steps between calls to preemptHook; 0 never preempts
+    size_t sliceSteps = 0;
+    std::function<void()> preemptHook;
+
+    // Where the main program is, level by level: the program's statements,
+    // then the body of each plain block or counted loop being run directly
+    // from it. Only the top level is tracked unless a safe-point hook is
+    // installed. Safe points are the boundaries between top-level
+    // statements and the back-edges of tracked loops; a checkpoint taken at
+    // one is this path plus every scope.
+    struct PathLevel {
+        const std::vector<StmtPtr>* body;
+        size_t index = 0;
+        bool loop = false;
+        int64_t value = 0; // Iterator of the current iteration, or at a back-edge the next one
+        int64_t end = 0;
+        int64_t step = 0;
+    };
+    std::vector<PathLevel> mainPath;
+    std::function<void()> safePointHook;
+    bool atSafePoint = false;
+    std::ostream* out;
+    EmitHandler emitHandler; // Unset: emitted values are printed like `say`
+    SpillOptions spillOptions;
+    // `return` stores its values on top of returnSlots and sets returning;
+    // statement lists stop at the flag and the enclosing call takes the
+    // values. The stack is reused across calls, so returning several values
+    // does not allocate once it has grown.
+    bool returning = false;
+    size_t returnCount = 0;
+    std::vector<Value> returnSlots;
+    void tick() {
+        if (stepBudget > 0 && ++steps > stepBudget) {
+            throw StepLimitExceeded();
+        }
+        if (preemptQuantum > 0 && ++sliceSteps >= preemptQuantum) {
+            sliceSteps = 0;
+            preemptHook();
+        }
+    }
     Value evaluateExpr(const Expr* expr); // Changed to take const Expr*
     void executeStmt(const Stmt* stmt);   // Changed to take const Stmt*
+    void dispatchStmt(const Stmt* stmt);
+    void executeBody(const std::vector<StmtPtr>& body);
+    size_t fieldSlot(const Record& record, const FieldExpr* field);
+    Value readField(const Value& base, const FieldExpr* field);
+    std::pmr::memory_resource* allocationResource();
+    void executeBlock(const BlockStmt* block);
+    void executeTryCatch(const TryCatchStmt* tryCatch);
+    std::shared_ptr<FunctionDefStmt> registerFunction(const FunctionDefStmt* funcDef);
+    // With valueCount, every returned value is left on top of returnSlots
+    // for the caller to pop, and the first is not returned
+    Value callFunction(const Token& name, const std::vector<ExprPtr>& arguments, int specialization,
+                       size_t* valueCount = nullptr);
+    // Runs a resolved function (and the closure it came from, if any) on
+    // arguments already evaluated and checked against its arity
+    Value invokeFunction(const std::shared_ptr<FunctionDefStmt>& func, const Closure* closure,
+                         std::vector<Value>& args, int specialization, size_t* valueCount = nullptr);
+    Value callBuiltin(const BuiltinSignature& builtin, std::vector<Value>& args);
+    Value callBatch(const Value& callee, const Value& columns);
+    Value loadIntegers(const Value& path);
+    Value extendSequence(const BuiltinSignature& builtin, std::vector<Value>& args);
+    // Runs a chain as one loop, handing each element to `sink` until the
+    // chain ends or `sink` returns false
+    void runSequence(const Sequence& sequence, const std::function<bool(Value&)>& sink);
+    // The chain's elements, run on first use and kept in the sequence
+    const List& materializeSequence(const Sequence& sequence);
+    List collectSequence(const Sequence& sequence);
+    Value groupRows(const BuiltinSignature& builtin, std::vector<Value>& args);
+    std::shared_ptr<Matrix> toMatrix(const Value& value, const std::string& caller);
+    // Column kernel for each function passed to call_batch; null when it cannot have one
+    std::unordered_map<const FunctionDefStmt*, std::shared_ptr<const ColumnKernel>> columnKernels;
+    Value readIndex(const Value& base, const Value& idx, bool boundsChecked);
+    void assignIndex(Value& base, const Value& idx, Value value, bool boundsChecked);
+    void assignNested(const IndexAssignStmt* indexAssign);
+    Value& elementForUpdate(Value& container, const Value& idx);
+    static bool isIntegerTyped(const BinaryExpr* bin);
+    bool evaluateInteger(const Expr* expr, int64_t& number, Value& other);
+    bool evaluateIntegerBinary(const BinaryExpr* bin, int64_t& number, Value& other);
+    Value combineValues(const BinaryExpr* bin, const Value& left, const Value& right);
+    int64_t evaluateComparison(const BinaryExpr* bin);
+    int64_t compareOperands(TokenType op, const Value& left, const Value& right);
+    // Binding caches for variable reads, picked by the expression's address
+    std::array<BindingCache, 256> bindingCaches;
+    Value& lookupVariable(const VariableExpr* var);
+    bool onMainPath() const {
+        return safePointHook && callStack.size() == 1 && env.depth() + 1 == mainPath.size();
+    }
+    void safePoint();
+    void runMain(bool resuming);
+    void runLevel(size_t level, size_t from);
+    void runLoop(const ForStmt* loop, size_t level, int64_t i, int64_t end, int64_t step, bool resuming);
+    void continueLevel(size_t level);
 
 public:
-    Interpreter(const SymbolTable& st) : symbolTable(st) {}
+    Interpreter(const SymbolTable& st);
     void interpret(const Program& program);
+    void setOutput(std::ostream& stream) { out = &stream; }
+    void setEmitHandler(EmitHandler handler) { emitHandler = std::move(handler); }
+    void setSpillOptions(SpillOptions options) { spillOptions = std::move(options); }
+    // Calls `hook` every `quantum` steps (loop iterations and calls), where
+    // a scheduler can suspend the run
+    void setPreemption(size_t quantum, std::function<void()> hook) {
+        preemptQuantum = quantum;
+        preemptHook = std::move(hook);
+    }
+    void define(const std::string& name, Value value); // Host-provided global
+    // Overflow raises "Integer overflow" unless checked is false
+    static int64_t applyIntegerOp(const Token& op, int64_t l, int64_t r, bool checked = true);
+    // Sandboxed use by the optimizer: bind a function, then evaluate
+    // expressions against it under the configured limits
+    void setLimits(size_t steps, size_t callDepth) { stepBudget = steps; maxCallDepth = callDepth; }
+    void define(const FunctionDefStmt* funcDef);
+    Value evaluate(const Expr* expr);
+    std::string formatStackTrace(const RuntimeError& error) const;
+
+    // `hook` is called at every safe point; it may call checkpoint()
+    void setSafePointHook(std::function<void()> hook) { safePointHook = std::move(hook); }
+    // Writes the position, scopes and everything they hold to `state` as it
+    // goes, so a checkpoint is never held in memory whole. Only valid from
+    // inside the safe-point hook.
+    void checkpoint(std::ostream& state);
+    // Continues `program` from a checkpoint taken while running the same
+    // program. `state` may be a mapping of the checkpoint file.
+    void resume(const Program& program, const char* state, size_t size);
 };
 
 } // namespace MyCustomLang
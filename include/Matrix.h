@@ -0,0 +1,52 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace MyCustomLang {
+
+// Dense matrix of integers in one row-major array, so element (i, j) is a
+// single offset and whole rows are contiguous. Operations check shapes and
+// overflow like the interpreter's own arithmetic, throwing
+// std::runtime_error.
+class Matrix {
+public:
+    // Throws std::runtime_error when rows * cols integers cannot be addressed
+    Matrix(size_t rows, size_t cols) : height(rows), width(cols), cells(cellCount(rows, cols)) {}
+
+    size_t rows() const { return height; }
+    size_t cols() const { return width; }
+    int64_t at(size_t i, size_t j) const { return cells[i * width + j]; }
+    int64_t& at(size_t i, size_t j) { return cells[i * width + j]; }
+    const int64_t* row(size_t i) const { return cells.data() + i * width; }
+    int64_t* row(size_t i) { return cells.data() + i * width; }
+    std::string shape() const { return std::to_string(height) + "x" + std::to_string(width); }
+
+private:
+    static size_t cellCount(size_t rows, size_t cols);
+
+    size_t height;
+    size_t width;
+    std::vector<int64_t> cells;
+};
+
+enum class MatrixOp { ADD, SUBTRACT, MULTIPLY, DIVIDE, MIN, MAX, SUM };
+
+// Throws for names other than "+", "-", "*", "/", "min", "max" and, when
+// `reduction` is set, "sum" instead of the four arithmetic ones
+MatrixOp matrixOp(const std::string& name, bool reduction);
+
+Matrix multiply(const Matrix& a, const Matrix& b);
+Matrix transpose(const Matrix& m);
+// `op` applied to each pair of elements; b is either the same shape as a,
+// or 1x1 and paired with every element
+Matrix elementwise(const Matrix& a, const Matrix& b, MatrixOp op);
+// Sum, min or max of each row (axis 1), each column (axis 0), or of every
+// element (any other axis; the result is 1x1)
+Matrix reduce(const Matrix& m, MatrixOp op, int axis);
+
+} // namespace MyCustomLang
+
+#endif // MATRIX_H
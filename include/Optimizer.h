@@ -0,0 +1,137 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "AST.h"
+#include "SymbolTable.h"
+#include "Interpreter.h"
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace MyCustomLang {
+
+struct OptimizerOptions {
+    size_t maxFullUnrollTrips = 8;     // Counted loops this short become straight-line code
+    size_t unrollFactor = 4;           // Body copies per iteration of longer counted loops; 1 disables
+    size_t maxUnrolledStatements = 64; // Cap on the statements one unrolled loop body may grow to
+    size_t maxPeeledIterations = 2;    // Leading iterations split off when that settles a condition
+};
+
+struct OptimizerStats {
+    size_t foldedCalls = 0;
+    size_t removedStatements = 0;
+    size_t unrolledLoops = 0;
+    size_t peeledIterations = 0;
+    size_t removedChecks = 0; // Bounds and overflow checks proven redundant
+    size_t propagatedConstants = 0;
+    size_t jumpTables = 0;
+};
+
+// AST-to-AST passes run between semantic analysis and interpretation. The
+// rewritten Program is what gets executed, so anything folded here is paid
+// for once per compile rather than once per run.
+class Optimizer {
+public:
+    explicit Optimizer(const SymbolTable& symTable, OptimizerOptions opts = OptimizerOptions())
+        : symbolTable(symTable), options(opts) {}
+
+    // Full pipeline. Integer and string `constants` are host globals fixed for
+    // this variant of the program and are propagated as literals; conditions
+    // that become constant have their dead branches and functions removed.
+    OptimizerStats optimize(Program& program, const Bindings& constants = {});
+
+    // Replaces calls to pure functions whose arguments are all literals with
+    // the integer or string they evaluate to. Returns the number of calls folded.
+    size_t foldConstantCalls(Program& program);
+
+private:
+    // What a name is replaced with: a constant, or (for copies of an unrolled
+    // loop body) the loop iterator plus an offset
+    struct Substitution {
+        Value constant;
+        int64_t offset = 0;
+        bool iterator = false; // Not visible inside functions defined in the loop
+    };
+
+    // Values a loop iterator can take anywhere in the loop body (or in a
+    // branch that tested it)
+    struct IteratorRange {
+        std::string name;
+        int64_t lo;
+        int64_t hi;
+        std::string below = ""; // List whose length the iterator is known to stay under
+    };
+
+    const SymbolTable& symbolTable;
+    OptimizerOptions options;
+    std::unordered_map<std::string, const FunctionDefStmt*> pureFunctions;
+    std::unique_ptr<Interpreter> sandbox; // Holds the pure functions seen so far
+    std::unordered_set<std::string> localNames; // Bound inside the functions being folded
+    std::unordered_set<std::string> shadowedBuiltins; // Builtin names the script binds itself
+    size_t folded = 0;
+    std::unordered_map<std::string, Substitution> propagated;
+    std::vector<IteratorRange> ranges; // Enclosing loops, innermost last
+    size_t rangeFolds = 0;
+    bool transformLoops = true; // Unroll and peel; off in passes after the first
+    std::set<std::pair<int, std::string>> unrolled; // Line and iterator of each source loop, however many copies
+    size_t peeled = 0;
+    size_t checksRemoved = 0;
+    std::unordered_set<std::string> reassigned; // Targets of `set` anywhere in the program
+    std::unordered_set<const VarDeclStmt*> globalConstants; // Top-level consts whose name is never bound again
+    size_t constantsPropagated = 0;
+    size_t jumpTables = 0;
+    std::unordered_map<std::string, size_t> references; // Uses of each name outside its own definition
+    std::string currentFunction;
+    size_t removed = 0;
+
+    static constexpr size_t FOLD_STEP_BUDGET = 100000; // Loop iterations and calls per folded call
+    static constexpr size_t FOLD_CALL_DEPTH = 200;
+    static constexpr int64_t LIST_LENGTH_LIMIT = int64_t(1) << 48; // No list gets this long
+
+    bool isPure(const FunctionDefStmt* func) const;
+    bool isPureBody(const std::vector<StmtPtr>& body, std::unordered_set<std::string>& locals,
+                    const std::string& self) const;
+    bool isPureStmt(const Stmt* stmt, std::unordered_set<std::string>& locals, const std::string& self) const;
+    bool isPureExpr(const Expr* expr, const std::unordered_set<std::string>& locals,
+                    const std::string& self) const;
+
+    static void collectBoundNames(const std::vector<StmtPtr>& body, std::unordered_set<std::string>& names,
+                                  bool assignmentsOnly = false);
+    static void collectBoundNames(const Stmt* stmt, std::unordered_set<std::string>& names, bool assignmentsOnly);
+    void findShadowedBuiltins(const Program& program);
+    void simplifyBody(std::vector<StmtPtr>& body);
+    StmtPtr simplifyStmt(StmtPtr stmt);
+    void simplifyExpr(ExprPtr& expr);
+    void countReference(const std::string& name);
+    bool foldByRange(ExprPtr& expr);
+    const IteratorRange* rangeOf(const std::string& name) const;
+    bool intervalOf(const Expr* expr, int64_t& lo, int64_t& hi) const;
+    void removeRedundantChecks(BinaryExpr* bin);
+    void removeRedundantChecks(IndexExpr* index);
+    const VariableExpr* lengthOperand(const Expr* expr) const;
+    StmtPtr simplifyLoop(StmtPtr stmt, size_t peelsLeft);
+    StmtPtr simplifyMatch(StmtPtr stmt);
+    std::vector<StmtPtr> instantiate(const std::vector<StmtPtr>& body, const std::string& name,
+                                     Substitution substitution);
+    std::unordered_map<std::string, Substitution> dropOffsets();
+    bool callsScript(const std::vector<StmtPtr>& body) const;
+    bool callsScript(const Stmt* stmt) const;
+    bool callsScript(const Expr* expr) const;
+    static bool definesFunction(const std::vector<StmtPtr>& body);
+    static size_t countStatements(const std::vector<StmtPtr>& body);
+    static bool literalInteger(const ExprPtr& expr, int64_t& value);
+    void removeUnusedFunctions(Program& program);
+
+    void foldBody(std::vector<StmtPtr>& body);
+    void foldStmt(Stmt* stmt);
+    void foldExpr(ExprPtr& expr);
+    ExprPtr evaluateCall(const CallExpr* call);
+    static ExprPtr makeLiteral(const Value& value, int line);
+};
+
+} // namespace MyCustomLang
+
+#endif // OPTIMIZER_H
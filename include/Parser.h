@@ -27,7 +27,8 @@ private:
 
     Program parseProgram();
     StmtPtr parseStmt();
-    StmtPtr parseVarDecl();
+    StmtPtr parseVarDecl(bool isConst = false);
+    StmtPtr parseDestructure(Token first);
     StmtPtr parseSetStmt();
     StmtPtr parseWhenStmt();
     StmtPtr parseSayStmt();
@@ -39,12 +40,15 @@ private:
     StmtPtr parseFunctionDef();
     StmtPtr parseCallStmt();
     StmtPtr parseReturnStmt();
+    StmtPtr parseModelDef();
+    StmtPtr parseBlockStmt();
     ExprPtr parseCallExpr();
     std::vector<StmtPtr> parseStmtList();
     ExprPtr parseExpr();
     ExprPtr parseAssignment();
     ExprPtr parseBinaryExpr();
     ExprPtr parsePrimary();
+    ExprPtr integerLiteral(const Token& number);
     ExprPtr parseListLiteral();
     ExprPtr parseDictLiteral();
     ExprPtr parseIndexExpr(ExprPtr base);
@@ -0,0 +1,69 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+namespace MyCustomLang {
+
+// Allocation arena backing a `block ... end` scope. Everything allocated from
+// it is dropped in one step by release(); the buffer is kept and reused by the
+// next entry into the block, so a loop wrapping its body in a block settles on
+// a single buffer instead of churning the heap.
+class Region {
+public:
+    explicit Region(size_t capacity = 64 * 1024) : buffer(capacity) {
+        arena.emplace(buffer.data(), buffer.size(), &overflow);
+    }
+
+    Region(const Region&) = delete;
+    Region& operator=(const Region&) = delete;
+
+    std::pmr::memory_resource* resource() { return &*arena; }
+
+    // All values allocated from the region must already be destroyed
+    void release() {
+        arena.reset();
+        if (overflow.bytes > 0) {
+            // The last run spilled past the buffer; size it for next time
+            size_t wanted = std::min(buffer.size() + overflow.bytes, MAX_RETAINED);
+            if (wanted > buffer.size()) {
+                buffer.assign(wanted, std::byte{0});
+            }
+            overflow.bytes = 0;
+        }
+        arena.emplace(buffer.data(), buffer.size(), &overflow);
+    }
+
+private:
+    static constexpr size_t MAX_RETAINED = 16 * 1024 * 1024;
+
+    // Upstream of the arena, counting what did not fit into the buffer
+    class Overflow : public std::pmr::memory_resource {
+    public:
+        size_t bytes = 0;
+
+    private:
+        void* do_allocate(size_t size, size_t alignment) override {
+            bytes += size;
+            return std::pmr::new_delete_resource()->allocate(size, alignment);
+        }
+        void do_deallocate(void* p, size_t size, size_t alignment) override {
+            std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+    };
+
+    std::vector<std::byte> buffer;
+    Overflow overflow;
+    std::optional<std::pmr::monotonic_buffer_resource> arena;
+};
+
+} // namespace MyCustomLang
+
+#endif
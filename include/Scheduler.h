@@ -0,0 +1,100 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "Engine.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace MyCustomLang {
+
+struct SchedulerOptions {
+    size_t workers = 1;          // Threads running tasks
+    size_t quantum = 1000;       // Interpreter steps (loop iterations and calls) per time slice
+    size_t stackBytes = 8 << 20; // Reserved per started task; pages are only committed when touched
+};
+
+struct TaskReport {
+    std::string tenant;
+    std::string name;
+    RunResult result;
+    double waitMs = 0; // Submission to first slice
+    double wallMs = 0; // Submission to completion
+    double cpuMs = 0;
+    size_t slices = 0;
+    size_t doneAtSlice = 0; // Slices of all tasks run when it finished; unlike the times, not skewed by load
+};
+
+struct TenantUsage {
+    std::string name;
+    unsigned weight = 1;
+    int priority = 0;
+    size_t tasks = 0;
+    size_t slices = 0;
+    double cpuMs = 0;
+};
+
+// Runs many scripts on a fixed pool of threads, switching between them
+// every `quantum` interpreter steps so a long script cannot hold a thread
+// while short ones wait. Each task runs on its own coroutine stack and is
+// only ever resumed on the worker that started it: thread-local state such
+// as errno and the exception being handled by a script's catch body stays
+// with the task across a switch.
+//
+// The next slice goes to a ready task of the highest priority present;
+// among tenants of that priority, to the one with the least CPU time used
+// divided by its weight, so over time tenants share the CPU in proportion
+// to their weights. A tenant that was idle starts level with the busiest
+// rather than cashing in the time it did not use.
+class Scheduler {
+public:
+    explicit Scheduler(Engine& engine, SchedulerOptions opts = SchedulerOptions());
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // Tenants not added explicitly get weight 1 and priority 0
+    void addTenant(const std::string& name, unsigned weight = 1, int priority = 0);
+
+    // Queues a script. Safe to call from any thread, including while run()
+    // is in progress; a task submitted before that run() returns is run by
+    // it, one submitted later by the next run(). Returns the task's index
+    // into run()'s result.
+    size_t submit(const std::string& tenant, const std::string& name, std::string source, Bindings globals = {});
+
+    // Runs every submitted task to completion. Reports are in submission order.
+    std::vector<TaskReport> run();
+
+    std::vector<TenantUsage> usage() const;
+
+private:
+    struct Tenant;
+    struct Task;
+
+    Engine& engine;
+    SchedulerOptions options;
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::map<std::string, std::unique_ptr<Tenant>> tenants;
+    std::vector<std::unique_ptr<Task>> tasks;
+    size_t unfinished = 0;
+    size_t slicesRun = 0;
+
+    Tenant& tenantFor(const std::string& name);
+    void makeReady(Task& task);
+    Task* pickReady(size_t worker);
+    void workerLoop(size_t worker);
+    bool startTask(Task& task);
+    void runTask(Task& task);
+    static void taskEntry(uint32_t high, uint32_t low);
+};
+
+} // namespace MyCustomLang
+
+#endif // SCHEDULER_H
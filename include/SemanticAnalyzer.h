@@ -5,6 +5,9 @@
 #include "Type.h"
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace MyCustomLang {
 class Program;
@@ -30,10 +33,27 @@ public:
 
 private:
     SymbolTable& symbolTable;
+    std::unordered_map<std::string, FunctionDefStmt*> functionDefs;
+    std::vector<Type> returnTypes; // Return type inferred so far, per function being analyzed
+    std::vector<std::unordered_set<std::string>> enclosingLocals; // Names bound by each function being analyzed
+    std::vector<std::unordered_set<std::string>> boundLocals;     // The subset bound before the current statement
+
+    static const size_t MAX_SPECIALIZATIONS = 4; // Typed versions per function
 
     void analyzeStmt(Stmt* stmt);
     void analyzeExpr(Expr* expr);
     Type inferExprType(Expr* expr);
+    Type analyzeFunctionBody(FunctionDefStmt* func, const std::vector<Type>& paramTypes);
+    Type analyzeCall(const Token& name, std::vector<ExprPtr>& arguments, int& specialization);
+    std::string recordModelOf(Expr* expr);
+    void checkAssignable(const Token& name);
+    void checkAssignable(const Expr* target);
+    void findCaptures(FunctionDefStmt* func);
+    void noteBound(const Token& name);
+    static void collectBindings(const std::vector<StmtPtr>& body, std::unordered_set<std::string>& names);
+    static void collectUses(const std::vector<StmtPtr>& body, std::vector<Token>& uses, std::vector<Token>& assigned);
+    static void collectUses(const Expr* expr, std::vector<Token>& uses, std::vector<Token>& assigned);
+    static bool isIntegerLike(Type type);
     void checkTypeCompatibility(Type expected, Type actual, const Token& token);
     void updateFunctionReturnType(const std::string& funcName, Type returnType);
 };
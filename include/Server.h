@@ -0,0 +1,80 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "Engine.h"
+#include <string>
+#include <vector>
+
+namespace MyCustomLang {
+
+constexpr const char* DEFAULT_SOCKET_PATH = "/tmp/nova.sock";
+
+// One script run requested over the socket. Either `path` names a file the
+// server reads, or `source` carries the script text.
+struct ScriptRequest {
+    std::string path;
+    std::string source;
+    std::vector<std::string> bindings; // `name=value`, as given to --bind
+    bool shutdown = false;             // Stop the server instead of running anything
+};
+
+// Messages are sequences of `<tag> <length>\n<bytes>` fields, written in full
+// and terminated by closing the writing side of the connection.
+std::string encodeRequest(const ScriptRequest& request);
+bool decodeRequest(const std::string& message, ScriptRequest& request);
+std::string encodeResult(const RunResult& result);
+bool decodeResult(const std::string& message, RunResult& result);
+
+struct ServerOptions {
+    size_t workers = 0;        // Forked worker processes; 0 serves from the server process itself
+    size_t maxRequests = 0;    // Requests a worker handles before it is replaced; 0 is unlimited
+    size_t maxResidentKb = 0;  // Resident size past which a worker is replaced; 0 is unlimited
+    size_t cacheCapacity = 256; // Compiled variants the engine keeps, least recently used evicted first; 0 is unlimited
+    size_t maxRequestKb = 16384; // Largest request read from a client; 0 is unlimited
+    size_t requestTimeoutMs = 10000; // Time a client has to send its whole request; 0 waits forever
+    std::vector<std::string> preload; // Scripts compiled before any worker is forked
+};
+
+// `nova serve`: a long-running process that answers script requests on a
+// Unix domain socket. Its Engine lives as long as the server, so a script
+// seen before skips lexing, parsing, analysis and optimization entirely.
+// Requests are handled one at a time, in arrival order.
+//
+// With workers, the server compiles the preload scripts and then forks a
+// pool that inherits the warm Engine copy-on-write. Each worker accepts
+// and runs requests in its own process, so a script that crashes or leaks
+// takes down only its worker; the server forks a replacement whenever a
+// worker exits, including when it retires itself after maxRequests
+// requests or on growing past maxResidentKb. Replacements for workers that
+// fail right after starting are forked with a growing delay, and the
+// server gives up after ten such failures in a row.
+class ScriptServer {
+public:
+    explicit ScriptServer(std::string socketPath, ServerOptions opts = ServerOptions())
+        : socketPath(std::move(socketPath)), options(std::move(opts)), engine(options.cacheCapacity) {}
+
+    // Listens until a shutdown request arrives. Returns the process exit status.
+    int serve();
+
+    // Runs one request against the warm engine
+    RunResult handle(const ScriptRequest& request);
+
+private:
+    std::string socketPath;
+    ServerOptions options;
+    Engine engine;
+    bool acceptFailed = false; // Set in a worker whose listener stopped working
+
+    // Accepts and answers connections until a shutdown request, or until
+    // this worker should be recycled. Returns true on a shutdown request.
+    bool acceptLoop(int listener, bool worker);
+    int superviseWorkers(int listener);
+};
+
+// `nova client`: sends one request to a server and waits for its result.
+// Throws std::runtime_error when the server cannot be reached.
+RunResult sendRequest(const std::string& socketPath, const ScriptRequest& request);
+
+} // namespace MyCustomLang
+
+#endif // SERVER_H
@@ -0,0 +1,26 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "Engine.h"
+#include <string>
+#include <vector>
+
+namespace MyCustomLang {
+
+struct ShardReport {
+    std::vector<RunResult> shards; // In shard order
+    List results;                  // Every emitted value, shard by shard, in emission order
+};
+
+// Shared-nothing parallel run of one script. The script is compiled once
+// with the integer globals `shard` and `shards`, then one process is forked
+// per shard; each runs the script with its own `shard` number and its own
+// heap, splits the work on that number and hands results back with
+// `call emit(value)`. Emitted values travel to the driver through one
+// shared-memory ring per shard, `ringBytes` each, in the ValueCodec form.
+// Throws std::runtime_error when the script does not compile.
+ShardReport runSharded(Engine& engine, const std::string& source, size_t shards, size_t ringBytes = 1 << 20);
+
+} // namespace MyCustomLang
+
+#endif // SHARD_H
@@ -0,0 +1,77 @@
+#ifndef SPILL_LIST_H
+#define SPILL_LIST_H
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace MyCustomLang {
+
+struct SpillOptions {
+    std::string directory;       // Where spill files go; empty means $TMPDIR, else /tmp
+    // load_ints keeps lists of up to this many integers in memory, where
+    // each takes a whole Value (72 bytes on x86-64): about 75 MB at most
+    size_t threshold = 1 << 20;
+    size_t residentChunks = 64;  // Chunks each spilled list keeps mapped at once
+};
+
+// A list of integers kept in a spill file instead of in memory. The file
+// is mapped one chunk at a time, and only the most recently used chunks
+// stay mapped, so a scan over a list far larger than memory works within a
+// fixed window. The file is unlinked as soon as it is created, so it goes
+// away with the process. Not safe to share between threads.
+class SpillList {
+public:
+    static constexpr size_t CHUNK_INTEGERS = size_t(1) << 17; // 1 MiB per mapping
+
+    // An empty list with a new spill file. Throws std::runtime_error if the
+    // file cannot be created.
+    explicit SpillList(const SpillOptions& options);
+    ~SpillList();
+
+    SpillList(const SpillList&) = delete;
+    SpillList& operator=(const SpillList&) = delete;
+
+    size_t size() const { return count; }
+    int64_t get(size_t index) { return chunk(index)[index % CHUNK_INTEGERS]; }
+    void set(size_t index, int64_t value) { chunk(index)[index % CHUNK_INTEGERS] = value; }
+    void append(int64_t value);
+    // Elements from `index` to the end of its chunk (or of the list), as one
+    // array of `length`; valid until this list maps another chunk
+    const int64_t* run(size_t index, size_t& length) {
+        length = std::min(count - index, CHUNK_INTEGERS - index % CHUNK_INTEGERS);
+        return chunk(index) + index % CHUNK_INTEGERS;
+    }
+
+    // A copy with its own spill file, for writing to a list that other
+    // values still hold
+    std::shared_ptr<SpillList> clone();
+
+private:
+    struct Mapping {
+        size_t chunk;
+        int64_t* data;
+    };
+
+    SpillOptions options;
+    int fd = -1;
+    size_t count = 0;
+    size_t capacity = 0; // Integers the file has room for; always whole chunks
+    std::list<Mapping> resident; // Most recently used first
+    std::unordered_map<size_t, std::list<Mapping>::iterator> byChunk;
+    size_t lastChunk = SIZE_MAX; // Fast path for runs of accesses to one chunk
+    int64_t* lastData = nullptr;
+
+    int64_t* chunk(size_t index) {
+        size_t number = index / CHUNK_INTEGERS;
+        return number == lastChunk ? lastData : map(number);
+    }
+    int64_t* map(size_t number);
+};
+
+} // namespace MyCustomLang
+
+#endif // SPILL_LIST_H
@@ -0,0 +1,42 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "Engine.h"
+#include <istream>
+#include <ostream>
+#include <string>
+
+namespace MyCustomLang {
+
+// How stream input is split into records and what the script sees for each:
+// a line as a string, a CSV row as a list of strings (quoted fields may span
+// lines), or a JSON object per line as a dictionary
+enum class RecordFormat { LINES, CSV, JSONL };
+
+struct StreamOptions {
+    RecordFormat format = RecordFormat::LINES;
+    size_t jobs = 1;           // Threads running records; 1 runs them on the calling thread
+    size_t chunkRecords = 512; // Records handed to a thread at a time
+};
+
+struct StreamSummary {
+    size_t records = 0;
+    size_t failed = 0; // Records whose run raised a runtime error
+};
+
+// Globals a stream script is compiled against: `record`, typed for the
+// format, and its 1-based `record_number`
+Bindings streamGlobals(RecordFormat format);
+
+// Parses one record. Throws std::runtime_error on malformed JSON.
+Value parseRecord(const std::string& text, RecordFormat format);
+
+// Runs `script` (compiled against streamGlobals) once per record read from
+// `in`. Output is written to `out` in input order, whatever the number of
+// jobs; each failing record's error goes to `errors`, and the stream carries on.
+StreamSummary runStream(const CompiledScript& script, std::istream& in, std::ostream& out, std::ostream& errors,
+                        const StreamOptions& options = StreamOptions());
+
+} // namespace MyCustomLang
+
+#endif // STREAM_H
@@ -14,8 +14,11 @@ struct Symbol {
     Token name;
     Type type;
     bool isLong;
-    std::vector<Token> parameters;
+    std::vector<Token> parameters; // Parameters for functions, fields for models
     Type returnType;
+    std::string modelName;         // Model of a RECORD-typed variable, if known
+    std::vector<Type> fieldTypes;  // Slot types of a model, indexed like parameters
+    bool isConst = false;          // Declared with `const`
 
     Symbol() : name(TokenType::UNKNOWN, "", 0), type(Type::NONE), isLong(false), parameters(), returnType(Type::NONE) {}
     Symbol(Token n, Type t, bool l = false, std::vector<Token> p = {})
@@ -26,6 +29,7 @@ class SymbolTable {
 private:
     std::vector<std::map<std::string, Symbol>> scopes;
     size_t currentScope;
+    size_t scriptScope = 0; // Outermost scope of the script's own declarations
 
 public:
     SymbolTable() : currentScope(0) {
@@ -39,6 +43,7 @@ public:
 
     void exitScope() {
         if (currentScope > 0) {
+            scopes.pop_back();
             currentScope--;
         } else {
             throw std::runtime_error("Cannot exit global scope");
@@ -48,8 +53,18 @@ public:
     void addSymbol(const Token& name, const Token& typeHint, bool isLong, const std::vector<Token>& params = {});
     void addSymbol(const Token& name, Type type, bool isLong, const std::vector<Token>& params = {});
 
+    // Ends the scope the runtime's builtins were declared in. The script's
+    // globals get a scope of their own inside it, so any declaration may
+    // reuse a builtin's name and hides the builtin where it is visible.
+    void closeBuiltinScope() {
+        enterScope();
+        scriptScope = currentScope;
+    }
+
     bool symbolExists(const std::string& name) const;
     bool symbolExistsInCurrentScope(const std::string& name) const; // New method
+    bool declaredByScript(const std::string& name) const; // Like symbolExists, ignoring builtins
+    bool isBuiltin(const std::string& name) const;         // Not hidden by a script declaration
 
     Symbol getSymbol(const std::string& name) const {
         for (size_t i = currentScope; ; --i) {
@@ -64,6 +79,9 @@ public:
 
     void updateSymbolType(const std::string& name, Type type);
     void updateSymbolReturnType(const std::string& name, Type returnType);
+    void updateSymbolModel(const std::string& name, const std::string& modelName);
+    void updateModelFieldType(const std::string& model, size_t slot, Type type);
+    void markConstant(const std::string& name);
 
     const std::vector<std::map<std::string, Symbol>>& getScopes() const {
         return scopes;
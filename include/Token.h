@@ -7,7 +7,7 @@ namespace MyCustomLang {
 
 enum class TokenType {
     // Keywords
-    LET, SET, BE, AS,
+    LET, CONST, SET, BE, AS,
     SAY,
     WHEN, THEN, OTHERWISE,
     MATCH, CASE,
@@ -32,7 +32,7 @@ enum class TokenType {
     LEFT_BRACE, RIGHT_BRACE,
     LEFT_BRACKET, RIGHT_BRACKET,
     SEMICOLON, COMMA,
-    COLON,
+    COLON, DOT,
 
     // Special
     NONE,
@@ -52,6 +52,7 @@ inline std::string tokenTypeToString(TokenType type) {
     switch (type) {
         // Keywords
         case TokenType::LET: return "LET";
+        case TokenType::CONST: return "CONST";
         case TokenType::SET: return "SET";
         case TokenType::BE: return "BE";
         case TokenType::AS: return "AS";
@@ -122,6 +123,7 @@ inline std::string tokenTypeToString(TokenType type) {
         case TokenType::SEMICOLON: return "SEMICOLON";
         case TokenType::COMMA: return "COMMA";
         case TokenType::COLON: return "COLON";
+        case TokenType::DOT: return "DOT";
 
         // Special
         case TokenType::NONE: return "NONE";
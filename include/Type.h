@@ -10,6 +10,8 @@ enum class Type {
     LIST,
     DICT,
     FUNCTION,
+    MODEL,
+    RECORD,
     ERROR
 };
 
@@ -22,6 +24,8 @@ inline std::string typeToString(Type type) {
         case Type::LIST: return "LIST";
         case Type::DICT: return "DICT";
         case Type::FUNCTION: return "FUNCTION";
+        case Type::MODEL: return "MODEL";
+        case Type::RECORD: return "RECORD";
         case Type::ERROR: return "ERROR";
         default: return "UNKNOWN";
     }
@@ -0,0 +1,39 @@
+#ifndef VALUE_CODEC_H
+#define VALUE_CODEC_H
+
+#include "Interpreter.h"
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace MyCustomLang {
+
+// Self-contained binary form of plain-data Values, for handing them to
+// another process on the same machine: nothing, integers, strings, lists,
+// dictionaries and matrices. A list made up entirely of integers, like a
+// matrix, is written as one packed array, so it is decoded in a single pass
+// without per-element tags.
+// Encoding anything else throws std::runtime_error, unless `references` is
+// given: functions, closures, models and records are then written as
+// references into the running program, and only decode against the same one.
+// Lazy sequences are written as their steps, so they need `references` too.
+// Spilled lists are decoded as ordinary lists, unless `references` can make
+// spill lists; they are then written so that decoding spills them again.
+struct ProgramReferences {
+    std::function<uint64_t(const FunctionDefStmt&)> functionNumber;
+    std::function<std::shared_ptr<FunctionDefStmt>(uint64_t)> function;
+    std::function<std::shared_ptr<ModelDefStmt>(const std::string&)> model;
+    std::function<std::shared_ptr<SpillList>()> spillList; // An empty list with a new spill file
+};
+
+void encodeValue(const Value& value, std::string& out, const ProgramReferences* references = nullptr);
+// The same encoding, written to `out` as it is produced
+void encodeValue(const Value& value, std::ostream& out, const ProgramReferences* references = nullptr);
+
+// Decodes one value starting at `data` and advances `data` past it.
+// Throws std::runtime_error on truncated or malformed input.
+Value decodeValue(const char*& data, const char* end, const ProgramReferences* references = nullptr);
+
+} // namespace MyCustomLang
+
+#endif // VALUE_CODEC_H
@@ -0,0 +1,373 @@
+#include "Interpreter.h"
+#include "Builtins.h"
+#include <algorithm>
+#include <limits>
+#include <string_view>
+#include <thread>
+
+namespace MyCustomLang {
+
+namespace {
+
+enum class Aggregation { GROUP, SUM, COUNT, MIN, MAX, AVG };
+
+constexpr size_t PARALLEL_ROWS = 1 << 16; // Fewest rows worth giving a thread of its own
+constexpr size_t SAMPLE_ROWS = 1024;      // Rows whose keys are counted to size the table
+
+// Picks a key or value out of a row: a field of a record, a key of a
+// dictionary, a position in a list, or whatever a function returns
+struct Selector {
+    const Value* source = nullptr;
+    std::shared_ptr<FunctionDefStmt> function;
+    const Closure* closure = nullptr;
+    const ModelDefStmt* model = nullptr; // Record model last seen, and where the field is in it
+    size_t slot = 0;
+};
+
+// Open-addressing table from group key to group number, probing linearly.
+// Buckets hold group numbers; keys and their hashes are stored once per
+// group, in the order groups were first seen.
+class GroupTable {
+public:
+    explicit GroupTable(size_t expected) {
+        size_t capacity = 16;
+        while (capacity < expected * 2) capacity *= 2; // At most half full before growing
+        buckets.assign(capacity, EMPTY);
+        keys.reserve(expected);
+        hashes.reserve(expected);
+    }
+
+    size_t size() const { return keys.size(); }
+    const std::string& key(size_t group) const { return keys[group]; }
+    uint64_t hash(size_t group) const { return hashes[group]; }
+
+    // Group number of `key`, adding a group when it is new
+    size_t find(std::string_view key, uint64_t hash, bool& added) {
+        size_t mask = buckets.size() - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+            uint32_t group = buckets[i];
+            if (group == EMPTY) {
+                added = true;
+                buckets[i] = static_cast<uint32_t>(keys.size());
+                keys.emplace_back(key);
+                hashes.push_back(hash);
+                if (keys.size() * 2 > buckets.size()) grow();
+                return keys.size() - 1;
+            }
+            if (hashes[group] == hash && keys[group] == key) {
+                added = false;
+                return group;
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> buckets;
+    std::vector<std::string> keys;
+    std::vector<uint64_t> hashes;
+
+    void grow() {
+        buckets.assign(buckets.size() * 2, EMPTY);
+        size_t mask = buckets.size() - 1;
+        for (size_t group = 0; group < keys.size(); ++group) {
+            size_t i = hashes[group] & mask;
+            while (buckets[i] != EMPTY) i = (i + 1) & mask;
+            buckets[i] = static_cast<uint32_t>(group);
+        }
+    }
+};
+
+// Groups and running totals for some of the rows
+struct Partial {
+    GroupTable table;
+    std::vector<__int128> sums; // Wide enough that no run of int64 values overflows it
+    std::vector<int64_t> counts;
+    std::vector<int64_t> extremes; // MIN, MAX
+    std::vector<List> members;     // GROUP
+
+    explicit Partial(size_t expected) : table(expected) {}
+};
+
+uint64_t hashKey(std::string_view key) {
+    return std::hash<std::string_view>{}(key);
+}
+
+// Text of a group key; dictionary keys are strings, so 7 and "7" are one group
+std::string_view keyText(const Value& key, std::string& buffer) {
+    if (auto* text = std::get_if<std::string>(&key)) return *text;
+    if (auto* number = std::get_if<int64_t>(&key)) {
+        buffer = std::to_string(*number);
+        return buffer;
+    }
+    throw std::runtime_error("Group keys must be integers or strings");
+}
+
+// The value a field or position selector picks; never called for functions
+const Value& pickField(Selector& selector, const Value& row) {
+    if (auto* name = std::get_if<std::string>(selector.source)) {
+        if (auto* record = std::get_if<Record>(&row)) {
+            if (record->model.get() != selector.model) {
+                const auto& fields = record->model->fields;
+                auto field = std::find_if(fields.begin(), fields.end(),
+                                          [&](const Token& f) { return f.lexeme == *name; });
+                if (field == fields.end()) {
+                    throw std::runtime_error("Row has no field '" + *name + "'");
+                }
+                selector.model = record->model.get();
+                selector.slot = static_cast<size_t>(field - fields.begin());
+            }
+            return record->slots[selector.slot];
+        }
+        if (auto* dict = std::get_if<Dict>(&row)) {
+            auto found = dict->find(*name);
+            if (found == dict->end()) {
+                throw std::runtime_error("Row has no key '" + *name + "'");
+            }
+            return found->second;
+        }
+        if (auto* dict = std::get_if<PersistentDict>(&row)) {
+            const Value* found = dict->find(*name);
+            if (!found) {
+                throw std::runtime_error("Row has no key '" + *name + "'");
+            }
+            return *found;
+        }
+        throw std::runtime_error("Rows selected by name must be records or dictionaries");
+    }
+    auto* list = std::get_if<List>(&row);
+    int64_t position = std::get<int64_t>(*selector.source);
+    if (!list) {
+        throw std::runtime_error("Rows selected by position must be lists");
+    }
+    if (position < 0 || position >= static_cast<int64_t>(list->size())) {
+        throw std::runtime_error("List index out of bounds");
+    }
+    return (*list)[position];
+}
+
+void addRow(Partial& partial, Aggregation aggregation, const Value& row, const Value& key, const Value* value,
+            std::string& buffer) {
+    std::string_view text = keyText(key, buffer);
+    bool added = false;
+    size_t group = partial.table.find(text, hashKey(text), added);
+    if (aggregation == Aggregation::GROUP) {
+        if (added) partial.members.emplace_back();
+        partial.members[group].push_back(row);
+        return;
+    }
+    int64_t number = 0;
+    if (aggregation != Aggregation::COUNT) {
+        if (!std::holds_alternative<int64_t>(*value)) {
+            throw std::runtime_error("Aggregated values must be integers");
+        }
+        number = std::get<int64_t>(*value);
+    }
+    if (added) {
+        partial.sums.push_back(0);
+        partial.counts.push_back(0);
+        partial.extremes.push_back(number);
+    }
+    partial.sums[group] += number;
+    partial.counts[group]++;
+    if (aggregation == Aggregation::MIN) partial.extremes[group] = std::min(partial.extremes[group], number);
+    if (aggregation == Aggregation::MAX) partial.extremes[group] = std::max(partial.extremes[group], number);
+}
+
+// Folds `from` into `into`; `from` covers rows after those of `into`
+void merge(Partial& into, Partial& from, Aggregation aggregation) {
+    for (size_t source = 0; source < from.table.size(); ++source) {
+        bool added = false;
+        size_t group = into.table.find(from.table.key(source), from.table.hash(source), added);
+        if (aggregation == Aggregation::GROUP) {
+            if (added) {
+                into.members.push_back(std::move(from.members[source]));
+            } else {
+                auto& members = into.members[group];
+                for (auto& row : from.members[source]) members.push_back(std::move(row));
+            }
+            continue;
+        }
+        if (added) {
+            into.sums.push_back(from.sums[source]);
+            into.counts.push_back(from.counts[source]);
+            into.extremes.push_back(from.extremes[source]);
+            continue;
+        }
+        into.sums[group] += from.sums[source];
+        into.counts[group] += from.counts[source];
+        if (aggregation == Aggregation::MIN) into.extremes[group] = std::min(into.extremes[group], from.extremes[source]);
+        if (aggregation == Aggregation::MAX) into.extremes[group] = std::max(into.extremes[group], from.extremes[source]);
+    }
+}
+
+} // namespace
+
+// group_by(rows, key) and aggregate(rows, key, value, op). Keys and values
+// are picked by a field or dictionary key name, a list position, or a
+// function of the row. With no functions involved, large inputs are split
+// into contiguous runs of rows, each grouped on its own thread into its own
+// table, and the tables are merged in row order at the end.
+Value Interpreter::groupRows(const BuiltinSignature& builtin, std::vector<Value>& args) {
+    Value collected;
+    const List* rows = std::get_if<List>(&args[0]);
+    if (auto* sequence = std::get_if<std::shared_ptr<const Sequence>>(&args[0])) {
+        collected = collectSequence(**sequence);
+        rows = &std::get<List>(collected);
+    } else if (auto* matrix = std::get_if<std::shared_ptr<Matrix>>(&args[0])) {
+        List matrixRows(allocationResource());
+        matrixRows.reserve((*matrix)->rows());
+        for (size_t i = 0; i < (*matrix)->rows(); ++i) {
+            const int64_t* row = (*matrix)->row(i);
+            matrixRows.emplace_back(List(row, row + (*matrix)->cols(), allocationResource()));
+        }
+        collected = std::move(matrixRows);
+        rows = &std::get<List>(collected);
+    }
+    if (!rows) {
+        throw std::runtime_error(builtin.name + " expects a list of rows");
+    }
+
+    Aggregation aggregation = Aggregation::GROUP;
+    if (builtin.name == "aggregate") {
+        static const std::pair<const char*, Aggregation> names[] = {
+            {"sum", Aggregation::SUM}, {"count", Aggregation::COUNT}, {"min", Aggregation::MIN},
+            {"max", Aggregation::MAX}, {"avg", Aggregation::AVG}};
+        auto* op = std::get_if<std::string>(&args[3]);
+        auto named = std::find_if(std::begin(names), std::end(names),
+                                  [&](const auto& entry) { return op && *op == entry.first; });
+        if (named == std::end(names)) {
+            throw std::runtime_error("aggregate expects one of \"sum\", \"count\", \"min\", \"max\" or \"avg\"");
+        }
+        aggregation = named->second;
+    }
+
+    bool callsFunctions = false;
+    auto selectorOf = [&](const Value& source) {
+        Selector selector;
+        selector.source = &source;
+        if (auto* plain = std::get_if<std::shared_ptr<FunctionDefStmt>>(&source)) {
+            selector.function = *plain;
+        } else if (auto* closure = std::get_if<std::shared_ptr<Closure>>(&source)) {
+            selector.closure = closure->get();
+            selector.function = (*closure)->function;
+        } else if (!std::holds_alternative<std::string>(source) && !std::holds_alternative<int64_t>(source)) {
+            throw std::runtime_error(builtin.name + " selectors must be a field name, a position or a function");
+        }
+        if (selector.function && selector.function->parameters.size() != 1) {
+            throw std::runtime_error(builtin.name + " expects selector functions of one argument");
+        }
+        callsFunctions = callsFunctions || selector.function;
+        return selector;
+    };
+    Selector keySelector = selectorOf(args[1]);
+    bool hasValue = aggregation != Aggregation::GROUP && aggregation != Aggregation::COUNT;
+    Selector valueSelector = hasValue ? selectorOf(args[2]) : keySelector;
+
+    // Sized from the distinct keys among the first rows: few distinct keys
+    // there suggest few overall, many suggest about one group per row
+    size_t expected = 0;
+    if (!callsFunctions && !rows->empty()) {
+        GroupTable sample(SAMPLE_ROWS);
+        Selector probe = keySelector;
+        std::string buffer;
+        size_t sampled = std::min(rows->size(), SAMPLE_ROWS);
+        for (size_t i = 0; i < sampled; ++i) {
+            std::string_view text = keyText(pickField(probe, (*rows)[i]), buffer);
+            bool added = false;
+            sample.find(text, hashKey(text), added);
+        }
+        expected = sample.size() * 2 > sampled ? rows->size() * sample.size() / sampled : sample.size() * 2;
+    }
+
+    size_t workers = 1;
+    if (!callsFunctions) {
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        workers = std::max<size_t>(1, std::min(threads, rows->size() / PARALLEL_ROWS));
+    }
+
+    std::vector<Partial> partials;
+    partials.reserve(workers);
+    if (workers == 1) {
+        partials.emplace_back(expected);
+        std::string buffer;
+        Value key, value;
+        for (const auto& row : *rows) {
+            tick();
+            auto pick = [&](Selector& selector, Value& scratch) -> const Value& {
+                if (!selector.function) return pickField(selector, row);
+                std::vector<Value> argument{row};
+                scratch = invokeFunction(selector.function, selector.closure, argument, -1);
+                return scratch;
+            };
+            const Value& keyValue = pick(keySelector, key);
+            const Value* picked = hasValue ? &pick(valueSelector, value) : nullptr;
+            addRow(partials[0], aggregation, row, keyValue, picked, buffer);
+        }
+    } else {
+        tick();
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> errors(workers);
+        for (size_t w = 0; w < workers; ++w) {
+            partials.emplace_back(expected / workers + 1);
+        }
+        for (size_t w = 0; w < workers; ++w) {
+            threads.emplace_back([&, w] {
+                try {
+                    Selector keys = keySelector;
+                    Selector values = valueSelector;
+                    std::string buffer;
+                    size_t begin = rows->size() * w / workers;
+                    size_t end = rows->size() * (w + 1) / workers;
+                    for (size_t i = begin; i < end; ++i) {
+                        const Value& row = (*rows)[i];
+                        addRow(partials[w], aggregation, row, pickField(keys, row),
+                               hasValue ? &pickField(values, row) : nullptr, buffer);
+                    }
+                } catch (...) {
+                    errors[w] = std::current_exception();
+                }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        for (const auto& error : errors) {
+            if (error) std::rethrow_exception(error); // The first failing run holds the first failing row
+        }
+        for (size_t w = 1; w < workers; ++w) {
+            merge(partials[0], partials[w], aggregation);
+        }
+    }
+
+    Partial& result = partials[0];
+    Dict groups(allocationResource());
+    groups.reserve(result.table.size());
+    for (size_t group = 0; group < result.table.size(); ++group) {
+        const std::string& key = result.table.key(group);
+        if (aggregation == Aggregation::GROUP) {
+            groups.emplace(key, std::move(result.members[group]));
+            continue;
+        }
+        __int128 total = result.sums[group];
+        int64_t count = result.counts[group];
+        switch (aggregation) {
+        case Aggregation::SUM:
+            if (total > std::numeric_limits<int64_t>::max() || total < std::numeric_limits<int64_t>::min()) {
+                throw std::runtime_error("Integer overflow");
+            }
+            groups.emplace(key, static_cast<int64_t>(total));
+            break;
+        case Aggregation::COUNT:
+            groups.emplace(key, count);
+            break;
+        case Aggregation::AVG:
+            groups.emplace(key, static_cast<int64_t>(total / count)); // Rounded toward zero, like `/`
+            break;
+        default:
+            groups.emplace(key, result.extremes[group]);
+            break;
+        }
+    }
+    return groups;
+}
+
+} // namespace MyCustomLang
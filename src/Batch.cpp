@@ -0,0 +1,95 @@
+#include "Batch.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <glob.h>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace MyCustomLang {
+
+namespace {
+
+void expandPattern(const std::string& pattern, std::vector<std::string>& paths) {
+    glob_t matches{};
+    if (::glob(pattern.c_str(), 0, nullptr, &matches) == 0) {
+        for (size_t i = 0; i < matches.gl_pathc; ++i) {
+            paths.push_back(matches.gl_pathv[i]);
+        }
+    }
+    ::globfree(&matches);
+}
+
+void expandInput(const std::string& input, std::vector<std::string>& paths, bool inManifest) {
+    if (input.find_first_of("*?[") != std::string::npos) {
+        expandPattern(input, paths);
+    } else if (inManifest || (input.size() > 3 && input.compare(input.size() - 3, 3, ".ns") == 0)) {
+        paths.push_back(input);
+    } else {
+        std::ifstream manifest(input);
+        if (!manifest.is_open()) {
+            throw std::runtime_error("Could not open manifest '" + input + "'.");
+        }
+        std::string line;
+        while (std::getline(manifest, line)) {
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == std::string::npos || line[start] == '#') continue;
+            size_t end = line.find_last_not_of(" \t\r");
+            expandInput(line.substr(start, end - start + 1), paths, true);
+        }
+    }
+}
+
+} // namespace
+
+std::vector<std::string> expandBatchInputs(const std::vector<std::string>& inputs) {
+    std::vector<std::string> paths;
+    for (const auto& input : inputs) {
+        expandInput(input, paths, false);
+    }
+    return paths;
+}
+
+std::vector<BatchEntry> runBatch(Engine& engine, const std::vector<std::string>& paths, size_t jobs) {
+    std::vector<BatchEntry> entries(paths.size());
+    std::atomic<size_t> next{0};
+
+    auto work = [&]() {
+        for (size_t i = next++; i < paths.size(); i = next++) {
+            BatchEntry& entry = entries[i];
+            entry.path = paths[i];
+            auto start = std::chrono::steady_clock::now();
+            std::ifstream file(paths[i]);
+            if (!file.is_open()) {
+                entry.result.status = 1;
+                entry.result.errors = "Could not open file '" + paths[i] + "'.\n";
+            } else {
+                std::stringstream buffer;
+                buffer << file.rdbuf();
+                try {
+                    entry.result = engine.execute(buffer.str(), {});
+                } catch (const std::exception& e) { // Must not escape the thread
+                    entry.result.status = 1;
+                    entry.result.errors = std::string("Error: ") + e.what() + "\n";
+                }
+            }
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            entry.milliseconds = elapsed.count();
+        }
+    };
+
+    jobs = std::max<size_t>(1, std::min(jobs, paths.size()));
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < jobs; ++t) {
+        threads.emplace_back(work);
+    }
+    work(); // The calling thread is one of the workers
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return entries;
+}
+
+} // namespace MyCustomLang
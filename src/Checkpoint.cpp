@@ -0,0 +1,205 @@
+#include "Interpreter.h"
+#include "ValueCodec.h"
+#include <sstream>
+#include <stdexcept>
+
+namespace MyCustomLang {
+
+// Interpreter::checkpoint and Interpreter::resume. A checkpoint is a magic
+// string followed by encoded Values: the program's fingerprint, the main
+// path as (index, loop, value, end, step) per level, then every scope as a
+// count and (name, value) pairs. Functions and models in those values are
+// written as references into the program's AST, so a checkpoint is only
+// restored against the program it was taken of. Spilled lists are written
+// out in full and spilled again on resume.
+
+namespace {
+
+const std::string CHECKPOINT_MAGIC = "NOVACKPT2";
+
+// Every function definition in the program, numbered in source order, and
+// every model; the numbering is the same each time the program is parsed
+struct ProgramDefinitions {
+    std::vector<const FunctionDefStmt*> functions;
+    std::unordered_map<const FunctionDefStmt*, uint64_t> numbers;
+    std::unordered_map<std::string, const ModelDefStmt*> models;
+
+    void collect(const std::vector<StmtPtr>& body) {
+        for (const auto& stmt : body) {
+            collect(stmt.get());
+        }
+    }
+
+    void collect(const Stmt* stmt) {
+        if (auto* func = dynamic_cast<const FunctionDefStmt*>(stmt)) {
+            numbers.emplace(func, functions.size());
+            functions.push_back(func);
+            collect(func->body);
+            for (const auto& specialization : func->specializations) {
+                collect(specialization.get());
+            }
+        } else if (auto* model = dynamic_cast<const ModelDefStmt*>(stmt)) {
+            models.emplace(model->name.lexeme, model);
+        } else if (auto* when = dynamic_cast<const WhenStmt*>(stmt)) {
+            for (const auto& branch : when->branches) collect(branch.body);
+        } else if (auto* match = dynamic_cast<const MatchStmt*>(stmt)) {
+            for (const auto& matchCase : match->cases) collect(matchCase.body);
+        } else if (auto* loop = dynamic_cast<const WhileStmt*>(stmt)) {
+            collect(loop->body);
+        } else if (auto* loop = dynamic_cast<const ForStmt*>(stmt)) {
+            collect(loop->body);
+        } else if (auto* with = dynamic_cast<const WithStmt*>(stmt)) {
+            collect(with->body);
+        } else if (auto* tryCatch = dynamic_cast<const TryCatchStmt*>(stmt)) {
+            collect(tryCatch->tryBody);
+            collect(tryCatch->catchBody);
+        } else if (auto* block = dynamic_cast<const BlockStmt*>(stmt)) {
+            collect(block->body);
+        }
+    }
+};
+
+std::string programFingerprint(const Program& program) {
+    std::ostringstream printed;
+    program.print(printed, 0);
+    return std::to_string(std::hash<std::string>{}(printed.str()));
+}
+
+int64_t integerAt(const List& list, size_t index) {
+    if (index >= list.size() || !std::holds_alternative<int64_t>(list[index])) {
+        throw std::runtime_error("Malformed checkpoint");
+    }
+    return std::get<int64_t>(list[index]);
+}
+
+[[noreturn]] void mismatch() {
+    throw std::runtime_error("Checkpoint was taken of a different program");
+}
+
+} // namespace
+
+void Interpreter::checkpoint(std::ostream& state) {
+    if (!atSafePoint) {
+        throw std::runtime_error("A checkpoint can only be taken at a safe point");
+    }
+    ProgramDefinitions definitions;
+    definitions.collect(program->statements);
+    ProgramReferences references;
+    references.functionNumber = [&](const FunctionDefStmt& func) -> uint64_t {
+        if (func.functionId > 0 && static_cast<size_t>(func.functionId) < functionSources.size()) {
+            auto it = definitions.numbers.find(functionSources[func.functionId]);
+            if (it != definitions.numbers.end()) return it->second;
+        }
+        throw std::runtime_error("Function '" + func.name.lexeme + "' is not part of the program");
+    };
+    references.spillList = [this] { return std::make_shared<SpillList>(spillOptions); };
+
+    state << CHECKPOINT_MAGIC;
+    encodeValue(programFingerprint(*program), state);
+    List path;
+    for (const auto& level : mainPath) {
+        path.emplace_back(static_cast<int64_t>(level.index));
+        path.emplace_back(static_cast<int64_t>(level.loop));
+        path.emplace_back(level.value);
+        path.emplace_back(level.end);
+        path.emplace_back(level.step);
+    }
+    encodeValue(path, state);
+
+    const auto& scopes = env.allScopes();
+    encodeValue(static_cast<int64_t>(env.depth() + 1), state);
+    for (size_t i = 0; i <= env.depth(); ++i) {
+        encodeValue(static_cast<int64_t>(scopes[i].size()), state);
+        for (const auto& [name, value] : scopes[i]) {
+            encodeValue(name, state);
+            encodeValue(value, state, &references);
+        }
+    }
+}
+
+void Interpreter::resume(const Program& program, const char* state, size_t size) {
+    if (size < CHECKPOINT_MAGIC.size() || std::string(state, CHECKPOINT_MAGIC.size()) != CHECKPOINT_MAGIC) {
+        throw std::runtime_error("Not a checkpoint");
+    }
+    const char* data = state + CHECKPOINT_MAGIC.size();
+    const char* end = state + size;
+    Value fingerprint = decodeValue(data, end);
+    if (!std::holds_alternative<std::string>(fingerprint) ||
+        std::get<std::string>(fingerprint) != programFingerprint(program)) {
+        mismatch();
+    }
+
+    // Rebuild the path, checking each level is the block or loop the
+    // statement above it says it should be
+    Value pathValue = decodeValue(data, end);
+    if (!std::holds_alternative<List>(pathValue)) throw std::runtime_error("Malformed checkpoint");
+    const List& path = std::get<List>(pathValue);
+    if (path.empty() || path.size() % 5 != 0) throw std::runtime_error("Malformed checkpoint");
+    std::vector<PathLevel> levels;
+    const std::vector<StmtPtr>* body = &program.statements;
+    for (size_t i = 0; i < path.size(); i += 5) {
+        PathLevel level{body};
+        level.index = static_cast<size_t>(integerAt(path, i));
+        level.loop = integerAt(path, i + 1) != 0;
+        level.value = integerAt(path, i + 2);
+        level.end = integerAt(path, i + 3);
+        level.step = integerAt(path, i + 4);
+        if (level.index > body->size()) mismatch();
+        levels.push_back(level);
+        if (i + 5 < path.size()) {
+            if (level.index == body->size()) mismatch();
+            const Stmt* stmt = (*body)[level.index].get();
+            bool innerLoop = integerAt(path, i + 6) != 0;
+            if (auto* loop = dynamic_cast<const ForStmt*>(stmt); loop && innerLoop) {
+                body = &loop->body;
+            } else if (auto* block = dynamic_cast<const BlockStmt*>(stmt); block && !innerLoop && !block->usesRegion) {
+                body = &block->body;
+            } else {
+                mismatch();
+            }
+        }
+    }
+
+    ProgramDefinitions definitions;
+    definitions.collect(program.statements);
+    std::unordered_map<std::string, std::shared_ptr<ModelDefStmt>> models;
+    ProgramReferences references;
+    references.function = [&](uint64_t number) {
+        if (number >= definitions.functions.size()) mismatch();
+        return registerFunction(definitions.functions[number]);
+    };
+    references.model = [&](const std::string& name) {
+        auto& model = models[name];
+        if (!model) {
+            auto it = definitions.models.find(name);
+            if (it == definitions.models.end()) mismatch();
+            model = std::make_shared<ModelDefStmt>(*it->second);
+        }
+        return model;
+    };
+    references.spillList = [this] { return std::make_shared<SpillList>(spillOptions); };
+
+    Value scopeCount = decodeValue(data, end);
+    if (!std::holds_alternative<int64_t>(scopeCount) ||
+        std::get<int64_t>(scopeCount) != static_cast<int64_t>(levels.size())) {
+        throw std::runtime_error("Malformed checkpoint");
+    }
+    std::vector<std::unordered_map<std::string, Value>> scopes(levels.size());
+    for (auto& scope : scopes) {
+        Value count = decodeValue(data, end);
+        if (!std::holds_alternative<int64_t>(count)) throw std::runtime_error("Malformed checkpoint");
+        for (int64_t i = 0; i < std::get<int64_t>(count); ++i) {
+            Value name = decodeValue(data, end);
+            if (!std::holds_alternative<std::string>(name)) throw std::runtime_error("Malformed checkpoint");
+            scope[std::get<std::string>(name)] = decodeValue(data, end, &references);
+        }
+    }
+    if (data != end) throw std::runtime_error("Malformed checkpoint");
+
+    this->program = &program;
+    env.restoreScopes(std::move(scopes));
+    mainPath = std::move(levels);
+    runMain(true);
+}
+
+} // namespace MyCustomLang
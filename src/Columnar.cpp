@@ -0,0 +1,358 @@
+#include "Columnar.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace MyCustomLang {
+
+using Column = std::vector<int64_t>;
+using Mask = std::vector<uint8_t>;
+
+struct ColumnKernel::Operation {
+    enum class Kind { CONSTANT, SLOT, BINARY } kind;
+    int64_t constant = 0;
+    size_t slot = 0;
+    TokenType op = TokenType::NONE;
+    bool checked = true;
+    size_t temporary = 0; // Column the result of a CONSTANT or BINARY goes to
+    std::unique_ptr<Operation> left;
+    std::unique_ptr<Operation> right;
+};
+
+struct ColumnKernel::Step {
+    enum class Kind { ASSIGN, BRANCH, RETURN } kind;
+    size_t slot = 0;
+    std::unique_ptr<Operation> value; // Nullptr for a bare `return`
+    struct Branch {
+        std::unique_ptr<Operation> condition; // Nullptr for `otherwise`
+        std::vector<std::unique_ptr<Step>> body;
+    };
+    std::vector<Branch> branches;
+};
+
+ColumnKernel::~ColumnKernel() = default;
+
+// Translates a function body into kernel steps, resolving every variable
+// to a slot. Fails (returns false) on anything the kernel cannot run.
+class ColumnCompiler {
+public:
+    explicit ColumnCompiler(ColumnKernel& kernel) : kernel(kernel) {}
+
+    bool compileFunction(const FunctionDefStmt& function) {
+        scopes.emplace_back();
+        for (const auto& parameter : function.parameters) {
+            scopes.back()[parameter.lexeme] = kernel.slots++;
+        }
+        kernel.parameters = function.parameters.size();
+        return compileBody(function.body, kernel.body);
+    }
+
+private:
+    ColumnKernel& kernel;
+    std::vector<std::unordered_map<std::string, size_t>> scopes;
+
+    using Operation = ColumnKernel::Operation;
+    using Step = ColumnKernel::Step;
+
+    bool resolve(const std::string& name, size_t& slot) const {
+        for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+            auto it = scope->find(name);
+            if (it != scope->end()) {
+                slot = it->second;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool compileBody(const std::vector<StmtPtr>& body, std::vector<std::unique_ptr<Step>>& steps) {
+        for (const auto& stmt : body) {
+            auto step = std::make_unique<Step>();
+            if (auto* decl = dynamic_cast<const VarDeclStmt*>(stmt.get())) {
+                step->kind = Step::Kind::ASSIGN;
+                if (!decl->init || !(step->value = compileExpr(decl->init.get()))) return false;
+                step->slot = kernel.slots++;
+                scopes.back()[decl->name.lexeme] = step->slot; // After the initializer, which may read a shadowed name
+            } else if (auto* set = dynamic_cast<const SetStmt*>(stmt.get())) {
+                step->kind = Step::Kind::ASSIGN;
+                if (!resolve(set->name.lexeme, step->slot) || !(step->value = compileExpr(set->value.get()))) {
+                    return false;
+                }
+            } else if (auto* when = dynamic_cast<const WhenStmt*>(stmt.get())) {
+                step->kind = Step::Kind::BRANCH;
+                for (const auto& branch : when->branches) {
+                    Step::Branch compiled;
+                    if (branch.condition && !(compiled.condition = compileExpr(branch.condition.get()))) {
+                        return false;
+                    }
+                    scopes.emplace_back();
+                    bool ok = compileBody(branch.body, compiled.body);
+                    scopes.pop_back();
+                    if (!ok) return false;
+                    step->branches.push_back(std::move(compiled));
+                }
+            } else if (auto* ret = dynamic_cast<const ReturnStmt*>(stmt.get())) {
+                step->kind = Step::Kind::RETURN;
+                if (!ret->moreValues.empty()) return false;
+                if (ret->value && !(step->value = compileExpr(ret->value.get()))) return false;
+            } else {
+                return false;
+            }
+            steps.push_back(std::move(step));
+        }
+        return true;
+    }
+
+    std::unique_ptr<Operation> compileExpr(const Expr* expr) {
+        auto operation = std::make_unique<Operation>();
+        if (auto* paren = dynamic_cast<const ParenExpr*>(expr)) {
+            return compileExpr(paren->expr.get());
+        } else if (auto* literal = dynamic_cast<const LiteralExpr*>(expr)) {
+            if (literal->value.type != TokenType::NUMBER) return nullptr;
+            try {
+                operation->constant = std::stoll(literal->value.lexeme);
+            } catch (const std::logic_error&) {
+                return nullptr;
+            }
+            operation->kind = Operation::Kind::CONSTANT;
+            operation->temporary = kernel.temporaries++;
+        } else if (auto* variable = dynamic_cast<const VariableExpr*>(expr)) {
+            operation->kind = Operation::Kind::SLOT;
+            if (!resolve(variable->name.lexeme, operation->slot)) return nullptr;
+        } else if (auto* binary = dynamic_cast<const BinaryExpr*>(expr)) {
+            switch (binary->op.type) {
+                case TokenType::PLUS: case TokenType::MINUS: case TokenType::STAR: case TokenType::SLASH:
+                case TokenType::GREATER: case TokenType::LESS: case TokenType::GREATER_EQUAL:
+                case TokenType::LESS_EQUAL: case TokenType::EQUAL_EQUAL: case TokenType::NOT_EQUAL:
+                    break;
+                default:
+                    return nullptr;
+            }
+            operation->kind = Operation::Kind::BINARY;
+            operation->op = binary->op.type;
+            operation->checked = binary->overflowChecked;
+            operation->left = compileExpr(binary->left.get());
+            operation->right = compileExpr(binary->right.get());
+            if (!operation->left || !operation->right) return nullptr;
+            operation->temporary = kernel.temporaries++;
+        } else {
+            return nullptr;
+        }
+        return operation;
+    }
+};
+
+std::unique_ptr<ColumnKernel> ColumnKernel::compile(const FunctionDefStmt& function) {
+    std::unique_ptr<ColumnKernel> kernel(new ColumnKernel());
+    ColumnCompiler compiler(*kernel);
+    if (!compiler.compileFunction(function)) {
+        return nullptr;
+    }
+    return kernel;
+}
+
+// State for one batch of rows. Arithmetic on rows outside the mask still
+// happens (the loops stay branch-free) but is done in unsigned arithmetic,
+// with a divisor of 1, and never reports an error.
+class ColumnRunner {
+public:
+    explicit ColumnRunner(const ColumnKernel& kernel)
+        : kernel(kernel), slots(kernel.slots, Column(ColumnKernel::BATCH_ROWS)),
+          temporaries(kernel.temporaries, Column(ColumnKernel::BATCH_ROWS)), finished(ColumnKernel::BATCH_ROWS) {}
+
+    void runBatch(const std::vector<const int64_t*>& arguments, size_t first, size_t count, int64_t* results,
+                  uint8_t* returned) {
+        rows = count;
+        base = first;
+        out = results + first;
+        outReturned = returned + first;
+        for (size_t p = 0; p < kernel.parameters; ++p) {
+            std::copy(arguments[p] + first, arguments[p] + first + count, slots[p].begin());
+        }
+        std::fill(finished.begin(), finished.begin() + count, 0);
+        std::fill(outReturned, outReturned + count, 0);
+        Mask active(count, 1);
+        runSteps(kernel.body, active);
+    }
+
+private:
+    using Operation = ColumnKernel::Operation;
+    using Step = ColumnKernel::Step;
+
+    const ColumnKernel& kernel;
+    std::vector<Column> slots;
+    std::vector<Column> temporaries;
+    Mask finished; // Rows that have returned
+    size_t rows = 0;
+    size_t base = 0;
+    int64_t* out = nullptr;
+    uint8_t* outReturned = nullptr;
+
+    [[noreturn]] void fail(const char* message, const uint8_t* flagged) const {
+        size_t row = std::find(flagged, flagged + rows, 1) - flagged;
+        throw std::runtime_error(std::string(message) + " in row " + std::to_string(base + row));
+    }
+
+    static bool any(const Mask& mask) { return std::find(mask.begin(), mask.end(), 1) != mask.end(); }
+
+    void runSteps(const std::vector<std::unique_ptr<Step>>& steps, Mask& active) {
+        for (const auto& step : steps) {
+            if (!any(active)) return;
+            switch (step->kind) {
+                case Step::Kind::ASSIGN: {
+                    const int64_t* value = evaluate(*step->value, active);
+                    int64_t* target = slots[step->slot].data();
+                    for (size_t i = 0; i < rows; ++i) {
+                        target[i] = active[i] ? value[i] : target[i];
+                    }
+                    break;
+                }
+                case Step::Kind::RETURN: {
+                    const int64_t* value = step->value ? evaluate(*step->value, active) : nullptr;
+                    for (size_t i = 0; i < rows; ++i) {
+                        if (!active[i]) continue;
+                        if (value) {
+                            out[i] = value[i];
+                            outReturned[i] = 1;
+                        }
+                        finished[i] = 1;
+                        active[i] = 0;
+                    }
+                    break;
+                }
+                case Step::Kind::BRANCH: {
+                    Mask remaining = active;
+                    for (const auto& branch : step->branches) {
+                        if (!any(remaining)) break;
+                        if (!branch.condition) {
+                            runSteps(branch.body, remaining);
+                            break;
+                        }
+                        const int64_t* condition = evaluate(*branch.condition, remaining);
+                        Mask taken(rows);
+                        for (size_t i = 0; i < rows; ++i) {
+                            taken[i] = remaining[i] & (condition[i] != 0);
+                            remaining[i] &= !taken[i];
+                        }
+                        runSteps(branch.body, taken);
+                    }
+                    for (size_t i = 0; i < rows; ++i) {
+                        active[i] &= !finished[i];
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    const int64_t* evaluate(const Operation& operation, const Mask& active) {
+        if (operation.kind == Operation::Kind::SLOT) {
+            return slots[operation.slot].data();
+        }
+        int64_t* result = temporaries[operation.temporary].data();
+        if (operation.kind == Operation::Kind::CONSTANT) {
+            std::fill(result, result + rows, operation.constant);
+            return result;
+        }
+        const int64_t* l = evaluate(*operation.left, active);
+        const int64_t* r = evaluate(*operation.right, active);
+        const uint8_t* mask = active.data();
+        Mask flagged(rows);
+        uint8_t anyFlagged = 0;
+        switch (operation.op) {
+            case TokenType::PLUS:
+                if (operation.checked) {
+                    for (size_t i = 0; i < rows; ++i) {
+                        flagged[i] = __builtin_add_overflow(l[i], r[i], &result[i]) & mask[i];
+                        anyFlagged |= flagged[i];
+                    }
+                } else {
+                    for (size_t i = 0; i < rows; ++i) {
+                        result[i] = static_cast<int64_t>(static_cast<uint64_t>(l[i]) + static_cast<uint64_t>(r[i]));
+                    }
+                }
+                if (anyFlagged) fail("Integer overflow", flagged.data());
+                break;
+            case TokenType::MINUS:
+                if (operation.checked) {
+                    for (size_t i = 0; i < rows; ++i) {
+                        flagged[i] = __builtin_sub_overflow(l[i], r[i], &result[i]) & mask[i];
+                        anyFlagged |= flagged[i];
+                    }
+                } else {
+                    for (size_t i = 0; i < rows; ++i) {
+                        result[i] = static_cast<int64_t>(static_cast<uint64_t>(l[i]) - static_cast<uint64_t>(r[i]));
+                    }
+                }
+                if (anyFlagged) fail("Integer overflow", flagged.data());
+                break;
+            case TokenType::STAR:
+                if (operation.checked) {
+                    for (size_t i = 0; i < rows; ++i) {
+                        flagged[i] = __builtin_mul_overflow(l[i], r[i], &result[i]) & mask[i];
+                        anyFlagged |= flagged[i];
+                    }
+                } else {
+                    for (size_t i = 0; i < rows; ++i) {
+                        result[i] = static_cast<int64_t>(static_cast<uint64_t>(l[i]) * static_cast<uint64_t>(r[i]));
+                    }
+                }
+                if (anyFlagged) fail("Integer overflow", flagged.data());
+                break;
+            case TokenType::SLASH: {
+                for (size_t i = 0; i < rows; ++i) {
+                    flagged[i] = (r[i] == 0) & mask[i];
+                    anyFlagged |= flagged[i];
+                }
+                if (anyFlagged) fail("Division by zero", flagged.data());
+                constexpr int64_t lowest = std::numeric_limits<int64_t>::min();
+                for (size_t i = 0; i < rows; ++i) {
+                    bool overflows = l[i] == lowest && r[i] == -1;
+                    flagged[i] = overflows & mask[i] & operation.checked;
+                    anyFlagged |= flagged[i];
+                    int64_t divisor = (mask[i] && r[i] != 0 && !overflows) ? r[i] : 1;
+                    result[i] = l[i] / divisor;
+                }
+                if (anyFlagged) fail("Integer overflow", flagged.data());
+                break;
+            }
+            case TokenType::GREATER:
+                for (size_t i = 0; i < rows; ++i) result[i] = l[i] > r[i];
+                break;
+            case TokenType::LESS:
+                for (size_t i = 0; i < rows; ++i) result[i] = l[i] < r[i];
+                break;
+            case TokenType::GREATER_EQUAL:
+                for (size_t i = 0; i < rows; ++i) result[i] = l[i] >= r[i];
+                break;
+            case TokenType::LESS_EQUAL:
+                for (size_t i = 0; i < rows; ++i) result[i] = l[i] <= r[i];
+                break;
+            case TokenType::EQUAL_EQUAL:
+                for (size_t i = 0; i < rows; ++i) result[i] = l[i] == r[i];
+                break;
+            case TokenType::NOT_EQUAL:
+                for (size_t i = 0; i < rows; ++i) result[i] = l[i] != r[i];
+                break;
+            default:
+                throw std::runtime_error("Unknown binary operator");
+        }
+        return result;
+    }
+};
+
+void ColumnKernel::run(const std::vector<const int64_t*>& arguments, size_t rows, int64_t* results,
+                       uint8_t* returned) const {
+    if (arguments.size() != parameters) {
+        throw std::runtime_error("Expected " + std::to_string(parameters) + " argument column(s) but got " +
+                                 std::to_string(arguments.size()));
+    }
+    ColumnRunner runner(*this);
+    for (size_t first = 0; first < rows; first += BATCH_ROWS) {
+        runner.runBatch(arguments, first, std::min(BATCH_ROWS, rows - first), results, returned);
+    }
+}
+
+} // namespace MyCustomLang
@@ -0,0 +1,199 @@
+#include "Interpreter.h"
+#include <algorithm>
+#include <cstring>
+
+namespace MyCustomLang {
+
+namespace {
+
+constexpr size_t RUN_BLOCK = 512; // Integers per memcmp: 4 KiB, so a difference is found within one block
+
+template <typename T>
+int sign(T a, T b) {
+    return (a > b) - (a < b);
+}
+
+bool isList(const Value& value) {
+    return std::holds_alternative<List>(value) || std::holds_alternative<std::shared_ptr<SpillList>>(value) ||
+           std::holds_alternative<std::shared_ptr<Matrix>>(value);
+}
+
+bool isDict(const Value& value) {
+    return std::holds_alternative<Dict>(value) || std::holds_alternative<PersistentDict>(value);
+}
+
+size_t lengthOf(const Value& list) {
+    if (auto* elements = std::get_if<List>(&list)) return elements->size();
+    if (auto* spilled = std::get_if<std::shared_ptr<SpillList>>(&list)) return (*spilled)->size();
+    return std::get<std::shared_ptr<Matrix>>(list)->rows();
+}
+
+Value elementAt(const Value& list, size_t index) {
+    if (auto* elements = std::get_if<List>(&list)) return (*elements)[index];
+    if (auto* spilled = std::get_if<std::shared_ptr<SpillList>>(&list)) return (*spilled)->get(index);
+    const Matrix& matrix = *std::get<std::shared_ptr<Matrix>>(list);
+    const int64_t* row = matrix.row(index);
+    return List(row, row + matrix.cols());
+}
+
+// First difference between two runs of integers. Each block is checked
+// with memcmp, and only a block that differs is scanned for where.
+int compareRuns(const int64_t* a, const int64_t* b, size_t length) {
+    for (size_t start = 0; start < length; start += RUN_BLOCK) {
+        size_t block = std::min(RUN_BLOCK, length - start);
+        if (std::memcmp(a + start, b + start, block * sizeof(int64_t)) != 0) {
+            auto difference = std::mismatch(a + start, a + start + block, b + start);
+            return sign(*difference.first, *difference.second);
+        }
+    }
+    return 0;
+}
+
+// The first `length` elements of two spilled lists, a chunk at a time
+int compareSpilled(SpillList& a, SpillList& b, size_t length) {
+    for (size_t i = 0; i < length;) {
+        size_t runA, runB;
+        const int64_t* x = a.run(i, runA);
+        const int64_t* y = b.run(i, runB);
+        size_t run = std::min({runA, runB, length - i});
+        if (int result = compareRuns(x, y, run)) return result;
+        i += run;
+    }
+    return 0;
+}
+
+// As lists of rows. With equal widths the rows are contiguous in both, so
+// the common rows compare as one run.
+int compareMatrices(const Matrix& a, const Matrix& b, size_t rows) {
+    if (a.cols() == b.cols()) return compareRuns(a.row(0), b.row(0), rows * a.cols());
+    if (rows == 0) return 0;
+    // Rows of different widths differ by the end of the first one
+    int result = compareRuns(a.row(0), b.row(0), std::min(a.cols(), b.cols()));
+    return result != 0 ? result : sign(a.cols(), b.cols());
+}
+
+// Lexicographic comparison of two lists in any of their forms. When only
+// equality is asked, lists of different lengths differ without looking at
+// an element, elements of different types just differ, and the result is
+// only zero or not.
+int compareLists(const Value& a, const Value& b, bool equality) {
+    size_t lengthA = lengthOf(a), lengthB = lengthOf(b);
+    if (equality && lengthA != lengthB) return 1;
+    size_t common = std::min(lengthA, lengthB);
+    auto* listA = std::get_if<List>(&a);
+    auto* listB = std::get_if<List>(&b);
+    auto* spilledA = std::get_if<std::shared_ptr<SpillList>>(&a);
+    auto* spilledB = std::get_if<std::shared_ptr<SpillList>>(&b);
+    auto* matrixA = std::get_if<std::shared_ptr<Matrix>>(&a);
+    auto* matrixB = std::get_if<std::shared_ptr<Matrix>>(&b);
+
+    int result = 0;
+    if (spilledA && spilledB) {
+        if (*spilledA == *spilledB) return 0;
+        result = compareSpilled(**spilledA, **spilledB, common);
+    } else if (matrixA && matrixB) {
+        if (*matrixA == *matrixB) return 0;
+        result = compareMatrices(**matrixA, **matrixB, common);
+    } else {
+        Value elementA, elementB;
+        for (size_t i = 0; i < common && result == 0; ++i) {
+            const Value& x = listA ? (*listA)[i] : (elementA = elementAt(a, i));
+            const Value& y = listB ? (*listB)[i] : (elementB = elementAt(b, i));
+            auto* numberX = std::get_if<int64_t>(&x);
+            auto* numberY = std::get_if<int64_t>(&y);
+            if (numberX && numberY) {
+                result = sign(*numberX, *numberY);
+            } else if (equality) {
+                result = valuesEqual(x, y) ? 0 : 1;
+            } else {
+                result = compareValues(x, y);
+            }
+        }
+    }
+    return result != 0 ? result : sign(lengthA, lengthB);
+}
+
+const Value* findKey(const Value& dict, const std::string& key) {
+    if (auto* persistent = std::get_if<PersistentDict>(&dict)) return persistent->find(key);
+    const Dict& entries = std::get<Dict>(dict);
+    auto it = entries.find(key);
+    return it == entries.end() ? nullptr : &it->second;
+}
+
+bool dictsEqual(const Value& a, const Value& b) {
+    auto* persistentA = std::get_if<PersistentDict>(&a);
+    auto* persistentB = std::get_if<PersistentDict>(&b);
+    size_t sizeA = persistentA ? persistentA->size() : std::get<Dict>(a).size();
+    size_t sizeB = persistentB ? persistentB->size() : std::get<Dict>(b).size();
+    if (sizeA != sizeB) return false;
+    if (persistentA && persistentB && persistentA->sameVersion(*persistentB)) return true;
+    if (!persistentA) {
+        for (const auto& [key, value] : std::get<Dict>(a)) {
+            const Value* other = findKey(b, key);
+            if (!other || !valuesEqual(value, *other)) return false;
+        }
+        return true;
+    }
+    bool equal = true;
+    persistentA->forEach([&](const std::string& key, const Value& value) {
+        if (!equal) return;
+        const Value* other = findKey(b, key);
+        equal = other && valuesEqual(value, *other);
+    });
+    return equal;
+}
+
+bool recordsEqual(const Record& a, const Record& b) {
+    if (a.model != b.model && a.model->name.lexeme != b.model->name.lexeme) return false;
+    if (a.slots.size() != b.slots.size()) return false;
+    for (size_t i = 0; i < a.slots.size(); ++i) {
+        if (!valuesEqual(a.slots[i], b.slots[i])) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool valuesEqual(const Value& a, const Value& b) {
+    if (&a == &b) return true;
+    if (isList(a) && isList(b)) return compareLists(a, b, true) == 0;
+    if (isDict(a) && isDict(b)) return dictsEqual(a, b);
+    if (a.index() != b.index()) return false;
+    if (auto* number = std::get_if<int64_t>(&a)) return *number == std::get<int64_t>(b);
+    if (auto* text = std::get_if<std::string>(&a)) return *text == std::get<std::string>(b);
+    if (auto* record = std::get_if<Record>(&a)) return recordsEqual(*record, std::get<Record>(b));
+    if (auto* func = std::get_if<std::shared_ptr<FunctionDefStmt>>(&a)) {
+        return *func == std::get<std::shared_ptr<FunctionDefStmt>>(b);
+    }
+    if (auto* closure = std::get_if<std::shared_ptr<Closure>>(&a)) return *closure == std::get<std::shared_ptr<Closure>>(b);
+    if (auto* model = std::get_if<std::shared_ptr<ModelDefStmt>>(&a)) {
+        return *model == std::get<std::shared_ptr<ModelDefStmt>>(b);
+    }
+    if (auto* sequence = std::get_if<std::shared_ptr<const Sequence>>(&a)) {
+        return *sequence == std::get<std::shared_ptr<const Sequence>>(b);
+    }
+    return true; // Both void
+}
+
+int compareValues(const Value& a, const Value& b) {
+    auto* numberA = std::get_if<int64_t>(&a);
+    auto* numberB = std::get_if<int64_t>(&b);
+    if (numberA && numberB) return sign(*numberA, *numberB);
+    auto* textA = std::get_if<std::string>(&a);
+    auto* textB = std::get_if<std::string>(&b);
+    if (textA && textB) return sign(textA->compare(*textB), 0);
+    if (isList(a) && isList(b)) return &a == &b ? 0 : compareLists(a, b, false);
+
+    if (std::holds_alternative<std::shared_ptr<const Sequence>>(a) ||
+        std::holds_alternative<std::shared_ptr<const Sequence>>(b)) {
+        throw std::runtime_error("Cannot order a lazy sequence; collect it first");
+    }
+    Type typeA = valueType(a), typeB = valueType(b);
+    if (typeA != typeB) {
+        throw std::runtime_error("Type mismatch in comparison of " + typeToString(typeA) + " and " +
+                                 typeToString(typeB));
+    }
+    throw std::runtime_error(typeToString(typeA) + " values can only be compared with == and !=");
+}
+
+} // namespace MyCustomLang
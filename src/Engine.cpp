@@ -0,0 +1,181 @@
+#include "Engine.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "SemanticAnalyzer.h"
+#include <sstream>
+
+namespace MyCustomLang {
+
+std::shared_ptr<const CompiledScript> Engine::compile(const std::string& source, const Bindings& globals) {
+    return build(source, globals, false);
+}
+
+std::shared_ptr<const CompiledScript> Engine::compileSpecialized(const std::string& source, const Bindings& globals) {
+    return build(source, globals, true);
+}
+
+std::shared_ptr<const CompiledScript> Engine::build(const std::string& source, const Bindings& globals,
+                                                    bool specialize) {
+    std::string key = cacheKey(source, (specialize ? "s:" : "g:") + fingerprint(globals, specialize));
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto cached = cache.find(key);
+        if (cached != cache.end() && cached->second->source == source) {
+            recent.splice(recent.begin(), recent, cached->second);
+            return cached->second->script;
+        }
+    }
+
+    Lexer lexer(source);
+    std::vector<Token> tokens;
+    Token token;
+    do {
+        token = lexer.getNextToken();
+        tokens.push_back(token);
+    } while (token.type != TokenType::END_OF_FILE);
+
+    Parser parser(tokens);
+    for (const auto& [name, value] : globals) {
+        parser.getSymbolTable().addSymbol(Token(TokenType::IDENTIFIER, name, 0), valueType(value), false);
+    }
+    auto script = std::make_shared<CompiledScript>();
+    script->program = parser.parse();
+    SemanticAnalyzer analyzer(parser.getSymbolTable());
+    analyzer.analyze(script->program);
+    script->symbols = analyzer.getSymbolTable();
+
+    Optimizer optimizer(script->symbols);
+    if (specialize) {
+        script->constants = globals;
+        script->stats = optimizer.optimize(script->program, globals);
+    } else {
+        script->stats = optimizer.optimize(script->program);
+    }
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto cached = cache.find(key);
+    if (cached != cache.end()) {
+        recent.splice(recent.begin(), recent, cached->second);
+        if (cached->second->source == source) {
+            return cached->second->script;
+        }
+        // Another source with the same key: this one replaces it
+        cached->second->source = source;
+        cached->second->script = std::move(script);
+        return cached->second->script;
+    }
+    recent.push_front(CacheEntry{key, source, std::move(script)});
+    cache.emplace(std::move(key), recent.begin());
+    while (capacity > 0 && recent.size() > capacity) {
+        cache.erase(recent.back().key);
+        recent.pop_back(); // Runs holding the script keep it alive
+    }
+    return recent.front().script;
+}
+
+std::string Engine::cacheKey(const std::string& source, const std::string& variant) {
+    return std::to_string(std::hash<std::string>{}(source)) + ":" + std::to_string(source.size()) + ":" + variant;
+}
+
+void Engine::run(const CompiledScript& script, const Bindings& globals, std::ostream& out) const {
+    Interpreter interpreter(script.symbols);
+    interpreter.setOutput(out);
+    for (const auto& [name, value] : globals) {
+        interpreter.define(name, value);
+    }
+    interpreter.interpret(script.program);
+}
+
+RunResult Engine::execute(const std::string& source, const Bindings& globals) {
+    RunResult result;
+    try {
+        return execute(*compile(source, globals), globals);
+    } catch (const std::runtime_error& e) {
+        result.errors = formatCompileError(e);
+        result.status = 1;
+    } catch (const std::exception& e) { // e.g. bad_alloc, or out_of_range on an oversized literal
+        result.errors = std::string("Error: ") + e.what() + "\n";
+        result.status = 1;
+    }
+    return result;
+}
+
+RunResult Engine::execute(const CompiledScript& script, const Bindings& globals,
+                          const std::function<void(Interpreter&)>& configure) const {
+    RunResult result;
+    std::ostringstream out;
+    Interpreter interpreter(script.symbols);
+    interpreter.setOutput(out);
+    if (configure) {
+        configure(interpreter);
+    }
+    for (const auto& [name, value] : globals) {
+        interpreter.define(name, value);
+    }
+    try {
+        interpreter.interpret(script.program);
+    } catch (const RuntimeError& e) {
+        result.errors = "Runtime error: " + std::string(e.what()) + "\n" + interpreter.formatStackTrace(e);
+        result.status = 1;
+    } catch (const std::runtime_error& e) {
+        result.errors = "Runtime error: " + std::string(e.what()) + "\n";
+        result.status = 1;
+    } catch (const std::exception& e) {
+        result.errors = std::string("Error: ") + e.what() + "\n";
+        result.status = 1;
+    }
+    result.output = out.str();
+    return result;
+}
+
+std::string formatCompileError(const std::runtime_error& error) {
+    if (auto* parseError = dynamic_cast<const ParserError*>(&error)) {
+        return "Parsing failed at line " + std::to_string(parseError->token.line) + ": " + error.what() + "\n";
+    }
+    if (dynamic_cast<const SemanticError*>(&error)) {
+        return std::string(error.what()) + "\n";
+    }
+    return "Runtime error: " + std::string(error.what()) + "\n";
+}
+
+bool parseBinding(const std::string& text, Bindings& bindings) {
+    size_t eq = text.find('=');
+    if (eq == std::string::npos || eq == 0) {
+        return false;
+    }
+    std::string name = text.substr(0, eq);
+    std::string value = text.substr(eq + 1);
+    size_t digits = (!value.empty() && value[0] == '-') ? 1 : 0;
+    bool isInteger = value.size() > digits && value.find_first_not_of("0123456789", digits) == std::string::npos;
+    if (isInteger) {
+        try {
+            bindings[name] = static_cast<int64_t>(std::stoll(value));
+        } catch (const std::logic_error&) {
+            return false; // Out of the int64 range
+        }
+    } else {
+        bindings[name] = value;
+    }
+    return true;
+}
+
+std::string Engine::fingerprint(const Bindings& bindings, bool withValues) {
+    std::string result;
+    for (const auto& [name, value] : bindings) {
+        result += name + ":" + typeToString(valueType(value));
+        // Lists and dicts are never folded in, so their contents do not split variants
+        if (withValues && (std::holds_alternative<int64_t>(value) || std::holds_alternative<std::string>(value))) {
+            std::string text = valueToString(value);
+            result += "=" + std::to_string(text.size()) + ":" + text;
+        }
+        result += ";";
+    }
+    return result;
+}
+
+size_t Engine::cachedVariants() const {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return recent.size();
+}
+
+} // namespace MyCustomLang
@@ -1,9 +1,14 @@
 #include "Interpreter.h"
+#include "Builtins.h"
+#include "Columnar.h"
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <limits>
 
 namespace MyCustomLang {
-using List = std::vector<Value>;
-using Dict = std::unordered_map<std::string, Value>;
+using List = std::pmr::vector<Value>;
+using Dict = std::pmr::unordered_map<std::string, Value>;
 
 std::string valueToString(const Value& value) {
     if (std::holds_alternative<int64_t>(value)) {
@@ -18,6 +23,14 @@ std::string valueToString(const Value& value) {
             result += valueToString(list[i]);
         }
         return result + "]";
+    } else if (std::holds_alternative<std::shared_ptr<SpillList>>(value)) {
+        auto& list = *std::get<std::shared_ptr<SpillList>>(value);
+        std::string result = "[";
+        for (size_t i = 0; i < list.size(); ++i) {
+            if (i > 0) result += ", ";
+            result += std::to_string(list.get(i));
+        }
+        return result + "]";
     } else if (std::holds_alternative<Dict>(value)) {
         const auto& dict = std::get<Dict>(value);
         std::string result = "{";
@@ -28,12 +41,76 @@ std::string valueToString(const Value& value) {
             result += "\"" + key + "\": " + valueToString(val);
         }
         return result + "}";
-    } else if (std::holds_alternative<std::shared_ptr<FunctionDefStmt>>(value)) {
+    } else if (std::holds_alternative<PersistentDict>(value)) {
+        std::string result = "{";
+        std::get<PersistentDict>(value).forEach([&](const std::string& key, const Value& val) {
+            if (result.size() > 1) result += ", ";
+            result += "\"" + key + "\": " + valueToString(val);
+        });
+        return result + "}";
+    } else if (std::holds_alternative<std::shared_ptr<FunctionDefStmt>>(value) ||
+               std::holds_alternative<std::shared_ptr<Closure>>(value)) {
         return "[function]";
+    } else if (std::holds_alternative<Record>(value)) {
+        const auto& record = std::get<Record>(value);
+        std::string result = record.model->name.lexeme + "(";
+        for (size_t i = 0; i < record.slots.size(); ++i) {
+            if (i > 0) result += ", ";
+            result += record.model->fields[i].lexeme + ": " + valueToString(record.slots[i]);
+        }
+        return result + ")";
+    } else if (auto* matrix = std::get_if<std::shared_ptr<Matrix>>(&value)) {
+        const Matrix& m = **matrix;
+        std::string result = "[";
+        for (size_t i = 0; i < m.rows(); ++i) {
+            if (i > 0) result += ", ";
+            result += "[";
+            for (size_t j = 0; j < m.cols(); ++j) {
+                if (j > 0) result += ", ";
+                result += std::to_string(m.at(i, j));
+            }
+            result += "]";
+        }
+        return result + "]";
+    } else if (std::holds_alternative<std::shared_ptr<const Sequence>>(value)) {
+        return "[sequence]"; // Running it could call functions; say collects it first
+    } else if (std::holds_alternative<std::shared_ptr<ModelDefStmt>>(value)) {
+        return "[model " + std::get<std::shared_ptr<ModelDefStmt>>(value)->name.lexeme + "]";
     }
     return "[void]";
 }
 
+Type valueType(const Value& value) {
+    if (std::holds_alternative<int64_t>(value)) return Type::INTEGER;
+    if (std::holds_alternative<std::string>(value)) return Type::STRING;
+    if (std::holds_alternative<List>(value)) return Type::LIST;
+    if (std::holds_alternative<std::shared_ptr<SpillList>>(value)) return Type::LIST;
+    if (std::holds_alternative<std::shared_ptr<const Sequence>>(value)) return Type::LIST;
+    if (std::holds_alternative<std::shared_ptr<Matrix>>(value)) return Type::LIST;
+    if (std::holds_alternative<Dict>(value)) return Type::DICT;
+    if (std::holds_alternative<PersistentDict>(value)) return Type::DICT;
+    if (std::holds_alternative<Record>(value)) return Type::RECORD;
+    if (std::holds_alternative<std::shared_ptr<FunctionDefStmt>>(value)) return Type::FUNCTION;
+    if (std::holds_alternative<std::shared_ptr<Closure>>(value)) return Type::FUNCTION;
+    if (std::holds_alternative<std::shared_ptr<ModelDefStmt>>(value)) return Type::MODEL;
+    return Type::NONE;
+}
+
+// Checked position in a list, or row or column of a matrix, of `limit` elements
+static size_t checkedIndex(const Value& idx, size_t limit) {
+    if (!std::holds_alternative<int64_t>(idx)) {
+        throw std::runtime_error("List index must be an integer");
+    }
+    int64_t i = std::get<int64_t>(idx);
+    if (i < 0 || static_cast<uint64_t>(i) >= limit) {
+        throw std::runtime_error("List index out of bounds");
+    }
+    return static_cast<size_t>(i);
+}
+
+Interpreter::Interpreter(const SymbolTable& st)
+    : symbolTable(st), functions(1), functionSources(1), out(&std::cout) {}
+
 Value Interpreter::evaluateExpr(const Expr* expr) {
     if (auto* lit = dynamic_cast<const LiteralExpr*>(expr)) {
         if (lit->value.type == TokenType::NUMBER) {
@@ -42,13 +119,15 @@ Value Interpreter::evaluateExpr(const Expr* expr) {
             return lit->value.lexeme;
         }
     }   else if (auto* list = dynamic_cast<const ListLiteralExpr*>(expr)) {
-        List listValue;
+        List listValue(allocationResource());
+        listValue.reserve(list->elements.size());
         for (const auto& elem : list->elements) {
             listValue.push_back(evaluateExpr(elem.get()));
         }
         return listValue;
     } else if (auto* dict = dynamic_cast<const DictLiteralExpr*>(expr)) {
-        Dict dictValue;
+        Dict dictValue(allocationResource());
+        dictValue.reserve(dict->entries.size());
         for (const auto& entry : dict->entries) {
             Value key = evaluateExpr(entry.first.get());
             if (!std::holds_alternative<std::string>(key)) {
@@ -58,132 +137,911 @@ Value Interpreter::evaluateExpr(const Expr* expr) {
         }
         return dictValue;
     } else if (auto* index = dynamic_cast<const IndexExpr*>(expr)) {
-        Value base = evaluateExpr(index->base.get());
-        Value idx = evaluateExpr(index->index.get());
-        
-        if (std::holds_alternative<List>(base)) {
-            if (!std::holds_alternative<int64_t>(idx)) {
-                throw std::runtime_error("List index must be an integer");
-            }
-            const auto& list = std::get<List>(base);
-            int64_t i = std::get<int64_t>(idx);
-            if (i < 0 || i >= static_cast<int64_t>(list.size())) {
-                throw std::runtime_error("List index out of bounds");
-            }
-            return list[i];
-        } else if (std::holds_alternative<Dict>(base)) {
-            if (!std::holds_alternative<std::string>(idx)) {
-                throw std::runtime_error("Dictionary key must be a string");
-            }
-            const auto& dict = std::get<Dict>(base);
-            auto it = dict.find(std::get<std::string>(idx));
-            if (it == dict.end()) {
-                throw std::runtime_error("Key not found in dictionary");
+        // `m[i][j]` on a matrix: one offset, without building row i
+        if (auto* row = dynamic_cast<const IndexExpr*>(index->base.get())) {
+            auto* var = dynamic_cast<const VariableExpr*>(row->base.get());
+            const Value* base = var ? env.find(var->name.lexeme) : nullptr;
+            if (base && std::holds_alternative<std::shared_ptr<Matrix>>(*base)) {
+                Value i = evaluateExpr(row->index.get());
+                Value j = evaluateExpr(index->index.get());
+                const Value& current = env.lookup(var->name.lexeme); // Evaluating the indexes may have rebound it
+                if (auto* matrix = std::get_if<std::shared_ptr<Matrix>>(&current)) {
+                    return (*matrix)->at(checkedIndex(i, (*matrix)->rows()), checkedIndex(j, (*matrix)->cols()));
+                }
+                return readIndex(readIndex(current, i, true), j, true);
             }
-            return it->second;
-        } else {
-            throw std::runtime_error("Index operation on non-list/dict value");
         }
+        if (auto* var = dynamic_cast<const VariableExpr*>(index->base.get())) {
+            // Read in place; copying the base would copy the whole list
+            Value idx = evaluateExpr(index->index.get());
+            return readIndex(lookupVariable(var), idx, index->boundsChecked);
+        }
+        Value base = evaluateExpr(index->base.get());
+        Value idx = evaluateExpr(index->index.get());
+        return readIndex(base, idx, index->boundsChecked);
     } else if (auto* var = dynamic_cast<const VariableExpr*>(expr)) {
-        return env.get(var->name.lexeme);
+        return lookupVariable(var);
     } else if (auto* bin = dynamic_cast<const BinaryExpr*>(expr)) {
+        if (isIntegerTyped(bin)) {
+            int64_t number;
+            Value other;
+            if (evaluateIntegerBinary(bin, number, other)) return number;
+            return other;
+        }
+        switch (bin->op.type) {
+            case TokenType::EQUAL_EQUAL: case TokenType::NOT_EQUAL: case TokenType::LESS:
+            case TokenType::LESS_EQUAL: case TokenType::GREATER: case TokenType::GREATER_EQUAL:
+                return evaluateComparison(bin);
+            default:
+                break;
+        }
         Value left = evaluateExpr(bin->left.get());
         Value right = evaluateExpr(bin->right.get());
 
         if (std::holds_alternative<int64_t>(left) && std::holds_alternative<int64_t>(right)) {
-            int64_t l = std::get<int64_t>(left);
-            int64_t r = std::get<int64_t>(right);
-            switch (bin->op.type) {
-                case TokenType::PLUS: return l + r;
-                case TokenType::MINUS: return l - r;
-                case TokenType::STAR: return l * r;
-                case TokenType::SLASH:
-                    if (r == 0) throw std::runtime_error("Division by zero");
-                    return l / r;
-                case TokenType::GREATER: return l > r ? 1 : 0;
-                case TokenType::LESS: return l < r ? 1 : 0;
-                case TokenType::GREATER_EQUAL: return l >= r ? 1 : 0;
-                case TokenType::LESS_EQUAL: return l <= r ? 1 : 0;
-                case TokenType::EQUAL_EQUAL: return l == r ? 1 : 0;
-                case TokenType::NOT_EQUAL: return l != r ? 1 : 0;
-                default: throw std::runtime_error("Unknown binary operator");
-            }
+            return applyIntegerOp(bin->op, std::get<int64_t>(left), std::get<int64_t>(right), bin->overflowChecked);
         } else {
             throw std::runtime_error("Type mismatch in binary expression");
         }
     } else if (auto* call = dynamic_cast<const CallExpr*>(expr)) {
-        Value funcVal = env.get(call->name.lexeme);
-        if (!std::holds_alternative<std::shared_ptr<FunctionDefStmt>>(funcVal)) {
-            throw std::runtime_error(call->name.lexeme + " is not a function");
+        return callFunction(call->name, call->arguments, call->specialization);
+    } else if (auto* paren = dynamic_cast<const ParenExpr*>(expr)) {
+        return evaluateExpr(paren->expr.get());
+    } else if (auto* field = dynamic_cast<const FieldExpr*>(expr)) {
+        if (auto* var = dynamic_cast<const VariableExpr*>(field->base.get())) {
+            return readField(lookupVariable(var), field);
         }
-        auto func = std::get<std::shared_ptr<FunctionDefStmt>>(funcVal);
+        return readField(evaluateExpr(field->base.get()), field);
+    } else if (auto* create = dynamic_cast<const CreateExpr*>(expr)) {
+        Value modelVal = env.get(create->model.lexeme);
+        if (!std::holds_alternative<std::shared_ptr<ModelDefStmt>>(modelVal)) {
+            throw std::runtime_error(create->model.lexeme + " is not a model");
+        }
+        Record record{std::get<std::shared_ptr<ModelDefStmt>>(modelVal), {}};
+        if (create->arguments.size() != record.model->fields.size()) {
+            throw std::runtime_error("Model " + create->model.lexeme + " expected " +
+                                     std::to_string(record.model->fields.size()) + " values but got " +
+                                     std::to_string(create->arguments.size()));
+        }
+        record.slots.reserve(create->arguments.size());
+        for (const auto& arg : create->arguments) {
+            record.slots.push_back(evaluateExpr(arg.get()));
+        }
+        return record;
+    }
 
-        std::vector<Value> args;
-        for (const auto& arg : call->arguments) {
-            args.push_back(evaluateExpr(arg.get()));
+    throw std::runtime_error("Unknown expression type");
+}
+
+// Both operands were typed INTEGER by the analyzer, so the intermediate
+// results of a nested arithmetic expression need not be boxed into Values
+bool Interpreter::isIntegerTyped(const BinaryExpr* bin) {
+    const Expr* left = bin->left.get();
+    const Expr* right = bin->right.get();
+    return left->inferredType == Type::INTEGER && right->inferredType == Type::INTEGER;
+}
+
+Value& Interpreter::lookupVariable(const VariableExpr* var) {
+    auto address = reinterpret_cast<uintptr_t>(var);
+    BindingCache& cache = bindingCaches[(address >> 4) % bindingCaches.size()];
+    return env.lookup(var->name.lexeme, cache);
+}
+
+// An operand the analyzer typed INTEGER, unboxed. A declared type can still
+// be overwritten by a runtime-checked value, and a host binding can hold
+// anything; then returns false with the value in `other`, having evaluated
+// the operand exactly once.
+bool Interpreter::evaluateInteger(const Expr* expr, int64_t& number, Value& other) {
+    if (auto* var = dynamic_cast<const VariableExpr*>(expr)) {
+        const Value& value = lookupVariable(var);
+        if (auto* integer = std::get_if<int64_t>(&value)) {
+            number = *integer;
+            return true;
         }
+        other = value;
+        return false;
+    }
+    if (auto* bin = dynamic_cast<const BinaryExpr*>(expr); bin && isIntegerTyped(bin)) {
+        return evaluateIntegerBinary(bin, number, other);
+    }
+    other = evaluateExpr(expr);
+    if (auto* integer = std::get_if<int64_t>(&other)) {
+        number = *integer;
+        return true;
+    }
+    return false;
+}
+
+// Both operands typed INTEGER: no Values are built unless one of them turns
+// out to hold something else, in which case the generic rules apply
+bool Interpreter::evaluateIntegerBinary(const BinaryExpr* bin, int64_t& number, Value& other) {
+    int64_t l = 0, r = 0;
+    Value left, right;
+    bool leftInteger = evaluateInteger(bin->left.get(), l, left);
+    bool rightInteger = evaluateInteger(bin->right.get(), r, right);
+    if (leftInteger && rightInteger) {
+        number = applyIntegerOp(bin->op, l, r, bin->overflowChecked);
+        return true;
+    }
+    if (leftInteger) left = l;
+    if (rightInteger) right = r;
+    other = combineValues(bin, left, right);
+    if (auto* integer = std::get_if<int64_t>(&other)) {
+        number = *integer;
+        return true;
+    }
+    return false;
+}
+
+// The generic rules for operands already evaluated
+Value Interpreter::combineValues(const BinaryExpr* bin, const Value& left, const Value& right) {
+    switch (bin->op.type) {
+        case TokenType::EQUAL_EQUAL: case TokenType::NOT_EQUAL: case TokenType::LESS:
+        case TokenType::LESS_EQUAL: case TokenType::GREATER: case TokenType::GREATER_EQUAL:
+            return compareOperands(bin->op.type, left, right);
+        default:
+            break;
+    }
+    if (std::holds_alternative<int64_t>(left) && std::holds_alternative<int64_t>(right)) {
+        return applyIntegerOp(bin->op, std::get<int64_t>(left), std::get<int64_t>(right), bin->overflowChecked);
+    }
+    throw std::runtime_error("Type mismatch in binary expression");
+}
+
+// Comparison of operands not both typed INTEGER. A variable is compared in
+// place when the other operand cannot rebind it, so comparing two large
+// lists copies neither, and a list compared with itself stops at once.
+int64_t Interpreter::evaluateComparison(const BinaryExpr* bin) {
+    auto* leftVar = dynamic_cast<const VariableExpr*>(bin->left.get());
+    auto* rightVar = dynamic_cast<const VariableExpr*>(bin->right.get());
+    bool rightIsPlain = rightVar || dynamic_cast<const LiteralExpr*>(bin->right.get());
+    Value leftValue, rightValue;
+    const Value* left = &leftValue;
+    const Value* right = &rightValue;
+    if (leftVar && rightIsPlain) {
+        left = &lookupVariable(leftVar);
+    } else {
+        leftValue = evaluateExpr(bin->left.get());
+    }
+    if (rightVar) {
+        right = &lookupVariable(rightVar);
+    } else {
+        rightValue = evaluateExpr(bin->right.get());
+    }
+    return compareOperands(bin->op.type, *left, *right);
+}
+
+int64_t Interpreter::compareOperands(TokenType op, const Value& left, const Value& right) {
+    // Lazy sequences compare as the lists they produce
+    if (auto* sequence = std::get_if<std::shared_ptr<const Sequence>>(&left)) {
+        auto chain = *sequence;
+        return compareOperands(op, Value(collectSequence(*chain)), right);
+    }
+    if (auto* sequence = std::get_if<std::shared_ptr<const Sequence>>(&right)) {
+        auto chain = *sequence;
+        return compareOperands(op, left, Value(collectSequence(*chain)));
+    }
+
+    switch (op) {
+        case TokenType::EQUAL_EQUAL: return valuesEqual(left, right) ? 1 : 0;
+        case TokenType::NOT_EQUAL: return valuesEqual(left, right) ? 0 : 1;
+        case TokenType::LESS: return compareValues(left, right) < 0 ? 1 : 0;
+        case TokenType::LESS_EQUAL: return compareValues(left, right) <= 0 ? 1 : 0;
+        case TokenType::GREATER: return compareValues(left, right) > 0 ? 1 : 0;
+        default: return compareValues(left, right) >= 0 ? 1 : 0;
+    }
+}
 
-        if (args.size() != func->parameters.size()) {
-            throw std::runtime_error("Function " + call->name.lexeme + " expected " +
-                                     std::to_string(func->parameters.size()) + " arguments but got " +
-                                     std::to_string(args.size()));
+int64_t Interpreter::applyIntegerOp(const Token& op, int64_t l, int64_t r, bool checked) {
+    int64_t result;
+    switch (op.type) {
+        case TokenType::PLUS:
+            if (!checked) return l + r;
+            if (__builtin_add_overflow(l, r, &result)) throw std::runtime_error("Integer overflow");
+            return result;
+        case TokenType::MINUS:
+            if (!checked) return l - r;
+            if (__builtin_sub_overflow(l, r, &result)) throw std::runtime_error("Integer overflow");
+            return result;
+        case TokenType::STAR:
+            if (!checked) return l * r;
+            if (__builtin_mul_overflow(l, r, &result)) throw std::runtime_error("Integer overflow");
+            return result;
+        case TokenType::SLASH:
+            if (r == 0) throw std::runtime_error("Division by zero");
+            if (checked && r == -1 && l == std::numeric_limits<int64_t>::min()) {
+                throw std::runtime_error("Integer overflow");
+            }
+            return l / r;
+        case TokenType::GREATER: return l > r ? 1 : 0;
+        case TokenType::LESS: return l < r ? 1 : 0;
+        case TokenType::GREATER_EQUAL: return l >= r ? 1 : 0;
+        case TokenType::LESS_EQUAL: return l <= r ? 1 : 0;
+        case TokenType::EQUAL_EQUAL: return l == r ? 1 : 0;
+        case TokenType::NOT_EQUAL: return l != r ? 1 : 0;
+        default: throw std::runtime_error("Unknown binary operator");
+    }
+}
+
+Value Interpreter::readIndex(const Value& base, const Value& idx, bool boundsChecked) {
+    if (std::holds_alternative<List>(base)) {
+        if (!std::holds_alternative<int64_t>(idx)) {
+            throw std::runtime_error("List index must be an integer");
+        }
+        const auto& list = std::get<List>(base);
+        int64_t i = std::get<int64_t>(idx);
+        if (boundsChecked && (i < 0 || i >= static_cast<int64_t>(list.size()))) {
+            throw std::runtime_error("List index out of bounds");
+        }
+        return list[i];
+    } else if (std::holds_alternative<std::shared_ptr<SpillList>>(base)) {
+        if (!std::holds_alternative<int64_t>(idx)) {
+            throw std::runtime_error("List index must be an integer");
+        }
+        auto& list = *std::get<std::shared_ptr<SpillList>>(base);
+        int64_t i = std::get<int64_t>(idx);
+        if (i < 0 || i >= static_cast<int64_t>(list.size())) { // Always checked: the file has no guard pages
+            throw std::runtime_error("List index out of bounds");
+        }
+        return list.get(static_cast<size_t>(i));
+    } else if (auto* matrix = std::get_if<std::shared_ptr<Matrix>>(&base)) {
+        const Matrix& m = **matrix;
+        size_t i = checkedIndex(idx, m.rows());
+        List row(allocationResource());
+        row.reserve(m.cols());
+        for (size_t j = 0; j < m.cols(); ++j) {
+            row.emplace_back(m.at(i, j));
+        }
+        return row;
+    } else if (auto* sequence = std::get_if<std::shared_ptr<const Sequence>>(&base)) {
+        if (!std::holds_alternative<int64_t>(idx)) {
+            throw std::runtime_error("List index must be an integer");
+        }
+        const List& elements = materializeSequence(**sequence);
+        int64_t i = std::get<int64_t>(idx);
+        if (i < 0 || i >= static_cast<int64_t>(elements.size())) {
+            throw std::runtime_error("List index out of bounds");
         }
+        return elements[static_cast<size_t>(i)];
+    } else if (std::holds_alternative<Dict>(base)) {
+        if (!std::holds_alternative<std::string>(idx)) {
+            throw std::runtime_error("Dictionary key must be a string");
+        }
+        const auto& dict = std::get<Dict>(base);
+        auto it = dict.find(std::get<std::string>(idx));
+        if (it == dict.end()) {
+            throw std::runtime_error("Key not found in dictionary");
+        }
+        return it->second;
+    } else if (std::holds_alternative<PersistentDict>(base)) {
+        if (!std::holds_alternative<std::string>(idx)) {
+            throw std::runtime_error("Dictionary key must be a string");
+        }
+        const Value* found = std::get<PersistentDict>(base).find(std::get<std::string>(idx));
+        if (!found) {
+            throw std::runtime_error("Key not found in dictionary");
+        }
+        return *found;
+    }
+    throw std::runtime_error("Index operation on non-list/dict value");
+}
 
-        env.enterScope();
-        for (size_t i = 0; i < func->parameters.size(); ++i) {
-            env.define(func->parameters[i].lexeme, args[i]);
+Value Interpreter::callBuiltin(const BuiltinSignature& builtin, std::vector<Value>& args) {
+    if (builtin.name == "len") {
+        if (std::holds_alternative<List>(args[0])) return static_cast<int64_t>(std::get<List>(args[0]).size());
+        if (std::holds_alternative<Dict>(args[0])) return static_cast<int64_t>(std::get<Dict>(args[0]).size());
+        if (std::holds_alternative<std::shared_ptr<SpillList>>(args[0])) {
+            return static_cast<int64_t>(std::get<std::shared_ptr<SpillList>>(args[0])->size());
+        }
+        if (std::holds_alternative<PersistentDict>(args[0])) {
+            return static_cast<int64_t>(std::get<PersistentDict>(args[0]).size());
+        }
+        if (auto* matrix = std::get_if<std::shared_ptr<Matrix>>(&args[0])) {
+            return static_cast<int64_t>((*matrix)->rows());
+        }
+        if (auto* sequence = std::get_if<std::shared_ptr<const Sequence>>(&args[0])) {
+            return static_cast<int64_t>(materializeSequence(**sequence).size());
+        }
+        if (std::holds_alternative<std::string>(args[0])) {
+            return static_cast<int64_t>(std::get<std::string>(args[0]).size());
+        }
+        throw std::runtime_error("len expects a list, dictionary or string");
+    }
+    if (builtin.name == "emit") {
+        if (auto* sequence = std::get_if<std::shared_ptr<const Sequence>>(&args[0])) {
+            args[0] = collectSequence(**sequence);
+        }
+        if (emitHandler) {
+            emitHandler(args[0]);
+        } else {
+            *out << valueToString(args[0]) << std::endl;
+        }
+        return Value{};
+    }
+    if (builtin.name == "call_batch") {
+        return callBatch(args[0], args[1]);
+    }
+    if (builtin.name == "spill") {
+        if (std::holds_alternative<std::shared_ptr<SpillList>>(args[0])) return args[0];
+        if (!std::holds_alternative<List>(args[0])) throw std::runtime_error("spill expects a list of integers");
+        auto spilled = std::make_shared<SpillList>(spillOptions);
+        for (const auto& element : std::get<List>(args[0])) {
+            if (!std::holds_alternative<int64_t>(element)) throw std::runtime_error("spill expects a list of integers");
+            spilled->append(std::get<int64_t>(element));
+        }
+        return spilled;
+    }
+    if (builtin.name == "load_ints") {
+        return loadIntegers(args[0]);
+    }
+    if (builtin.name == "persist" || builtin.name == "assoc" || builtin.name == "dissoc") {
+        PersistentDict dict;
+        if (std::holds_alternative<PersistentDict>(args[0])) {
+            dict = std::get<PersistentDict>(args[0]);
+        } else if (std::holds_alternative<Dict>(args[0])) {
+            for (const auto& [key, value] : std::get<Dict>(args[0])) {
+                dict = dict.set(key, value);
+            }
+        } else {
+            throw std::runtime_error(builtin.name + " expects a dictionary");
+        }
+        if (builtin.name == "persist") return dict;
+        if (!std::holds_alternative<std::string>(args[1])) {
+            throw std::runtime_error("Dictionary key must be a string");
+        }
+        if (builtin.name == "assoc") {
+            // Leaves are shared with every later version, so none may hold region memory
+            Value value = regionDepth > 0 ? Value(args[2]) : std::move(args[2]);
+            return dict.set(std::get<std::string>(args[1]), std::move(value));
+        }
+        return dict.erase(std::get<std::string>(args[1]));
+    }
+    if (builtin.name == "collect") {
+        if (auto* sequence = std::get_if<std::shared_ptr<const Sequence>>(&args[0])) {
+            return collectSequence(**sequence);
+        }
+        if (std::holds_alternative<List>(args[0]) || std::holds_alternative<std::shared_ptr<SpillList>>(args[0])) {
+            return args[0];
+        }
+        throw std::runtime_error("collect expects a list");
+    }
+    if (builtin.name == "map" || builtin.name == "filter" || builtin.name == "take" || builtin.name == "skip" ||
+        builtin.name == "zip" || builtin.name == "enumerate") {
+        return extendSequence(builtin, args);
+    }
+    if (builtin.name == "group_by" || builtin.name == "aggregate") {
+        return groupRows(builtin, args);
+    }
+    if (builtin.name == "zeros" || builtin.name == "identity") {
+        bool square = builtin.name == "identity";
+        for (size_t a = 0; a < builtin.arity; ++a) {
+            if (!std::holds_alternative<int64_t>(args[a]) || std::get<int64_t>(args[a]) < 0) {
+                throw std::runtime_error(builtin.name + " expects sizes of at least 0");
+            }
+        }
+        size_t rows = static_cast<size_t>(std::get<int64_t>(args[0]));
+        auto matrix = std::make_shared<Matrix>(rows, square ? rows : static_cast<size_t>(std::get<int64_t>(args[1])));
+        for (size_t i = 0; square && i < rows; ++i) {
+            matrix->at(i, i) = 1;
+        }
+        return matrix;
+    }
+    if (builtin.name == "matrix") {
+        return toMatrix(args[0], "matrix");
+    }
+    if (builtin.name == "transpose") {
+        return std::make_shared<Matrix>(transpose(*toMatrix(args[0], "transpose")));
+    }
+    if (builtin.name == "matmul") {
+        return std::make_shared<Matrix>(multiply(*toMatrix(args[0], "matmul"), *toMatrix(args[1], "matmul")));
+    }
+    if (builtin.name == "elementwise") {
+        if (!std::holds_alternative<std::string>(args[2])) {
+            throw std::runtime_error("elementwise expects an operator name");
+        }
+        auto left = toMatrix(args[0], "elementwise");
+        std::shared_ptr<Matrix> right;
+        if (auto* scalar = std::get_if<int64_t>(&args[1])) {
+            right = std::make_shared<Matrix>(1, 1);
+            right->at(0, 0) = *scalar;
+        } else {
+            right = toMatrix(args[1], "elementwise");
+        }
+        return std::make_shared<Matrix>(elementwise(*left, *right, matrixOp(std::get<std::string>(args[2]), false)));
+    }
+    if (builtin.name == "reduce" || builtin.name == "reduce_rows" || builtin.name == "reduce_cols") {
+        if (!std::holds_alternative<std::string>(args[1])) {
+            throw std::runtime_error(builtin.name + " expects a reduction name");
+        }
+        int axis = builtin.name == "reduce_rows" ? 1 : builtin.name == "reduce_cols" ? 0 : -1;
+        Matrix result = reduce(*toMatrix(args[0], builtin.name), matrixOp(std::get<std::string>(args[1]), true), axis);
+        if (axis < 0) return result.at(0, 0);
+        List totals(allocationResource());
+        totals.reserve(result.rows() * result.cols());
+        for (size_t i = 0; i < result.rows(); ++i) {
+            for (size_t j = 0; j < result.cols(); ++j) {
+                totals.emplace_back(result.at(i, j));
+            }
         }
+        return totals;
+    }
+    throw std::runtime_error("Unknown builtin " + builtin.name);
+}
 
+// load_ints(path): the whitespace-separated integers in a text file. The
+// file is read as a stream; once it holds more than the spill threshold the
+// list moves to a spill file, so files larger than memory can be loaded.
+Value Interpreter::loadIntegers(const Value& pathValue) {
+    if (!std::holds_alternative<std::string>(pathValue)) {
+        throw std::runtime_error("load_ints expects a file path");
+    }
+    const std::string& path = std::get<std::string>(pathValue);
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Could not open file '" + path + "'");
+    }
+    // Packed and on the default resource until the size is known, so what
+    // is read before a spill costs 8 bytes an integer and is freed by it
+    std::vector<int64_t> numbers;
+    std::shared_ptr<SpillList> spilled;
+    std::string word;
+    while (file >> word) {
+        int64_t number;
         try {
-            for (const auto& stmt : func->body) {
-                executeStmt(stmt.get());
+            size_t used = 0;
+            number = std::stoll(word, &used);
+            if (used != word.size()) throw std::invalid_argument(word);
+        } catch (const std::logic_error&) {
+            throw std::runtime_error("Expected an integer in '" + path + "', got '" + word + "'");
+        }
+        if (spilled) {
+            spilled->append(number);
+        } else if (numbers.size() < spillOptions.threshold) {
+            numbers.push_back(number);
+        } else {
+            spilled = std::make_shared<SpillList>(spillOptions);
+            for (int64_t element : numbers) {
+                spilled->append(element);
             }
-            env.exitScope();
+            std::vector<int64_t>().swap(numbers);
+            spilled->append(number);
+        }
+    }
+    if (spilled) return spilled;
+    List list(numbers.begin(), numbers.end(), allocationResource());
+    return list;
+}
+
+// A matrix as is, or one built from a list of equally long lists of integers
+std::shared_ptr<Matrix> Interpreter::toMatrix(const Value& value, const std::string& caller) {
+    if (auto* matrix = std::get_if<std::shared_ptr<Matrix>>(&value)) return *matrix;
+    auto* rows = std::get_if<List>(&value);
+    if (!rows) {
+        throw std::runtime_error(caller + " expects a matrix");
+    }
+    size_t cols = 0;
+    for (size_t i = 0; i < rows->size(); ++i) {
+        auto* row = std::get_if<List>(&(*rows)[i]);
+        if (!row || (i > 0 && row->size() != cols)) {
+            throw std::runtime_error(caller + " expects a matrix or a list of rows of the same length");
+        }
+        cols = row->size();
+    }
+    auto matrix = std::make_shared<Matrix>(rows->size(), cols);
+    for (size_t i = 0; i < rows->size(); ++i) {
+        const List& row = std::get<List>((*rows)[i]);
+        for (size_t j = 0; j < cols; ++j) {
+            if (!std::holds_alternative<int64_t>(row[j])) {
+                throw std::runtime_error("Matrix elements must be integers");
+            }
+            matrix->at(i, j) = std::get<int64_t>(row[j]);
+        }
+    }
+    return matrix;
+}
+
+// Integer functions called on integer rows run as a column kernel, a batch
+// of rows per pass; anything else is called row by row
+Value Interpreter::callBatch(const Value& callee, const Value& columnsValue) {
+    std::shared_ptr<FunctionDefStmt> func;
+    std::shared_ptr<Closure> closure;
+    if (std::holds_alternative<std::shared_ptr<FunctionDefStmt>>(callee)) {
+        func = std::get<std::shared_ptr<FunctionDefStmt>>(callee);
+    } else if (std::holds_alternative<std::shared_ptr<Closure>>(callee)) {
+        closure = std::get<std::shared_ptr<Closure>>(callee);
+        func = closure->function;
+    } else {
+        throw std::runtime_error("call_batch expects a function");
+    }
+    if (!std::holds_alternative<List>(columnsValue)) {
+        throw std::runtime_error("call_batch expects a list of argument lists");
+    }
+    const List& columns = std::get<List>(columnsValue);
+    if (columns.size() != func->parameters.size()) {
+        throw std::runtime_error("Function " + func->name.lexeme + " expected " +
+                                 std::to_string(func->parameters.size()) + " argument list(s) but got " +
+                                 std::to_string(columns.size()));
+    }
+    size_t rows = 0;
+    bool integers = true;
+    for (size_t p = 0; p < columns.size(); ++p) {
+        if (!std::holds_alternative<List>(columns[p])) {
+            throw std::runtime_error("call_batch expects a list of argument lists");
+        }
+        const List& column = std::get<List>(columns[p]);
+        if (p > 0 && column.size() != rows) {
+            throw std::runtime_error("call_batch argument lists must all be the same length");
+        }
+        rows = column.size();
+        for (const auto& value : column) {
+            integers = integers && std::holds_alternative<int64_t>(value);
+        }
+    }
+
+    const ColumnKernel* kernel = nullptr;
+    if (integers && (!closure || closure->captured.empty())) {
+        auto cached = columnKernels.find(func.get());
+        if (cached == columnKernels.end()) {
+            cached = columnKernels.emplace(func.get(), ColumnKernel::compile(*func)).first;
+        }
+        kernel = cached->second.get();
+    }
+
+    List results(allocationResource());
+    results.reserve(rows);
+    if (kernel) {
+        tick();
+        std::vector<std::vector<int64_t>> data(columns.size(), std::vector<int64_t>(rows));
+        std::vector<const int64_t*> arguments;
+        for (size_t p = 0; p < columns.size(); ++p) {
+            const List& column = std::get<List>(columns[p]);
+            for (size_t row = 0; row < rows; ++row) {
+                data[p][row] = std::get<int64_t>(column[row]);
+            }
+            arguments.push_back(data[p].data());
+        }
+        std::vector<int64_t> output(rows);
+        std::vector<uint8_t> returned(rows);
+        kernel->run(arguments, rows, output.data(), returned.data());
+        for (size_t row = 0; row < rows; ++row) {
+            results.push_back(returned[row] ? Value(output[row]) : Value{});
+        }
+        return results;
+    }
+    for (size_t row = 0; row < rows; ++row) {
+        std::vector<Value> args;
+        for (const auto& column : columns) {
+            args.push_back(std::get<List>(column)[row]);
+        }
+        tick();
+        results.push_back(invokeFunction(func, closure.get(), args, -1));
+    }
+    return results;
+}
+
+Value Interpreter::callFunction(const Token& name, const std::vector<ExprPtr>& arguments, int specialization,
+                                size_t* valueCount) {
+    tick();
+    if (maxCallDepth > 0 && callStack.size() > maxCallDepth) {
+        throw StepLimitExceeded();
+    }
+    // A script binding with a builtin's name hides the builtin
+    const Value* bound = env.find(name.lexeme);
+    const BuiltinSignature* builtin = bound ? nullptr : findBuiltin(name.lexeme);
+    if (builtin) {
+        std::vector<Value> args;
+        args.reserve(arguments.size());
+        for (const auto& arg : arguments) {
+            args.push_back(evaluateExpr(arg.get()));
+        }
+        if (args.size() != builtin->arity) {
+            throw std::runtime_error("Function " + name.lexeme + " expected " + std::to_string(builtin->arity) +
+                                     " arguments but got " + std::to_string(args.size()));
+        }
+        Value result = callBuiltin(*builtin, args);
+        if (valueCount) {
+            returnSlots.push_back(std::move(result));
+            *valueCount = 1;
             return Value{};
-        } catch (const Value& returnValue) {
-            env.exitScope();
-            return returnValue;
         }
-    } else if (auto* paren = dynamic_cast<const ParenExpr*>(expr)) {
-        return evaluateExpr(paren->expr.get());
+        return result;
+    }
+    if (!bound) {
+        throw std::runtime_error("Undefined variable: " + name.lexeme);
+    }
+    Value funcVal = *bound;
+    std::shared_ptr<FunctionDefStmt> func;
+    std::shared_ptr<Closure> closure;
+    if (std::holds_alternative<std::shared_ptr<FunctionDefStmt>>(funcVal)) {
+        func = std::get<std::shared_ptr<FunctionDefStmt>>(funcVal);
+    } else if (std::holds_alternative<std::shared_ptr<Closure>>(funcVal)) {
+        closure = std::get<std::shared_ptr<Closure>>(funcVal);
+        func = closure->function;
+    } else {
+        throw std::runtime_error(name.lexeme + " is not a function");
     }
 
-    throw std::runtime_error("Unknown expression type");
+    std::vector<Value> args;
+    args.reserve(arguments.size());
+    for (const auto& arg : arguments) {
+        args.push_back(evaluateExpr(arg.get()));
+    }
+
+    if (args.size() != func->parameters.size()) {
+        throw std::runtime_error("Function " + name.lexeme + " expected " +
+                                 std::to_string(func->parameters.size()) + " arguments but got " +
+                                 std::to_string(args.size()));
+    }
+    return invokeFunction(func, closure.get(), args, specialization, valueCount);
+}
+
+Value Interpreter::invokeFunction(const std::shared_ptr<FunctionDefStmt>& func, const Closure* closure,
+                                  std::vector<Value>& args, int specialization, size_t* valueCount) {
+    // The analyzer picked a version typed for these arguments; func owns it,
+    // so the statements a trace points at outlive the call
+    const FunctionDefStmt* body = func.get();
+    if (specialization >= 0 && static_cast<size_t>(specialization) < func->specializations.size()) {
+        body = func->specializations[specialization].get();
+    }
+
+    size_t scope = env.depth();
+    env.enterScope();
+    if (func->bindsSelf) {
+        Value self = func;
+        if (closure) self = std::const_pointer_cast<Closure>(closure->shared_from_this());
+        env.define(func->name.lexeme, std::move(self));
+    }
+    if (closure) {
+        env.bindCaptures(closure); // Read in place, so a call copies none of them
+    }
+    for (size_t i = 0; i < func->parameters.size(); ++i) {
+        env.define(func->parameters[i].lexeme, std::move(args[i]));
+    }
+
+    size_t slotBase = returnSlots.size();
+    callStack.push_back(StackFrame{static_cast<uint32_t>(func->functionId), nullptr});
+    try {
+        for (size_t i = 0; i < body->body.size() && !returning; ++i) {
+            executeStmt(body->body[i].get());
+        }
+    } catch (const RuntimeError&) {
+        env.unwindTo(scope);
+        callStack.pop_back();
+        returnSlots.resize(slotBase);
+        throw;
+    } catch (const std::runtime_error& e) {
+        // Innermost call the error crosses: record where it happened
+        RuntimeError error(e.what(), callStack);
+        env.unwindTo(scope);
+        callStack.pop_back();
+        returnSlots.resize(slotBase);
+        throw error;
+    }
+    env.unwindTo(scope);
+    callStack.pop_back();
+
+    size_t count = returning ? returnCount : 0;
+    returning = false;
+    if (valueCount) {
+        *valueCount = count;
+        return Value{};
+    }
+    if (count == 0) {
+        return Value{};
+    }
+    // Used as a single value: the first one, with the rest dropped
+    Value result = std::move(returnSlots[returnSlots.size() - count]);
+    returnSlots.resize(returnSlots.size() - count);
+    return result;
+}
+
+size_t Interpreter::fieldSlot(const Record& record, const FieldExpr* field) {
+    if (field->slot >= 0 && static_cast<size_t>(field->slot) < record.slots.size()) {
+        return static_cast<size_t>(field->slot);
+    }
+    // Base model was not known statically; fall back to a scan of the field names
+    const auto& fields = record.model->fields;
+    for (size_t i = 0; i < fields.size(); ++i) {
+        if (fields[i].lexeme == field->field.lexeme) {
+            return i;
+        }
+    }
+    throw std::runtime_error("Model " + record.model->name.lexeme + " has no field " + field->field.lexeme);
+}
+
+Value Interpreter::readField(const Value& base, const FieldExpr* field) {
+    if (!std::holds_alternative<Record>(base)) {
+        throw std::runtime_error("Field access on non-record value");
+    }
+    const auto& record = std::get<Record>(base);
+    return record.slots[fieldSlot(record, field)];
+}
+
+// The element of a list or existing entry of a dictionary, to assign into
+Value& Interpreter::elementForUpdate(Value& container, const Value& idx) {
+    if (auto* list = std::get_if<List>(&container)) {
+        return (*list)[checkedIndex(idx, list->size())];
+    }
+    if (auto* dict = std::get_if<Dict>(&container)) {
+        if (!std::holds_alternative<std::string>(idx)) {
+            throw std::runtime_error("Dictionary key must be a string");
+        }
+        auto it = dict->find(std::get<std::string>(idx));
+        if (it == dict->end()) {
+            throw std::runtime_error("Key not found in dictionary");
+        }
+        return it->second;
+    }
+    throw std::runtime_error("Nested index assignment needs lists or dictionaries, and matrix elements are integers");
+}
+
+void Interpreter::assignIndex(Value& base, const Value& idx, Value value, bool boundsChecked) {
+    if (std::holds_alternative<List>(base)) {
+        if (!std::holds_alternative<int64_t>(idx)) {
+            throw std::runtime_error("List index must be an integer");
+        }
+        auto& list = std::get<List>(base);
+        int64_t i = std::get<int64_t>(idx);
+        if (boundsChecked && (i < 0 || i >= static_cast<int64_t>(list.size()))) {
+            throw std::runtime_error("List index out of bounds");
+        }
+        list[i] = std::move(value);
+    } else if (std::holds_alternative<std::shared_ptr<SpillList>>(base)) {
+        if (!std::holds_alternative<int64_t>(idx)) {
+            throw std::runtime_error("List index must be an integer");
+        }
+        if (!std::holds_alternative<int64_t>(value)) {
+            throw std::runtime_error("Spilled lists can only hold integers");
+        }
+        auto& list = std::get<std::shared_ptr<SpillList>>(base);
+        int64_t i = std::get<int64_t>(idx);
+        if (i < 0 || i >= static_cast<int64_t>(list->size())) {
+            throw std::runtime_error("List index out of bounds");
+        }
+        if (list.use_count() > 1) {
+            list = list->clone(); // Other values still hold the list; they must not see the write
+        }
+        list->set(static_cast<size_t>(i), std::get<int64_t>(value));
+    } else if (std::holds_alternative<Dict>(base)) {
+        if (!std::holds_alternative<std::string>(idx)) {
+            throw std::runtime_error("Dictionary key must be a string");
+        }
+        auto& dict = std::get<Dict>(base);
+        dict[std::get<std::string>(idx)] = std::move(value);
+    } else if (std::holds_alternative<PersistentDict>(base)) {
+        if (!std::holds_alternative<std::string>(idx)) {
+            throw std::runtime_error("Dictionary key must be a string");
+        }
+        auto& dict = std::get<PersistentDict>(base);
+        dict = dict.set(std::get<std::string>(idx), std::move(value)); // Earlier copies keep the old version
+    } else if (auto* matrix = std::get_if<std::shared_ptr<Matrix>>(&base)) {
+        // A whole row, from a list of as many integers
+        size_t i = checkedIndex(idx, (*matrix)->rows());
+        auto* row = std::get_if<List>(&value);
+        if (!row || row->size() != (*matrix)->cols() ||
+            !std::all_of(row->begin(), row->end(), [](const Value& v) { return std::holds_alternative<int64_t>(v); })) {
+            throw std::runtime_error("A matrix row must be a list of " + std::to_string((*matrix)->cols()) + " integers");
+        }
+        if (matrix->use_count() > 1) {
+            *matrix = std::make_shared<Matrix>(**matrix); // Other values still hold the matrix
+        }
+        for (size_t j = 0; j < row->size(); ++j) {
+            (*matrix)->at(i, j) = std::get<int64_t>((*row)[j]);
+        }
+    } else if (std::holds_alternative<std::shared_ptr<const Sequence>>(base)) {
+        throw std::runtime_error("Cannot assign into a lazy sequence; collect it first");
+    } else {
+        throw std::runtime_error("Index assignment to non-list/dict value");
+    }
+}
+
+// `set a[i][j] = v`: the target is a chain of indexes into a variable
+void Interpreter::assignNested(const IndexAssignStmt* indexAssign) {
+    std::vector<const IndexExpr*> chain;
+    const Expr* target = indexAssign->target.get();
+    while (auto* indexExpr = dynamic_cast<const IndexExpr*>(target)) {
+        chain.push_back(indexExpr);
+        target = indexExpr->base.get();
+    }
+    auto* varExpr = dynamic_cast<const VariableExpr*>(target);
+    if (!varExpr) {
+        throw std::runtime_error("Invalid index assignment target");
+    }
+    std::vector<Value> indices;
+    for (auto link = chain.rbegin(); link != chain.rend(); ++link) {
+        indices.push_back(evaluateExpr((*link)->index.get()));
+    }
+    Value value = evaluateExpr(indexAssign->value.get());
+    if (regionDepth > 0) {
+        // The container may outlive the current region. Copy-constructing
+        // drops the region allocator; move-assigning back would keep it.
+        Value escaped = value;
+        value = Value{};
+        value = std::move(escaped);
+    }
+    Value* base = &env.lookup(varExpr->name.lexeme); // Updated in place
+    size_t last = indices.size() - 1;
+    for (size_t k = 0; k < last; ++k) {
+        if (auto* matrix = std::get_if<std::shared_ptr<Matrix>>(base); matrix && k + 1 == last) {
+            if (!std::holds_alternative<int64_t>(value)) {
+                throw std::runtime_error("Matrix elements must be integers");
+            }
+            size_t i = checkedIndex(indices[k], (*matrix)->rows());
+            size_t j = checkedIndex(indices[last], (*matrix)->cols());
+            if (matrix->use_count() > 1) {
+                *matrix = std::make_shared<Matrix>(**matrix); // Other values still hold the matrix
+            }
+            (*matrix)->at(i, j) = std::get<int64_t>(value);
+            return;
+        }
+        base = &elementForUpdate(*base, indices[k]);
+    }
+    assignIndex(*base, indices[last], std::move(value), true);
 }
 
 void Interpreter::executeStmt(const Stmt* stmt) {
+    if (callStack.empty()) {
+        dispatchStmt(stmt);
+        return;
+    }
+    // Point the frame at the innermost statement, so a trace names the line
+    // inside an if or loop body. Put the outer one back afterwards: an error
+    // in, say, a loop condition belongs to the loop, not its last statement.
+    size_t frame = callStack.size() - 1;
+    const Stmt* outer = callStack[frame].statement;
+    callStack[frame].statement = stmt;
+    dispatchStmt(stmt);
+    callStack[frame].statement = outer;
+}
+
+void Interpreter::dispatchStmt(const Stmt* stmt) {
     if (auto* indexAssign = dynamic_cast<const IndexAssignStmt*>(stmt)) {
-        Value target = evaluateExpr(indexAssign->target.get());
+        auto* indexExpr = dynamic_cast<const IndexExpr*>(indexAssign->target.get());
+        if (indexExpr && dynamic_cast<const IndexExpr*>(indexExpr->base.get())) {
+            assignNested(indexAssign);
+            return;
+        }
+        auto* varExpr = indexExpr ? dynamic_cast<const VariableExpr*>(indexExpr->base.get()) : nullptr;
+        if (!varExpr) {
+            throw std::runtime_error("Invalid index assignment target");
+        }
+        Value idx = evaluateExpr(indexExpr->index.get());
         Value value = evaluateExpr(indexAssign->value.get());
-        
-        if (auto* indexExpr = dynamic_cast<const IndexExpr*>(indexAssign->target.get())) {
-            if (auto* varExpr = dynamic_cast<const VariableExpr*>(indexExpr->base.get())) {
-                Value base = env.get(varExpr->name.lexeme);
-                Value idx = evaluateExpr(indexExpr->index.get());
-                
-                if (std::holds_alternative<List>(base)) {
-                    if (!std::holds_alternative<int64_t>(idx)) {
-                        throw std::runtime_error("List index must be an integer");
-                    }
-                    auto& list = std::get<List>(base);
-                    int64_t i = std::get<int64_t>(idx);
-                    if (i < 0 || i >= static_cast<int64_t>(list.size())) {
-                        throw std::runtime_error("List index out of bounds");
-                    }
-                    list[i] = value;
-                } else if (std::holds_alternative<Dict>(base)) {
-                    if (!std::holds_alternative<std::string>(idx)) {
-                        throw std::runtime_error("Dictionary key must be a string");
-                    }
-                    auto& dict = std::get<Dict>(base);
-                    dict[std::get<std::string>(idx)] = value;
-                } else {
-                    throw std::runtime_error("Index assignment to non-list/dict value");
-                }
-                return;
-            }
+        Value& base = env.lookup(varExpr->name.lexeme); // Updated in place
+        if (regionDepth > 0) {
+            Value escaped = value; // The container may outlive the current region
+            assignIndex(base, idx, std::move(escaped), indexExpr->boundsChecked);
+        } else {
+            assignIndex(base, idx, std::move(value), indexExpr->boundsChecked);
         }
-        throw std::runtime_error("Invalid index assignment target");
+    } else if (auto* fieldAssign = dynamic_cast<const FieldAssignStmt*>(stmt)) {
+        auto* field = static_cast<const FieldExpr*>(fieldAssign->target.get());
+        auto* varExpr = dynamic_cast<const VariableExpr*>(field->base.get());
+        if (!varExpr) {
+            throw std::runtime_error("Invalid field assignment target");
+        }
+        Value value = evaluateExpr(fieldAssign->value.get());
+        Value& base = env.lookup(varExpr->name.lexeme);
+        if (!std::holds_alternative<Record>(base)) {
+            throw std::runtime_error("Field assignment to non-record value");
+        }
+        auto& record = std::get<Record>(base);
+        Value& slot = record.slots[fieldSlot(record, field)];
+        if (regionDepth > 0) {
+            Value escaped = value; // The record may outlive the current region
+            slot = std::move(escaped);
+        } else {
+            slot = std::move(value);
+        }
+    } else if (auto* block = dynamic_cast<const BlockStmt*>(stmt)) {
+        executeBlock(block);
+    } else if (auto* throwStmt = dynamic_cast<const ThrowStmt*>(stmt)) {
+        Value value = evaluateExpr(throwStmt->expr.get());
+        throw std::runtime_error(valueToString(value));
+    } else if (auto* tryCatch = dynamic_cast<const TryCatchStmt*>(stmt)) {
+        executeTryCatch(tryCatch);
+    } else if (auto* modelDef = dynamic_cast<const ModelDefStmt*>(stmt)) {
+        env.define(modelDef->name.lexeme, std::make_shared<ModelDefStmt>(*modelDef));
     } else if (auto* varDecl = dynamic_cast<const VarDeclStmt*>(stmt)) {
         Value value = evaluateExpr(varDecl->init.get());
         env.define(varDecl->name.lexeme, value);
@@ -192,28 +1050,55 @@ void Interpreter::executeStmt(const Stmt* stmt) {
         env.assign(setStmt->name.lexeme, value);
     } else if (auto* sayStmt = dynamic_cast<const SayStmt*>(stmt)) {
         Value value = evaluateExpr(sayStmt->expr.get());
-        std::cout << valueToString(value) << std::endl;
+        if (auto* sequence = std::get_if<std::shared_ptr<const Sequence>>(&value)) {
+            value = collectSequence(**sequence);
+        }
+        *out << valueToString(value) << std::endl;
     } else if (auto* funcDef = dynamic_cast<const FunctionDefStmt*>(stmt)) {
-        env.define(funcDef->name.lexeme, std::make_shared<FunctionDefStmt>(*funcDef));
-    } else if (auto* callStmt = dynamic_cast<const CallStmt*>(stmt)) {
-        std::vector<ExprPtr> clonedArgs;
-        for (const auto& arg : callStmt->arguments) {
-            clonedArgs.push_back(arg->clone());
+        if (funcDef->captures.empty()) {
+            env.define(funcDef->name.lexeme, registerFunction(funcDef));
+        } else {
+            auto closure = std::make_shared<Closure>();
+            closure->function = registerFunction(funcDef);
+            closure->captured.reserve(funcDef->captures.size());
+            for (const auto& capture : funcDef->captures) {
+                closure->captured.push_back(env.get(capture.lexeme)); // Copying also moves it out of any region
+            }
+            env.define(funcDef->name.lexeme, std::move(closure));
         }
-        auto callExpr = std::make_unique<CallExpr>(callStmt->name, std::move(clonedArgs));
-        evaluateExpr(callExpr.get());
+    } else if (auto* callStmt = dynamic_cast<const CallStmt*>(stmt)) {
+        callFunction(callStmt->name, callStmt->arguments, callStmt->specialization);
     } else if (auto* returnStmt = dynamic_cast<const ReturnStmt*>(stmt)) {
+        size_t count = 0;
         if (returnStmt->value) {
-            throw evaluateExpr(returnStmt->value.get());
+            returnSlots.push_back(evaluateExpr(returnStmt->value.get()));
+            count++;
+            for (const auto& more : returnStmt->moreValues) {
+                returnSlots.push_back(evaluateExpr(more.get()));
+                count++;
+            }
+        }
+        returnCount = count;
+        returning = true;
+    } else if (auto* destructure = dynamic_cast<const DestructureStmt*>(stmt)) {
+        auto* call = static_cast<const CallExpr*>(destructure->init.get());
+        size_t count = 0;
+        callFunction(call->name, call->arguments, call->specialization, &count);
+        size_t first = returnSlots.size() - count;
+        if (count != destructure->names.size()) {
+            returnSlots.resize(first);
+            throw std::runtime_error("Expected " + std::to_string(destructure->names.size()) + " values from " +
+                                     call->name.lexeme + " but got " + std::to_string(count));
+        }
+        for (size_t i = 0; i < count; ++i) {
+            env.define(destructure->names[i].lexeme, std::move(returnSlots[first + i]));
         }
-        throw Value{};
+        returnSlots.resize(first);
     } else if (auto* whenStmt = dynamic_cast<const WhenStmt*>(stmt)) {
         for (const auto& branch : whenStmt->branches) {
             if (!branch.condition) {
                 env.enterScope();
-                for (const auto& s : branch.body) {
-                    executeStmt(s.get());
-                }
+                executeBody(branch.body);
                 env.exitScope();
                 break;
             }
@@ -223,13 +1108,36 @@ void Interpreter::executeStmt(const Stmt* stmt) {
             }
             if (std::get<int64_t>(cond) != 0) {
                 env.enterScope();
-                for (const auto& s : branch.body) {
-                    executeStmt(s.get());
-                }
+                executeBody(branch.body);
                 env.exitScope();
                 break;
             }
         }
+    } else if (auto* matchStmt = dynamic_cast<const MatchStmt*>(stmt)) {
+        Value subject = evaluateExpr(matchStmt->condition.get());
+        const std::vector<StmtPtr>* body = nullptr;
+        if (matchStmt->jumpTable) {
+            if (auto* i = std::get_if<int64_t>(&subject)) {
+                auto it = matchStmt->integerCases.find(*i);
+                if (it != matchStmt->integerCases.end()) body = &matchStmt->cases[it->second].body;
+            } else if (auto* text = std::get_if<std::string>(&subject)) {
+                auto it = matchStmt->stringCases.find(*text);
+                if (it != matchStmt->stringCases.end()) body = &matchStmt->cases[it->second].body;
+            }
+        } else {
+            for (const auto& c : matchStmt->cases) {
+                Value pattern = evaluateExpr(c.pattern.get());
+                if (valuesEqual(subject, pattern)) {
+                    body = &c.body;
+                    break;
+                }
+            }
+        }
+        if (body) {
+            env.enterScope();
+            executeBody(*body);
+            env.exitScope();
+        }
     } else if (auto* whileStmt = dynamic_cast<const WhileStmt*>(stmt)) {
         while (true) {
             Value cond = evaluateExpr(whileStmt->condition.get());
@@ -237,11 +1145,11 @@ void Interpreter::executeStmt(const Stmt* stmt) {
                 throw std::runtime_error("Condition must evaluate to an integer");
             }
             if (std::get<int64_t>(cond) == 0) break;
+            tick();
             env.enterScope();
-            for (const auto& s : whileStmt->body) {
-                executeStmt(s.get());
-            }
+            executeBody(whileStmt->body);
             env.exitScope();
+            if (returning) break;
         }
     } else if (auto* forStmt = dynamic_cast<const ForStmt*>(stmt)) {
         Value startVal = evaluateExpr(forStmt->start.get());
@@ -259,21 +1167,28 @@ void Interpreter::executeStmt(const Stmt* stmt) {
 
         if (step == 0) throw std::runtime_error("Step cannot be zero");
 
+        if (onMainPath()) {
+            env.enterScope();
+            env.define(forStmt->iterator.lexeme, start);
+            mainPath.push_back(PathLevel{&forStmt->body, 0, true, start, end, step});
+            runLoop(forStmt, mainPath.size() - 1, start, end, step, false);
+            return;
+        }
         env.enterScope();
         env.define(forStmt->iterator.lexeme, start);
         if (step > 0) {
             for (int64_t i = start; i <= end; i += step) {
+                tick();
                 env.assign(forStmt->iterator.lexeme, i);
-                for (const auto& s : forStmt->body) {
-                    executeStmt(s.get());
-                }
+                executeBody(forStmt->body);
+                if (returning) break;
             }
         } else {
             for (int64_t i = start; i >= end; i += step) {
+                tick();
                 env.assign(forStmt->iterator.lexeme, i);
-                for (const auto& s : forStmt->body) {
-                    executeStmt(s.get());
-                }
+                executeBody(forStmt->body);
+                if (returning) break;
             }
         }
         env.exitScope();
@@ -282,10 +1197,240 @@ void Interpreter::executeStmt(const Stmt* stmt) {
     }
 }
 
+void Interpreter::executeBody(const std::vector<StmtPtr>& body) {
+    for (const auto& s : body) {
+        executeStmt(s.get());
+        if (returning) return;
+    }
+}
+
+std::pmr::memory_resource* Interpreter::allocationResource() {
+    if (regionDepth == 0) {
+        return std::pmr::get_default_resource();
+    }
+    return regions[regionDepth - 1]->resource();
+}
+
+void Interpreter::executeBlock(const BlockStmt* block) {
+    size_t scope = env.depth();
+    if (!block->usesRegion && onMainPath()) {
+        env.enterScope();
+        mainPath.push_back(PathLevel{&block->body});
+        runLevel(mainPath.size() - 1, 0);
+        mainPath.pop_back();
+        env.exitScope();
+        return;
+    }
+    if (!block->usesRegion) {
+        env.enterScope();
+        try {
+            executeBody(block->body);
+        } catch (...) {
+            env.unwindTo(scope);
+            throw;
+        }
+        env.exitScope();
+        return;
+    }
+
+    if (regions.size() == regionDepth) {
+        regions.push_back(std::make_unique<Region>());
+    }
+    Region& region = *regions[regionDepth];
+    size_t outerFloor = env.getRegionFloor();
+    auto leave = [&]() {
+        // Destroy the block's values before their memory goes away
+        env.unwindTo(scope);
+        env.setRegionFloor(outerFloor);
+        regionDepth--;
+        region.release();
+    };
+
+    regionDepth++;
+    env.enterScope();
+    env.setRegionFloor(env.depth());
+    try {
+        executeBody(block->body);
+    } catch (...) {
+        leave();
+        throw;
+    }
+    if (returning) {
+        // Copy the return values out of the region
+        for (size_t i = returnSlots.size() - returnCount; i < returnSlots.size(); ++i) {
+            Value escaped = returnSlots[i];
+            returnSlots[i] = Value{}; // So the move below keeps escaped's allocator
+            returnSlots[i] = std::move(escaped);
+        }
+    }
+    leave();
+}
+
+void Interpreter::executeTryCatch(const TryCatchStmt* tryCatch) {
+    size_t scope = env.depth();
+    size_t slots = returnSlots.size();
+    std::string message;
+    bool caught = false;
+    env.enterScope();
+    try {
+        executeBody(tryCatch->tryBody);
+    } catch (const std::runtime_error& e) {
+        // Only the message is kept; frames are never symbolized for caught errors
+        message = e.what();
+        caught = true;
+        returnSlots.resize(slots); // Values of a return the error cut short
+    }
+    env.unwindTo(scope);
+    if (!caught) {
+        return;
+    }
+    env.enterScope();
+    env.define(tryCatch->exceptionVar.lexeme, message);
+    executeBody(tryCatch->catchBody);
+    env.exitScope();
+}
+
+void Interpreter::define(const std::string& name, Value value) {
+    env.define(name, std::move(value));
+}
+
+void Interpreter::define(const FunctionDefStmt* funcDef) {
+    env.define(funcDef->name.lexeme, registerFunction(funcDef));
+}
+
+Value Interpreter::evaluate(const Expr* expr) {
+    size_t scope = env.depth();
+    size_t frames = callStack.size();
+    steps = 0;
+    try {
+        return evaluateExpr(expr);
+    } catch (...) {
+        // A step limit leaves the calls it cut short on the stacks
+        env.unwindTo(scope);
+        callStack.resize(frames);
+        returnSlots.clear();
+        returning = false;
+        throw;
+    }
+}
+
+std::shared_ptr<FunctionDefStmt> Interpreter::registerFunction(const FunctionDefStmt* funcDef) {
+    auto it = functionIds.find(funcDef);
+    if (it != functionIds.end()) {
+        return functions[it->second];
+    }
+    auto func = std::make_shared<FunctionDefStmt>(*funcDef);
+    func->functionId = static_cast<int>(functions.size());
+    functionIds[funcDef] = static_cast<uint32_t>(functions.size());
+    functions.push_back(func);
+    functionSources.push_back(funcDef);
+    return func;
+}
+
 void Interpreter::interpret(const Program& program) {
-    for (const auto& stmt : program.statements) {
-        executeStmt(stmt.get());
+    this->program = &program;
+    mainPath.assign(1, PathLevel{&program.statements});
+    runMain(false);
+}
+
+void Interpreter::runMain(bool resuming) {
+    callStack.assign(1, StackFrame{0, nullptr});
+    try {
+        if (resuming) {
+            continueLevel(0);
+        } else {
+            runLevel(0, 0);
+        }
+    } catch (const RuntimeError&) {
+        throw;
+    } catch (const std::runtime_error& e) {
+        throw RuntimeError(e.what(), callStack);
+    }
+    if (returning) {
+        // `return` outside any function ends the program
+        returning = false;
+        returnSlots.clear();
+    }
+}
+
+void Interpreter::safePoint() {
+    if (safePointHook) {
+        atSafePoint = true;
+        safePointHook();
+        atSafePoint = false;
+    }
+}
+
+void Interpreter::runLevel(size_t level, size_t from) {
+    const auto& body = *mainPath[level].body;
+    for (size_t i = from; i < body.size(); ++i) {
+        mainPath[level].index = i;
+        if (level == 0) safePoint();
+        executeStmt(body[i].get());
+        if (returning) return;
+    }
+}
+
+// A counted loop on the main path. Its scope is already entered and its
+// level pushed; both are gone when this returns.
+void Interpreter::runLoop(const ForStmt* loop, size_t level, int64_t i, int64_t end, int64_t step,
+                          bool resuming) {
+    for (; step > 0 ? i <= end : i >= end; i += step) {
+        if (resuming && level + 1 < mainPath.size()) {
+            continueLevel(level); // Finish the iteration the checkpoint was taken in
+        } else {
+            tick();
+            env.assign(loop->iterator.lexeme, i);
+            mainPath[level].value = i;
+            runLevel(level, 0);
+        }
+        resuming = false;
+        if (returning) break;
+        mainPath[level].value = i + step;
+        mainPath[level].index = 0;
+        safePoint();
+    }
+    mainPath.pop_back();
+    env.exitScope();
+}
+
+// Finishes the body at `level` from its recorded index, first completing
+// the block or loop a deeper recorded level is inside of
+void Interpreter::continueLevel(size_t level) {
+    size_t i = mainPath[level].index;
+    if (level + 1 < mainPath.size()) {
+        const Stmt* stmt = (*mainPath[level].body)[i].get();
+        callStack[0].statement = stmt; // Not entered through executeStmt when resumed
+        if (auto* loop = dynamic_cast<const ForStmt*>(stmt)) {
+            const PathLevel& inner = mainPath[level + 1];
+            runLoop(loop, level + 1, inner.value, inner.end, inner.step, true);
+        } else {
+            continueLevel(level + 1);
+            mainPath.pop_back();
+            env.exitScope();
+        }
+        if (returning) return;
+        i++;
+    }
+    runLevel(level, i);
+}
+
+std::string Interpreter::formatStackTrace(const RuntimeError& error) const {
+    std::string trace;
+    for (auto frame = error.frames.rbegin(); frame != error.frames.rend(); ++frame) {
+        std::string name = "<unknown>";
+        if (frame->functionId == 0) {
+            name = "<main>";
+        } else if (frame->functionId < functions.size()) {
+            name = functions[frame->functionId]->name.lexeme;
+        }
+        trace += "  at " + name;
+        if (frame->statement) {
+            trace += " (line " + std::to_string(frame->statement->getToken().line) + ")";
+        }
+        trace += "\n";
     }
+    return trace;
 }
 
 } // namespace MyCustomLang
\ No newline at end of file
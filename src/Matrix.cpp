@@ -0,0 +1,205 @@
+#include "Matrix.h"
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+
+namespace MyCustomLang {
+
+namespace {
+
+constexpr size_t BLOCK = 64; // Tile edge: three 64x64 tiles of int64 fit in L2
+
+[[noreturn]] void overflow() {
+    throw std::runtime_error("Integer overflow");
+}
+
+// Largest |x| over the matrix; 2^63 for INT64_MIN
+uint64_t maxMagnitude(const Matrix& m) {
+    uint64_t largest = 0;
+    for (size_t i = 0; i < m.rows(); ++i) {
+        const int64_t* row = m.row(i);
+        for (size_t j = 0; j < m.cols(); ++j) {
+            uint64_t magnitude = row[j] < 0 ? 0 - static_cast<uint64_t>(row[j]) : static_cast<uint64_t>(row[j]);
+            largest = std::max(largest, magnitude);
+        }
+    }
+    return largest;
+}
+
+// c += a * b over tiles of BLOCK rows, columns and inner terms, in i-k-j
+// order so the innermost loop walks a row of b and a row of c with unit
+// stride. `multiplyAdd(sum, x, y)` returns sum + x * y.
+template <typename MultiplyAdd>
+void multiplyBlocked(const Matrix& a, const Matrix& b, Matrix& c, MultiplyAdd multiplyAdd) {
+    size_t n = a.rows(), inner = a.cols(), m = b.cols();
+    for (size_t i0 = 0; i0 < n; i0 += BLOCK) {
+        size_t i1 = std::min(n, i0 + BLOCK);
+        for (size_t k0 = 0; k0 < inner; k0 += BLOCK) {
+            size_t k1 = std::min(inner, k0 + BLOCK);
+            for (size_t j0 = 0; j0 < m; j0 += BLOCK) {
+                size_t j1 = std::min(m, j0 + BLOCK);
+                for (size_t i = i0; i < i1; ++i) {
+                    int64_t* out = c.row(i);
+                    const int64_t* left = a.row(i);
+                    for (size_t k = k0; k < k1; ++k) {
+                        int64_t x = left[k];
+                        const int64_t* right = b.row(k);
+                        for (size_t j = j0; j < j1; ++j) {
+                            out[j] = multiplyAdd(out[j], x, right[j]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+int64_t combine(MatrixOp op, int64_t x, int64_t y) {
+    int64_t result;
+    switch (op) {
+    case MatrixOp::ADD:
+        if (__builtin_add_overflow(x, y, &result)) overflow();
+        return result;
+    case MatrixOp::SUBTRACT:
+        if (__builtin_sub_overflow(x, y, &result)) overflow();
+        return result;
+    case MatrixOp::MULTIPLY:
+        if (__builtin_mul_overflow(x, y, &result)) overflow();
+        return result;
+    case MatrixOp::DIVIDE:
+        if (y == 0) throw std::runtime_error("Division by zero");
+        if (y == -1 && x == std::numeric_limits<int64_t>::min()) overflow();
+        return x / y;
+    case MatrixOp::MIN:
+        return std::min(x, y);
+    case MatrixOp::MAX:
+    default:
+        return std::max(x, y);
+    }
+}
+
+} // namespace
+
+size_t Matrix::cellCount(size_t rows, size_t cols) {
+    size_t count;
+    if (__builtin_mul_overflow(rows, cols, &count) ||
+        count > static_cast<size_t>(std::numeric_limits<ptrdiff_t>::max()) / sizeof(int64_t)) {
+        throw std::runtime_error("A " + std::to_string(rows) + "x" + std::to_string(cols) + " matrix is too large");
+    }
+    return count;
+}
+
+MatrixOp matrixOp(const std::string& name, bool reduction) {
+    if (name == "min") return MatrixOp::MIN;
+    if (name == "max") return MatrixOp::MAX;
+    if (reduction) {
+        if (name == "sum") return MatrixOp::SUM;
+        throw std::runtime_error("Matrix reductions are \"sum\", \"min\" and \"max\", not \"" + name + "\"");
+    }
+    if (name == "+") return MatrixOp::ADD;
+    if (name == "-") return MatrixOp::SUBTRACT;
+    if (name == "*") return MatrixOp::MULTIPLY;
+    if (name == "/") return MatrixOp::DIVIDE;
+    throw std::runtime_error("Elementwise operations are \"+\", \"-\", \"*\", \"/\", \"min\" and \"max\", not \"" +
+                             name + "\"");
+}
+
+// When no sum of products can leave the int64 range, which is the usual
+// case, the product runs without per-step overflow checks, on wrapping
+// unsigned arithmetic the compiler vectorizes. Otherwise every step is
+// checked, so overflow is reported exactly when it happens.
+Matrix multiply(const Matrix& a, const Matrix& b) {
+    if (a.cols() != b.rows()) {
+        throw std::runtime_error("Cannot multiply a " + a.shape() + " matrix by a " + b.shape() + " matrix");
+    }
+    Matrix c(a.rows(), b.cols());
+    unsigned __int128 term = static_cast<unsigned __int128>(maxMagnitude(a)) * maxMagnitude(b);
+    bool safe = term <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) &&
+                term * a.cols() <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+    if (safe) {
+        multiplyBlocked(a, b, c, [](int64_t sum, int64_t x, int64_t y) {
+            return static_cast<int64_t>(static_cast<uint64_t>(sum) + static_cast<uint64_t>(x) * static_cast<uint64_t>(y));
+        });
+    } else {
+        multiplyBlocked(a, b, c, [](int64_t sum, int64_t x, int64_t y) {
+            int64_t product;
+            if (__builtin_mul_overflow(x, y, &product) || __builtin_add_overflow(sum, product, &sum)) overflow();
+            return sum;
+        });
+    }
+    return c;
+}
+
+// Tile by tile, so both the rows read and the rows written stay in cache
+Matrix transpose(const Matrix& m) {
+    Matrix t(m.cols(), m.rows());
+    for (size_t i0 = 0; i0 < m.rows(); i0 += BLOCK) {
+        size_t i1 = std::min(m.rows(), i0 + BLOCK);
+        for (size_t j0 = 0; j0 < m.cols(); j0 += BLOCK) {
+            size_t j1 = std::min(m.cols(), j0 + BLOCK);
+            for (size_t i = i0; i < i1; ++i) {
+                for (size_t j = j0; j < j1; ++j) {
+                    t.at(j, i) = m.at(i, j);
+                }
+            }
+        }
+    }
+    return t;
+}
+
+Matrix elementwise(const Matrix& a, const Matrix& b, MatrixOp op) {
+    bool scalar = b.rows() == 1 && b.cols() == 1;
+    if (!scalar && (a.rows() != b.rows() || a.cols() != b.cols())) {
+        throw std::runtime_error("Cannot combine a " + a.shape() + " matrix with a " + b.shape() + " matrix");
+    }
+    Matrix c(a.rows(), a.cols());
+    for (size_t i = 0; i < a.rows(); ++i) {
+        const int64_t* left = a.row(i);
+        const int64_t* right = scalar ? b.row(0) : b.row(i);
+        int64_t* out = c.row(i);
+        for (size_t j = 0; j < a.cols(); ++j) {
+            out[j] = combine(op, left[j], right[scalar ? 0 : j]);
+        }
+    }
+    return c;
+}
+
+Matrix reduce(const Matrix& m, MatrixOp op, int axis) {
+    size_t groups = axis == 1 ? m.rows() : axis == 0 ? m.cols() : 1;
+    size_t length = axis == 1 ? m.cols() : axis == 0 ? m.rows() : m.rows() * m.cols();
+    if (length == 0 && groups > 0 && op != MatrixOp::SUM) {
+        throw std::runtime_error("Cannot take the " + std::string(op == MatrixOp::MIN ? "min" : "max") +
+                                 " of no elements");
+    }
+    // Sums are taken in 128 bits: only a total outside the int64 range overflows
+    std::vector<__int128> sums(groups);
+    std::vector<int64_t> extremes(groups);
+    for (size_t i = 0; i < m.rows(); ++i) {
+        const int64_t* row = m.row(i);
+        for (size_t j = 0; j < m.cols(); ++j) {
+            size_t group = axis == 1 ? i : axis == 0 ? j : 0;
+            bool first = (axis == 1 ? j : axis == 0 ? i : i * m.cols() + j) == 0;
+            if (op == MatrixOp::SUM) {
+                sums[group] += row[j];
+            } else {
+                extremes[group] = first ? row[j] : combine(op, extremes[group], row[j]);
+            }
+        }
+    }
+    Matrix result(axis == 1 ? groups : 1, axis == 1 ? 1 : groups);
+    for (size_t group = 0; group < groups; ++group) {
+        int64_t value = extremes[group];
+        if (op == MatrixOp::SUM) {
+            if (sums[group] > std::numeric_limits<int64_t>::max() || sums[group] < std::numeric_limits<int64_t>::min()) {
+                overflow();
+            }
+            value = static_cast<int64_t>(sums[group]);
+        }
+        if (axis == 1) result.at(group, 0) = value;
+        else result.at(0, group) = value;
+    }
+    return result;
+}
+
+} // namespace MyCustomLang
@@ -0,0 +1,1246 @@
+#include "Optimizer.h"
+#include "Builtins.h"
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <optional>
+
+namespace MyCustomLang {
+
+OptimizerStats Optimizer::optimize(Program& program, const Bindings& constants) {
+    OptimizerStats stats;
+    removed = 0;
+    unrolled.clear();
+    peeled = 0;
+    checksRemoved = 0;
+    constantsPropagated = 0;
+    jumpTables = 0;
+    propagated.clear();
+    reassigned.clear();
+    collectBoundNames(program.statements, reassigned, true);
+    findShadowedBuiltins(program);
+
+    // A top-level `const` holds its value everywhere after its declaration,
+    // functions included, unless some other binding reuses the name
+    std::unordered_set<std::string> rebound;
+    for (const auto& stmt : program.statements) {
+        if (!dynamic_cast<const VarDeclStmt*>(stmt.get())) {
+            collectBoundNames(stmt.get(), rebound, false);
+        }
+    }
+    globalConstants.clear();
+    for (const auto& stmt : program.statements) {
+        auto* varDecl = dynamic_cast<const VarDeclStmt*>(stmt.get());
+        if (varDecl && varDecl->isConst && !rebound.count(varDecl->name.lexeme)) {
+            globalConstants.insert(varDecl);
+        }
+    }
+
+    if (!constants.empty()) {
+        std::unordered_set<std::string> bound;
+        collectBoundNames(program.statements, bound);
+        for (const auto& [name, value] : constants) {
+            if (bound.count(name)) continue; // Shadowed or reassigned by the script
+            if (std::holds_alternative<int64_t>(value) || std::holds_alternative<std::string>(value)) {
+                propagated[name] = Substitution{value};
+            }
+        }
+    }
+    transformLoops = true;
+    simplifyBody(program.statements);
+    transformLoops = false; // Loops are unrolled and peeled once, in the first pass
+    propagated.clear();
+    globalConstants.clear(); // Every use has been replaced by now
+
+    stats.foldedCalls = foldConstantCalls(program);
+
+    // Folded calls may have settled more conditions; this pass also counts
+    // the references that decide which functions are still reachable
+    references.clear();
+    simplifyBody(program.statements);
+    removeUnusedFunctions(program);
+    stats.removedStatements = removed;
+    stats.unrolledLoops = unrolled.size();
+    stats.peeledIterations = peeled;
+    stats.removedChecks = checksRemoved;
+    stats.propagatedConstants = constantsPropagated;
+    stats.jumpTables = jumpTables;
+    return stats;
+}
+
+size_t Optimizer::foldConstantCalls(Program& program) {
+    pureFunctions.clear();
+    findShadowedBuiltins(program);
+    for (const auto& builtin : builtinSignatures()) {
+        if (builtin.pure && !shadowedBuiltins.count(builtin.name)) {
+            pureFunctions[builtin.name] = nullptr; // Implemented by the interpreter
+        }
+    }
+    folded = 0;
+    sandbox = std::make_unique<Interpreter>(symbolTable);
+    sandbox->setLimits(FOLD_STEP_BUDGET, FOLD_CALL_DEPTH);
+
+    // A name defined twice is bound to different bodies over the run
+    std::unordered_map<std::string, size_t> definitions;
+    for (const auto& stmt : program.statements) {
+        if (auto* funcDef = dynamic_cast<const FunctionDefStmt*>(stmt.get())) {
+            definitions[funcDef->name.lexeme]++;
+        }
+    }
+
+    // Program order: a call is only folded once its callee has been defined
+    for (auto& stmt : program.statements) {
+        foldStmt(stmt.get());
+        auto* funcDef = dynamic_cast<const FunctionDefStmt*>(stmt.get());
+        if (!funcDef || definitions[funcDef->name.lexeme] != 1) continue;
+        if (!symbolTable.symbolExists(funcDef->name.lexeme) ||
+            symbolTable.getSymbol(funcDef->name.lexeme).type != Type::FUNCTION) {
+            continue; // Rebound to a non-function value later on
+        }
+        if (isPure(funcDef)) {
+            pureFunctions[funcDef->name.lexeme] = funcDef;
+            sandbox->define(funcDef);
+        }
+    }
+    sandbox.reset();
+    return folded;
+}
+
+// Pure: touches nothing but its parameters and locals, produces no output
+// and calls only functions already known to be pure (or itself)
+bool Optimizer::isPure(const FunctionDefStmt* func) const {
+    std::unordered_set<std::string> locals;
+    for (const auto& param : func->parameters) {
+        locals.insert(param.lexeme);
+    }
+    return isPureBody(func->body, locals, func->name.lexeme);
+}
+
+bool Optimizer::isPureBody(const std::vector<StmtPtr>& body, std::unordered_set<std::string>& locals,
+                           const std::string& self) const {
+    for (const auto& stmt : body) {
+        if (!isPureStmt(stmt.get(), locals, self)) return false;
+    }
+    return true;
+}
+
+bool Optimizer::isPureStmt(const Stmt* stmt, std::unordered_set<std::string>& locals,
+                           const std::string& self) const {
+    if (auto* varDecl = dynamic_cast<const VarDeclStmt*>(stmt)) {
+        if (varDecl->init && !isPureExpr(varDecl->init.get(), locals, self)) return false;
+        locals.insert(varDecl->name.lexeme);
+        return true;
+    } else if (auto* destructure = dynamic_cast<const DestructureStmt*>(stmt)) {
+        if (!isPureExpr(destructure->init.get(), locals, self)) return false;
+        for (const auto& name : destructure->names) {
+            locals.insert(name.lexeme);
+        }
+        return true;
+    } else if (auto* setStmt = dynamic_cast<const SetStmt*>(stmt)) {
+        return locals.count(setStmt->name.lexeme) && isPureExpr(setStmt->value.get(), locals, self);
+    } else if (auto* indexAssign = dynamic_cast<const IndexAssignStmt*>(stmt)) {
+        return isPureExpr(indexAssign->target.get(), locals, self) &&
+               isPureExpr(indexAssign->value.get(), locals, self);
+    } else if (auto* fieldAssign = dynamic_cast<const FieldAssignStmt*>(stmt)) {
+        return isPureExpr(fieldAssign->target.get(), locals, self) &&
+               isPureExpr(fieldAssign->value.get(), locals, self);
+    } else if (auto* returnStmt = dynamic_cast<const ReturnStmt*>(stmt)) {
+        if (returnStmt->value && !isPureExpr(returnStmt->value.get(), locals, self)) return false;
+        for (const auto& more : returnStmt->moreValues) {
+            if (!isPureExpr(more.get(), locals, self)) return false;
+        }
+        return true;
+    } else if (auto* throwStmt = dynamic_cast<const ThrowStmt*>(stmt)) {
+        return isPureExpr(throwStmt->expr.get(), locals, self);
+    } else if (auto* callStmt = dynamic_cast<const CallStmt*>(stmt)) {
+        if (callStmt->name.lexeme != self && !pureFunctions.count(callStmt->name.lexeme)) return false;
+        for (const auto& arg : callStmt->arguments) {
+            if (!isPureExpr(arg.get(), locals, self)) return false;
+        }
+        return true;
+    } else if (auto* whenStmt = dynamic_cast<const WhenStmt*>(stmt)) {
+        for (const auto& branch : whenStmt->branches) {
+            if (branch.condition && !isPureExpr(branch.condition.get(), locals, self)) return false;
+            if (!isPureBody(branch.body, locals, self)) return false;
+        }
+        return true;
+    } else if (auto* whileStmt = dynamic_cast<const WhileStmt*>(stmt)) {
+        return isPureExpr(whileStmt->condition.get(), locals, self) && isPureBody(whileStmt->body, locals, self);
+    } else if (auto* forStmt = dynamic_cast<const ForStmt*>(stmt)) {
+        if (!isPureExpr(forStmt->start.get(), locals, self) || !isPureExpr(forStmt->end.get(), locals, self) ||
+            (forStmt->step && !isPureExpr(forStmt->step.get(), locals, self))) {
+            return false;
+        }
+        locals.insert(forStmt->iterator.lexeme);
+        return isPureBody(forStmt->body, locals, self);
+    } else if (auto* block = dynamic_cast<const BlockStmt*>(stmt)) {
+        return isPureBody(block->body, locals, self);
+    } else if (auto* tryCatch = dynamic_cast<const TryCatchStmt*>(stmt)) {
+        if (!isPureBody(tryCatch->tryBody, locals, self)) return false;
+        locals.insert(tryCatch->exceptionVar.lexeme);
+        return isPureBody(tryCatch->catchBody, locals, self);
+    }
+    // say, nested definitions, and anything the interpreter does not execute
+    return false;
+}
+
+bool Optimizer::isPureExpr(const Expr* expr, const std::unordered_set<std::string>& locals,
+                           const std::string& self) const {
+    if (dynamic_cast<const LiteralExpr*>(expr)) {
+        return true;
+    } else if (auto* var = dynamic_cast<const VariableExpr*>(expr)) {
+        return locals.count(var->name.lexeme) > 0;
+    } else if (auto* bin = dynamic_cast<const BinaryExpr*>(expr)) {
+        return isPureExpr(bin->left.get(), locals, self) && isPureExpr(bin->right.get(), locals, self);
+    } else if (auto* paren = dynamic_cast<const ParenExpr*>(expr)) {
+        return isPureExpr(paren->expr.get(), locals, self);
+    } else if (auto* list = dynamic_cast<const ListLiteralExpr*>(expr)) {
+        for (const auto& elem : list->elements) {
+            if (!isPureExpr(elem.get(), locals, self)) return false;
+        }
+        return true;
+    } else if (auto* dict = dynamic_cast<const DictLiteralExpr*>(expr)) {
+        for (const auto& entry : dict->entries) {
+            if (!isPureExpr(entry.first.get(), locals, self) || !isPureExpr(entry.second.get(), locals, self)) {
+                return false;
+            }
+        }
+        return true;
+    } else if (auto* index = dynamic_cast<const IndexExpr*>(expr)) {
+        return isPureExpr(index->base.get(), locals, self) && isPureExpr(index->index.get(), locals, self);
+    } else if (auto* field = dynamic_cast<const FieldExpr*>(expr)) {
+        return isPureExpr(field->base.get(), locals, self);
+    } else if (auto* call = dynamic_cast<const CallExpr*>(expr)) {
+        if (call->name.lexeme != self && (!pureFunctions.count(call->name.lexeme) || locals.count(call->name.lexeme))) {
+            return false;
+        }
+        for (const auto& arg : call->arguments) {
+            if (!isPureExpr(arg.get(), locals, self)) return false;
+        }
+        return true;
+    }
+    // create reads a global model binding
+    return false;
+}
+
+// With assignmentsOnly, just the targets of `set`; otherwise every name the
+// statements declare or rebind
+void Optimizer::collectBoundNames(const std::vector<StmtPtr>& body, std::unordered_set<std::string>& names,
+                                  bool assignmentsOnly) {
+    for (const auto& stmt : body) {
+        collectBoundNames(stmt.get(), names, assignmentsOnly);
+    }
+}
+
+void Optimizer::collectBoundNames(const Stmt* stmt, std::unordered_set<std::string>& names, bool assignmentsOnly) {
+    if (auto* varDecl = dynamic_cast<const VarDeclStmt*>(stmt)) {
+        if (!assignmentsOnly) names.insert(varDecl->name.lexeme);
+    } else if (auto* destructure = dynamic_cast<const DestructureStmt*>(stmt)) {
+        for (const auto& name : destructure->names) {
+            if (!assignmentsOnly) names.insert(name.lexeme);
+        }
+    } else if (auto* setStmt = dynamic_cast<const SetStmt*>(stmt)) {
+        names.insert(setStmt->name.lexeme);
+    } else if (auto* whenStmt = dynamic_cast<const WhenStmt*>(stmt)) {
+        for (const auto& branch : whenStmt->branches) {
+            collectBoundNames(branch.body, names, assignmentsOnly);
+        }
+    } else if (auto* matchStmt = dynamic_cast<const MatchStmt*>(stmt)) {
+        for (const auto& c : matchStmt->cases) {
+            collectBoundNames(c.body, names, assignmentsOnly);
+        }
+    } else if (auto* whileStmt = dynamic_cast<const WhileStmt*>(stmt)) {
+        collectBoundNames(whileStmt->body, names, assignmentsOnly);
+    } else if (auto* forStmt = dynamic_cast<const ForStmt*>(stmt)) {
+        if (!assignmentsOnly) names.insert(forStmt->iterator.lexeme);
+        collectBoundNames(forStmt->body, names, assignmentsOnly);
+    } else if (auto* withStmt = dynamic_cast<const WithStmt*>(stmt)) {
+        if (!assignmentsOnly) names.insert(withStmt->iterator.lexeme);
+        collectBoundNames(withStmt->body, names, assignmentsOnly);
+    } else if (auto* block = dynamic_cast<const BlockStmt*>(stmt)) {
+        collectBoundNames(block->body, names, assignmentsOnly);
+    } else if (auto* tryCatch = dynamic_cast<const TryCatchStmt*>(stmt)) {
+        if (!assignmentsOnly) names.insert(tryCatch->exceptionVar.lexeme);
+        collectBoundNames(tryCatch->tryBody, names, assignmentsOnly);
+        collectBoundNames(tryCatch->catchBody, names, assignmentsOnly);
+    } else if (auto* funcDef = dynamic_cast<const FunctionDefStmt*>(stmt)) {
+        if (!assignmentsOnly) names.insert(funcDef->name.lexeme);
+        for (const auto& param : funcDef->parameters) {
+            if (!assignmentsOnly) names.insert(param.lexeme);
+        }
+        collectBoundNames(funcDef->body, names, assignmentsOnly);
+    } else if (auto* modelDef = dynamic_cast<const ModelDefStmt*>(stmt)) {
+        if (!assignmentsOnly) names.insert(modelDef->name.lexeme);
+    }
+}
+
+// Builtins whose name the script binds anywhere; calls to them may reach
+// the script's binding instead
+void Optimizer::findShadowedBuiltins(const Program& program) {
+    std::unordered_set<std::string> bound;
+    collectBoundNames(program.statements, bound);
+    shadowedBuiltins.clear();
+    for (const auto& builtin : builtinSignatures()) {
+        if (bound.count(builtin.name)) shadowedBuiltins.insert(builtin.name);
+    }
+}
+
+void Optimizer::simplifyBody(std::vector<StmtPtr>& body) {
+    std::vector<StmtPtr> kept;
+    kept.reserve(body.size());
+    for (size_t i = 0; i < body.size(); ++i) {
+        bool terminal = dynamic_cast<ReturnStmt*>(body[i].get()) || dynamic_cast<ThrowStmt*>(body[i].get());
+        if (StmtPtr result = simplifyStmt(std::move(body[i]))) {
+            kept.push_back(std::move(result));
+        }
+        if (terminal) {
+            removed += body.size() - i - 1; // Unreachable
+            break;
+        }
+    }
+    body = std::move(kept);
+}
+
+// Returns the replacement for stmt, or nullptr when it can never execute
+StmtPtr Optimizer::simplifyStmt(StmtPtr stmt) {
+    if (auto* varDecl = dynamic_cast<VarDeclStmt*>(stmt.get())) {
+        if (varDecl->init) simplifyExpr(varDecl->init);
+        auto* lit = dynamic_cast<LiteralExpr*>(varDecl->init.get());
+        if (lit && globalConstants.count(varDecl) && !propagated.count(varDecl->name.lexeme)) {
+            if (lit->value.type == TokenType::NUMBER) {
+                propagated[varDecl->name.lexeme] = Substitution{std::stoll(lit->value.lexeme)};
+                constantsPropagated++;
+            } else if (lit->value.type == TokenType::STRING) {
+                propagated[varDecl->name.lexeme] = Substitution{lit->value.lexeme};
+                constantsPropagated++;
+            }
+        }
+    } else if (auto* destructure = dynamic_cast<DestructureStmt*>(stmt.get())) {
+        simplifyExpr(destructure->init);
+    } else if (auto* setStmt = dynamic_cast<SetStmt*>(stmt.get())) {
+        simplifyExpr(setStmt->value);
+    } else if (auto* indexAssign = dynamic_cast<IndexAssignStmt*>(stmt.get())) {
+        // The interpreter needs the innermost base to stay a variable
+        auto* target = static_cast<IndexExpr*>(indexAssign->target.get());
+        simplifyExpr(target->index);
+        while (auto* inner = dynamic_cast<IndexExpr*>(target->base.get())) {
+            target = inner;
+            simplifyExpr(target->index);
+        }
+        if (auto* var = dynamic_cast<VariableExpr*>(target->base.get())) {
+            countReference(var->name.lexeme);
+        } else {
+            simplifyExpr(target->base);
+        }
+        simplifyExpr(indexAssign->value);
+        removeRedundantChecks(target);
+    } else if (auto* fieldAssign = dynamic_cast<FieldAssignStmt*>(stmt.get())) {
+        auto* target = static_cast<FieldExpr*>(fieldAssign->target.get());
+        if (auto* var = dynamic_cast<VariableExpr*>(target->base.get())) {
+            countReference(var->name.lexeme);
+        }
+        simplifyExpr(fieldAssign->value);
+    } else if (auto* sayStmt = dynamic_cast<SayStmt*>(stmt.get())) {
+        simplifyExpr(sayStmt->expr);
+    } else if (auto* returnStmt = dynamic_cast<ReturnStmt*>(stmt.get())) {
+        if (returnStmt->value) simplifyExpr(returnStmt->value);
+        for (auto& more : returnStmt->moreValues) {
+            simplifyExpr(more);
+        }
+    } else if (auto* throwStmt = dynamic_cast<ThrowStmt*>(stmt.get())) {
+        simplifyExpr(throwStmt->expr);
+    } else if (auto* callStmt = dynamic_cast<CallStmt*>(stmt.get())) {
+        countReference(callStmt->name.lexeme);
+        for (auto& arg : callStmt->arguments) {
+            simplifyExpr(arg);
+        }
+    } else if (auto* whenStmt = dynamic_cast<WhenStmt*>(stmt.get())) {
+        std::vector<WhenStmt::Branch> kept;
+        for (auto& branch : whenStmt->branches) {
+            if (branch.condition) {
+                simplifyExpr(branch.condition);
+                if (auto* lit = dynamic_cast<LiteralExpr*>(branch.condition.get())) {
+                    if (lit->value.type == TokenType::NUMBER && std::stoll(lit->value.lexeme) == 0) {
+                        removed += branch.body.size();
+                        continue; // Never taken
+                    }
+                    if (lit->value.type == TokenType::NUMBER) {
+                        branch.condition = nullptr; // Always taken: later branches are dead
+                    }
+                }
+            }
+            // `i < call len(xs)` bounds i from above inside the branch
+            const IteratorRange* tested = nullptr;
+            const VariableExpr* list = nullptr;
+            if (auto* cmp = dynamic_cast<BinaryExpr*>(branch.condition.get())) {
+                auto* var = dynamic_cast<VariableExpr*>(cmp->left.get());
+                list = lengthOperand(cmp->right.get());
+                if (cmp->op.type != TokenType::LESS) {
+                    var = cmp->op.type == TokenType::GREATER ? dynamic_cast<VariableExpr*>(cmp->right.get()) : nullptr;
+                    list = lengthOperand(cmp->left.get());
+                }
+                tested = var ? rangeOf(var->name.lexeme) : nullptr;
+            }
+            std::unordered_set<std::string> bound;
+            if (tested && list && tested->lo >= 0) collectBoundNames(branch.body, bound);
+            if (tested && list && tested->lo >= 0 && !bound.count(tested->name) && !bound.count(list->name.lexeme)) {
+                ranges.push_back(IteratorRange{tested->name, tested->lo, std::min(tested->hi, LIST_LENGTH_LIMIT - 1),
+                                               list->name.lexeme});
+                simplifyBody(branch.body);
+                ranges.pop_back();
+            } else {
+                simplifyBody(branch.body);
+            }
+            kept.emplace_back(std::move(branch.condition), std::move(branch.body));
+            if (!kept.back().condition) break;
+        }
+        if (kept.empty()) {
+            return nullptr;
+        }
+        if (!kept.front().condition) {
+            // Only one path is left; keep its scope but drop the test
+            return std::make_unique<BlockStmt>(std::move(kept.front().body), false);
+        }
+        whenStmt->branches = std::move(kept);
+    } else if (dynamic_cast<MatchStmt*>(stmt.get())) {
+        return simplifyMatch(std::move(stmt));
+    } else if (auto* whileStmt = dynamic_cast<WhileStmt*>(stmt.get())) {
+        simplifyExpr(whileStmt->condition);
+        if (auto* lit = dynamic_cast<LiteralExpr*>(whileStmt->condition.get())) {
+            if (lit->value.type == TokenType::NUMBER && std::stoll(lit->value.lexeme) == 0) {
+                removed += 1;
+                return nullptr;
+            }
+        }
+        simplifyBody(whileStmt->body);
+    } else if (dynamic_cast<ForStmt*>(stmt.get())) {
+        return simplifyLoop(std::move(stmt), options.maxPeeledIterations);
+    } else if (auto* withStmt = dynamic_cast<WithStmt*>(stmt.get())) {
+        simplifyExpr(withStmt->start);
+        simplifyExpr(withStmt->end);
+        if (withStmt->step) simplifyExpr(withStmt->step);
+        simplifyBody(withStmt->body);
+    } else if (auto* block = dynamic_cast<BlockStmt*>(stmt.get())) {
+        simplifyBody(block->body);
+    } else if (auto* tryCatch = dynamic_cast<TryCatchStmt*>(stmt.get())) {
+        simplifyBody(tryCatch->tryBody);
+        simplifyBody(tryCatch->catchBody);
+    } else if (auto* funcDef = dynamic_cast<FunctionDefStmt*>(stmt.get())) {
+        // Names resolve at call time, so facts about enclosing loop
+        // iterators do not hold inside the body
+        std::string enclosing = currentFunction;
+        auto outerSubstitutions = propagated;
+        auto outerRanges = std::move(ranges);
+        ranges.clear();
+        for (auto it = propagated.begin(); it != propagated.end();) {
+            it = it->second.iterator ? propagated.erase(it) : std::next(it);
+        }
+        currentFunction = funcDef->name.lexeme;
+        simplifyBody(funcDef->body);
+        for (auto& version : funcDef->specializations) {
+            simplifyBody(version->body);
+        }
+        currentFunction = enclosing;
+        propagated = std::move(outerSubstitutions);
+        ranges = std::move(outerRanges);
+    }
+    return stmt;
+}
+
+void Optimizer::simplifyExpr(ExprPtr& expr) {
+    if (auto* var = dynamic_cast<VariableExpr*>(expr.get())) {
+        auto it = propagated.find(var->name.lexeme);
+        if (it != propagated.end()) {
+            const Substitution& substitution = it->second;
+            int line = var->name.line;
+            if (std::holds_alternative<std::monostate>(substitution.constant)) {
+                // iterator + offset, for a later copy in an unrolled loop body
+                countReference(var->name.lexeme);
+                ExprPtr iterator = std::make_unique<VariableExpr>(var->name);
+                iterator->inferredType = Type::INTEGER;
+                auto sum = std::make_unique<BinaryExpr>(std::move(iterator), Token(TokenType::PLUS, "+", line),
+                                                        makeLiteral(substitution.offset, line));
+                sum->overflowChecked = false; // Always a value the loop itself reaches
+                static_cast<Expr*>(sum.get())->inferredType = Type::INTEGER;
+                expr = std::move(sum);
+            } else {
+                expr = makeLiteral(substitution.constant, line);
+            }
+            return;
+        }
+        countReference(var->name.lexeme);
+    } else if (auto* bin = dynamic_cast<BinaryExpr*>(expr.get())) {
+        simplifyExpr(bin->left);
+        simplifyExpr(bin->right);
+        auto* left = dynamic_cast<LiteralExpr*>(bin->left.get());
+        auto* right = dynamic_cast<LiteralExpr*>(bin->right.get());
+        if (left && right && left->value.type == TokenType::NUMBER && right->value.type == TokenType::NUMBER) {
+            try {
+                int64_t result = Interpreter::applyIntegerOp(bin->op, std::stoll(left->value.lexeme),
+                                                             std::stoll(right->value.lexeme));
+                expr = makeLiteral(result, bin->op.line);
+            } catch (const std::runtime_error&) {
+                // Division by zero or overflow: left for run time to report
+            }
+        } else if (!ranges.empty() && !foldByRange(expr)) {
+            removeRedundantChecks(bin);
+        }
+    } else if (auto* paren = dynamic_cast<ParenExpr*>(expr.get())) {
+        simplifyExpr(paren->expr);
+        if (dynamic_cast<LiteralExpr*>(paren->expr.get())) {
+            ExprPtr inner = std::move(paren->expr);
+            expr = std::move(inner);
+        }
+    } else if (auto* list = dynamic_cast<ListLiteralExpr*>(expr.get())) {
+        for (auto& elem : list->elements) {
+            simplifyExpr(elem);
+        }
+    } else if (auto* dict = dynamic_cast<DictLiteralExpr*>(expr.get())) {
+        for (auto& entry : dict->entries) {
+            simplifyExpr(entry.first);
+            simplifyExpr(entry.second);
+        }
+    } else if (auto* index = dynamic_cast<IndexExpr*>(expr.get())) {
+        simplifyExpr(index->base);
+        simplifyExpr(index->index);
+        removeRedundantChecks(index);
+    } else if (auto* field = dynamic_cast<FieldExpr*>(expr.get())) {
+        simplifyExpr(field->base);
+    } else if (auto* create = dynamic_cast<CreateExpr*>(expr.get())) {
+        countReference(create->model.lexeme);
+        for (auto& arg : create->arguments) {
+            simplifyExpr(arg);
+        }
+    } else if (auto* call = dynamic_cast<CallExpr*>(expr.get())) {
+        countReference(call->name.lexeme);
+        for (auto& arg : call->arguments) {
+            simplifyExpr(arg);
+        }
+    } else if (auto* assign = dynamic_cast<AssignExpr*>(expr.get())) {
+        simplifyExpr(assign->value);
+    } else if (auto* indexAssign = dynamic_cast<IndexAssignExpr*>(expr.get())) {
+        simplifyExpr(indexAssign->value);
+    }
+}
+
+// Settles `iterator <op> constant` when the comparison comes out the same
+// for every value the iterator takes in its loop
+bool Optimizer::foldByRange(ExprPtr& expr) {
+    auto* bin = static_cast<BinaryExpr*>(expr.get());
+    auto* var = dynamic_cast<VariableExpr*>(bin->left.get());
+    auto* lit = dynamic_cast<LiteralExpr*>(bin->right.get());
+    TokenType op = bin->op.type;
+    if (!var || !lit) {
+        var = dynamic_cast<VariableExpr*>(bin->right.get());
+        lit = dynamic_cast<LiteralExpr*>(bin->left.get());
+        // Mirrored so the iterator reads as the left operand
+        if (op == TokenType::LESS) op = TokenType::GREATER;
+        else if (op == TokenType::GREATER) op = TokenType::LESS;
+        else if (op == TokenType::LESS_EQUAL) op = TokenType::GREATER_EQUAL;
+        else if (op == TokenType::GREATER_EQUAL) op = TokenType::LESS_EQUAL;
+    }
+    if (!var || !lit || lit->value.type != TokenType::NUMBER) return false;
+
+    const IteratorRange* range = rangeOf(var->name.lexeme);
+    if (!range || reassigned.count(var->name.lexeme)) return false;
+
+    int64_t c = std::stoll(lit->value.lexeme);
+    int result = -1;
+    switch (op) {
+        case TokenType::EQUAL_EQUAL:
+            if (c < range->lo || c > range->hi) result = 0;
+            else if (range->lo == range->hi) result = 1;
+            break;
+        case TokenType::NOT_EQUAL:
+            if (c < range->lo || c > range->hi) result = 1;
+            else if (range->lo == range->hi) result = 0;
+            break;
+        case TokenType::LESS:
+            if (range->hi < c) result = 1;
+            else if (range->lo >= c) result = 0;
+            break;
+        case TokenType::LESS_EQUAL:
+            if (range->hi <= c) result = 1;
+            else if (range->lo > c) result = 0;
+            break;
+        case TokenType::GREATER:
+            if (range->lo > c) result = 1;
+            else if (range->hi <= c) result = 0;
+            break;
+        case TokenType::GREATER_EQUAL:
+            if (range->lo >= c) result = 1;
+            else if (range->hi < c) result = 0;
+            break;
+        default:
+            break;
+    }
+    if (result < 0) return false;
+    int line = bin->op.line;
+    expr = makeLiteral(static_cast<int64_t>(result), line);
+    rangeFolds++;
+    return true;
+}
+
+const Optimizer::IteratorRange* Optimizer::rangeOf(const std::string& name) const {
+    for (auto it = ranges.rbegin(); it != ranges.rend(); ++it) {
+        if (it->name == name) return &*it;
+    }
+    return nullptr;
+}
+
+// Bounds every value an integer expression can take, when the iterator
+// ranges in scope decide it. Anything a called function could `set` is unknown.
+bool Optimizer::intervalOf(const Expr* expr, int64_t& lo, int64_t& hi) const {
+    if (auto* lit = dynamic_cast<const LiteralExpr*>(expr)) {
+        if (lit->value.type != TokenType::NUMBER) return false;
+        lo = hi = std::stoll(lit->value.lexeme);
+        return true;
+    } else if (auto* var = dynamic_cast<const VariableExpr*>(expr)) {
+        const IteratorRange* range = rangeOf(var->name.lexeme);
+        if (!range || reassigned.count(var->name.lexeme)) return false;
+        lo = range->lo;
+        hi = range->hi;
+        return true;
+    } else if (auto* paren = dynamic_cast<const ParenExpr*>(expr)) {
+        return intervalOf(paren->expr.get(), lo, hi);
+    } else if (lengthOperand(expr)) {
+        lo = 0;
+        hi = LIST_LENGTH_LIMIT;
+        return true;
+    } else if (auto* bin = dynamic_cast<const BinaryExpr*>(expr)) {
+        TokenType op = bin->op.type;
+        if (op != TokenType::PLUS && op != TokenType::MINUS && op != TokenType::STAR) return false;
+        int64_t leftLo, leftHi, rightLo, rightHi;
+        if (!intervalOf(bin->left.get(), leftLo, leftHi) || !intervalOf(bin->right.get(), rightLo, rightHi)) {
+            return false;
+        }
+        // Each operation is monotonic in each operand, so the extremes are at the corners
+        const int64_t lefts[] = {leftLo, leftHi};
+        const int64_t rights[] = {rightLo, rightHi};
+        lo = std::numeric_limits<int64_t>::max();
+        hi = std::numeric_limits<int64_t>::min();
+        for (int64_t l : lefts) {
+            for (int64_t r : rights) {
+                int64_t corner;
+                bool overflow = op == TokenType::PLUS    ? __builtin_add_overflow(l, r, &corner)
+                                : op == TokenType::MINUS ? __builtin_sub_overflow(l, r, &corner)
+                                                         : __builtin_mul_overflow(l, r, &corner);
+                if (overflow) return false;
+                lo = std::min(lo, corner);
+                hi = std::max(hi, corner);
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+void Optimizer::removeRedundantChecks(BinaryExpr* bin) {
+    int64_t lo, hi;
+    if (bin->overflowChecked && intervalOf(bin, lo, hi)) {
+        bin->overflowChecked = false;
+        checksRemoved++;
+    }
+}
+
+// `xs[i]` needs no bounds check where i is known to lie in [0, len(xs))
+void Optimizer::removeRedundantChecks(IndexExpr* index) {
+    auto* list = dynamic_cast<const VariableExpr*>(index->base.get());
+    auto* var = dynamic_cast<const VariableExpr*>(index->index.get());
+    if (!index->boundsChecked || !list || !var) return;
+    const IteratorRange* range = rangeOf(var->name.lexeme);
+    if (range && range->lo >= 0 && range->below == list->name.lexeme && !reassigned.count(var->name.lexeme) &&
+        !reassigned.count(list->name.lexeme)) {
+        index->boundsChecked = false;
+        checksRemoved++;
+    }
+}
+
+// The list in `call len(list)`, when expr is exactly that and len is the builtin
+const VariableExpr* Optimizer::lengthOperand(const Expr* expr) const {
+    auto* call = dynamic_cast<const CallExpr*>(expr);
+    if (!call || call->name.lexeme != "len" || call->arguments.size() != 1 || shadowedBuiltins.count("len")) {
+        return nullptr;
+    }
+    return dynamic_cast<const VariableExpr*>(call->arguments[0].get());
+}
+
+// Counted loops (`repeat for` with constant start and step, and an iterator
+// the body never rebinds and nothing ever `set`s) are unrolled fully when short, peeled when the
+// first iterations are the only ones a condition holds for, and otherwise
+// unrolled by options.unrollFactor when the trip count is known.
+StmtPtr Optimizer::simplifyLoop(StmtPtr stmt, size_t peelsLeft) {
+    auto* loop = static_cast<ForStmt*>(stmt.get());
+    simplifyExpr(loop->start);
+    simplifyExpr(loop->end);
+    if (loop->step) simplifyExpr(loop->step);
+
+    std::string name = loop->iterator.lexeme;
+    int line = loop->iterator.line;
+    int64_t start = 0;
+    int64_t end = 0;
+    int64_t step = 1;
+    std::unordered_set<std::string> bound;
+    collectBoundNames(loop->body, bound);
+    bool counted = literalInteger(loop->start, start) && (!loop->step || literalInteger(loop->step, step)) &&
+                   step != 0 && !bound.count(name) && !reassigned.count(name);
+    if (!counted) {
+        simplifyBody(loop->body);
+        return stmt;
+    }
+
+    bool endKnown = literalInteger(loop->end, end);
+    uint64_t trips = 0;
+    if (endKnown) {
+        if (step > 0) {
+            trips = end < start ? 0 : (static_cast<uint64_t>(end) - static_cast<uint64_t>(start)) /
+                                      static_cast<uint64_t>(step) + 1;
+        } else {
+            trips = start < end ? 0 : (static_cast<uint64_t>(start) - static_cast<uint64_t>(end)) /
+                                      (0 - static_cast<uint64_t>(step)) + 1;
+        }
+        if (trips == 0) {
+            removed++;
+            return nullptr;
+        }
+    }
+    int64_t last = endKnown ? start + static_cast<int64_t>(trips - 1) * step
+                            : (step > 0 ? std::numeric_limits<int64_t>::max() : std::numeric_limits<int64_t>::min());
+
+    // `to call len(xs) - c` keeps the iterator inside xs when c >= 1 and
+    // nothing can give xs a new value
+    std::string below;
+    if (auto* bin = dynamic_cast<BinaryExpr*>(loop->end.get())) {
+        const VariableExpr* list = lengthOperand(bin->left.get());
+        int64_t c = 0;
+        if (list && bin->op.type == TokenType::MINUS && literalInteger(bin->right, c) && c >= 1 && step > 0 &&
+            start >= 0 && !bound.count(list->name.lexeme) && !reassigned.count(list->name.lexeme)) {
+            below = list->name.lexeme;
+            last = std::max(start, LIST_LENGTH_LIMIT - c);
+        }
+    }
+
+    ranges.push_back(IteratorRange{name, std::min(start, last), std::max(start, last), below});
+    simplifyBody(loop->body);
+    ranges.pop_back();
+    // A function defined in the body reads the iterator when it is called,
+    // so every copy needs the binding the loop itself provides
+    if (!transformLoops || definesFunction(loop->body)) {
+        return stmt;
+    }
+
+    // Names resolve at call time, so a function called from the body reads
+    // the iterator from the loop's scope. Copies for a single iteration then
+    // bind it first; copies at an offset from it cannot, so they are not made.
+    bool observed = callsScript(loop->body);
+    auto copyIteration = [&](std::vector<StmtPtr>& into, int64_t value) {
+        if (observed) {
+            into.push_back(std::make_unique<VarDeclStmt>(loop->iterator, makeLiteral(value, line)));
+        }
+        for (auto& s : instantiate(loop->body, name, Substitution{value, 0, true})) {
+            into.push_back(std::move(s));
+        }
+    };
+
+    uint64_t size = std::max<uint64_t>(countStatements(loop->body), 1);
+    if (endKnown && trips <= options.maxFullUnrollTrips && trips * size <= options.maxUnrolledStatements) {
+        std::vector<StmtPtr> straight;
+        for (uint64_t k = 0; k < trips; ++k) {
+            copyIteration(straight, start + static_cast<int64_t>(k) * step);
+        }
+        auto outerSubstitutions = dropOffsets();
+        simplifyBody(straight); // Drops what follows a return in an early copy
+        propagated = std::move(outerSubstitutions);
+        unrolled.emplace(line, name);
+        return std::make_unique<BlockStmt>(std::move(straight), false); // One scope, as the loop had
+    }
+
+    // Peel the first iteration if the remaining ones settle a condition
+    // Only with a known trip count: the peeled copy runs unconditionally
+    if (peelsLeft > 0 && endKnown && trips >= 2) {
+        int64_t second = start + step;
+        // Counts as they were, restored if the trial copy is discarded
+        size_t removedBefore = removed;
+        size_t foldsBefore = rangeFolds;
+        auto unrolledBefore = unrolled;
+        size_t peeledBefore = peeled;
+        size_t checksBefore = checksRemoved;
+        size_t propagatedBefore = constantsPropagated;
+        size_t tablesBefore = jumpTables;
+        std::vector<StmtPtr> rest;
+        for (const auto& s : loop->body) {
+            rest.push_back(s->clone());
+        }
+        ranges.push_back(IteratorRange{name, std::min(second, last), std::max(second, last)});
+        auto outerSubstitutions = dropOffsets();
+        simplifyBody(rest);
+        ranges.pop_back();
+        if (rangeFolds > foldsBefore) {
+            std::vector<StmtPtr> result;
+            copyIteration(result, start);
+            peeled++;
+            loop->start = makeLiteral(second, line);
+            loop->body = std::move(rest);
+            StmtPtr remaining = simplifyLoop(std::move(stmt), peelsLeft - 1);
+            propagated = std::move(outerSubstitutions);
+            if (remaining) {
+                result.push_back(std::move(remaining));
+            }
+            return std::make_unique<BlockStmt>(std::move(result), false);
+        }
+        propagated = std::move(outerSubstitutions);
+        removed = removedBefore;
+        rangeFolds = foldsBefore;
+        unrolled = std::move(unrolledBefore);
+        peeled = peeledBefore;
+        checksRemoved = checksBefore;
+        constantsPropagated = propagatedBefore;
+        jumpTables = tablesBefore;
+    }
+
+    uint64_t factor = options.unrollFactor;
+    if (!observed && endKnown && factor > 1 && trips >= factor && size * factor <= options.maxUnrolledStatements &&
+        static_cast<uint64_t>(step > 0 ? step : -step) <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) / factor) {
+        uint64_t mainTrips = trips / factor;
+        int64_t stride = step * static_cast<int64_t>(factor);
+        std::vector<StmtPtr> body;
+        for (const auto& s : loop->body) {
+            body.push_back(s->clone());
+        }
+        for (uint64_t u = 1; u < factor; ++u) {
+            Substitution offset{Value(), step * static_cast<int64_t>(u), true};
+            for (auto& s : instantiate(loop->body, name, offset)) {
+                body.push_back(std::move(s));
+            }
+        }
+        // Iterations that do not fill a whole unrolled body run straight-line after it
+        std::vector<StmtPtr> remainder;
+        for (uint64_t k = mainTrips * factor; k < trips; ++k) {
+            int64_t value = start + static_cast<int64_t>(k) * step;
+            for (auto& s : instantiate(loop->body, name, Substitution{value, 0, true})) {
+                remainder.push_back(std::move(s));
+            }
+        }
+        loop->body = std::move(body);
+        loop->end = makeLiteral(start + static_cast<int64_t>(mainTrips - 1) * stride, line);
+        loop->step = makeLiteral(stride, line);
+        unrolled.emplace(line, name);
+        if (remainder.empty()) {
+            return stmt;
+        }
+        std::vector<StmtPtr> result;
+        result.push_back(std::move(stmt));
+        result.push_back(std::make_unique<BlockStmt>(std::move(remainder), false));
+        return std::make_unique<BlockStmt>(std::move(result), false);
+    }
+    return stmt;
+}
+
+// A match on a literal keeps only the case it selects. Otherwise, when the
+// patterns are all integer or all string literals, a jump table replaces
+// the case-by-case comparison.
+StmtPtr Optimizer::simplifyMatch(StmtPtr stmt) {
+    auto* matchStmt = static_cast<MatchStmt*>(stmt.get());
+    simplifyExpr(matchStmt->condition);
+    bool integers = true;
+    bool strings = true;
+    for (auto& c : matchStmt->cases) {
+        simplifyExpr(c.pattern);
+        auto* lit = dynamic_cast<LiteralExpr*>(c.pattern.get());
+        integers = integers && lit && lit->value.type == TokenType::NUMBER;
+        strings = strings && lit && lit->value.type == TokenType::STRING;
+    }
+    if (!integers && !strings) {
+        for (auto& c : matchStmt->cases) {
+            simplifyBody(c.body);
+        }
+        return stmt;
+    }
+
+    matchStmt->integerCases.clear();
+    matchStmt->stringCases.clear();
+    for (size_t i = 0; i < matchStmt->cases.size(); ++i) {
+        const Token& value = static_cast<LiteralExpr*>(matchStmt->cases[i].pattern.get())->value;
+        if (integers) {
+            matchStmt->integerCases.emplace(std::stoll(value.lexeme), i); // The first case wins
+        } else {
+            matchStmt->stringCases.emplace(value.lexeme, i);
+        }
+    }
+
+    if (auto* subject = dynamic_cast<LiteralExpr*>(matchStmt->condition.get())) {
+        std::optional<size_t> chosen;
+        if (integers && subject->value.type == TokenType::NUMBER) {
+            auto it = matchStmt->integerCases.find(std::stoll(subject->value.lexeme));
+            if (it != matchStmt->integerCases.end()) chosen = it->second;
+        } else if (strings && subject->value.type == TokenType::STRING) {
+            auto it = matchStmt->stringCases.find(subject->value.lexeme);
+            if (it != matchStmt->stringCases.end()) chosen = it->second;
+        }
+        for (size_t i = 0; i < matchStmt->cases.size(); ++i) {
+            if (!chosen || i != *chosen) removed += matchStmt->cases[i].body.size();
+        }
+        if (!chosen) {
+            return nullptr;
+        }
+        std::vector<StmtPtr> body = std::move(matchStmt->cases[*chosen].body);
+        simplifyBody(body);
+        return std::make_unique<BlockStmt>(std::move(body), false);
+    }
+
+    for (auto& c : matchStmt->cases) {
+        simplifyBody(c.body);
+    }
+    if (!matchStmt->jumpTable) {
+        matchStmt->jumpTable = true;
+        jumpTables++;
+    }
+    return stmt;
+}
+
+// Copy of a loop body for one iteration, with the iterator replaced and
+// the result simplified
+std::vector<StmtPtr> Optimizer::instantiate(const std::vector<StmtPtr>& body, const std::string& name,
+                                            Substitution substitution) {
+    std::vector<StmtPtr> copy;
+    for (const auto& s : body) {
+        copy.push_back(s->clone());
+    }
+    auto outer = dropOffsets();
+    propagated[name] = std::move(substitution);
+    simplifyBody(copy);
+    propagated = std::move(outer);
+    return copy;
+}
+
+// Loop bodies are copied after they were simplified, so the offsets of
+// enclosing unrolled loops are already in them and must not be added again
+// when a copy is simplified. Returns the substitutions as they were.
+std::unordered_map<std::string, Optimizer::Substitution> Optimizer::dropOffsets() {
+    auto before = propagated;
+    for (auto it = propagated.begin(); it != propagated.end();) {
+        it = std::holds_alternative<std::monostate>(it->second.constant) ? propagated.erase(it) : std::next(it);
+    }
+    return before;
+}
+
+// Whether running the statements may call a script function, directly or
+// through a builtin other than a pure one
+bool Optimizer::callsScript(const std::vector<StmtPtr>& body) const {
+    for (const auto& stmt : body) {
+        if (callsScript(stmt.get())) return true;
+    }
+    return false;
+}
+
+bool Optimizer::callsScript(const Stmt* stmt) const {
+    if (auto* varDecl = dynamic_cast<const VarDeclStmt*>(stmt)) {
+        return varDecl->init && callsScript(varDecl->init.get());
+    } else if (auto* destructure = dynamic_cast<const DestructureStmt*>(stmt)) {
+        return callsScript(destructure->init.get());
+    } else if (auto* setStmt = dynamic_cast<const SetStmt*>(stmt)) {
+        return callsScript(setStmt->value.get());
+    } else if (auto* indexAssign = dynamic_cast<const IndexAssignStmt*>(stmt)) {
+        return callsScript(indexAssign->target.get()) || callsScript(indexAssign->value.get());
+    } else if (auto* fieldAssign = dynamic_cast<const FieldAssignStmt*>(stmt)) {
+        return callsScript(fieldAssign->target.get()) || callsScript(fieldAssign->value.get());
+    } else if (auto* sayStmt = dynamic_cast<const SayStmt*>(stmt)) {
+        return callsScript(sayStmt->expr.get());
+    } else if (auto* returnStmt = dynamic_cast<const ReturnStmt*>(stmt)) {
+        if (returnStmt->value && callsScript(returnStmt->value.get())) return true;
+        for (const auto& more : returnStmt->moreValues) {
+            if (callsScript(more.get())) return true;
+        }
+        return false;
+    } else if (auto* throwStmt = dynamic_cast<const ThrowStmt*>(stmt)) {
+        return callsScript(throwStmt->expr.get());
+    } else if (auto* callStmt = dynamic_cast<const CallStmt*>(stmt)) {
+        const BuiltinSignature* builtin = findBuiltin(callStmt->name.lexeme);
+        if (!builtin || !builtin->pure || shadowedBuiltins.count(builtin->name)) return true;
+        for (const auto& arg : callStmt->arguments) {
+            if (callsScript(arg.get())) return true;
+        }
+        return false;
+    } else if (auto* whenStmt = dynamic_cast<const WhenStmt*>(stmt)) {
+        for (const auto& branch : whenStmt->branches) {
+            if ((branch.condition && callsScript(branch.condition.get())) || callsScript(branch.body)) return true;
+        }
+        return false;
+    } else if (auto* matchStmt = dynamic_cast<const MatchStmt*>(stmt)) {
+        if (callsScript(matchStmt->condition.get())) return true;
+        for (const auto& c : matchStmt->cases) {
+            if (callsScript(c.pattern.get()) || callsScript(c.body)) return true;
+        }
+        return false;
+    } else if (auto* whileStmt = dynamic_cast<const WhileStmt*>(stmt)) {
+        return callsScript(whileStmt->condition.get()) || callsScript(whileStmt->body);
+    } else if (auto* forStmt = dynamic_cast<const ForStmt*>(stmt)) {
+        return callsScript(forStmt->start.get()) || callsScript(forStmt->end.get()) ||
+               (forStmt->step && callsScript(forStmt->step.get())) || callsScript(forStmt->body);
+    } else if (auto* withStmt = dynamic_cast<const WithStmt*>(stmt)) {
+        return callsScript(withStmt->start.get()) || callsScript(withStmt->end.get()) ||
+               (withStmt->step && callsScript(withStmt->step.get())) || callsScript(withStmt->body);
+    } else if (auto* block = dynamic_cast<const BlockStmt*>(stmt)) {
+        return callsScript(block->body);
+    } else if (auto* tryCatch = dynamic_cast<const TryCatchStmt*>(stmt)) {
+        return callsScript(tryCatch->tryBody) || callsScript(tryCatch->catchBody);
+    }
+    return false; // Definitions run nothing
+}
+
+bool Optimizer::callsScript(const Expr* expr) const {
+    if (auto* bin = dynamic_cast<const BinaryExpr*>(expr)) {
+        return callsScript(bin->left.get()) || callsScript(bin->right.get());
+    } else if (auto* paren = dynamic_cast<const ParenExpr*>(expr)) {
+        return callsScript(paren->expr.get());
+    } else if (auto* list = dynamic_cast<const ListLiteralExpr*>(expr)) {
+        for (const auto& elem : list->elements) {
+            if (callsScript(elem.get())) return true;
+        }
+        return false;
+    } else if (auto* dict = dynamic_cast<const DictLiteralExpr*>(expr)) {
+        for (const auto& entry : dict->entries) {
+            if (callsScript(entry.first.get()) || callsScript(entry.second.get())) return true;
+        }
+        return false;
+    } else if (auto* index = dynamic_cast<const IndexExpr*>(expr)) {
+        return callsScript(index->base.get()) || callsScript(index->index.get());
+    } else if (auto* field = dynamic_cast<const FieldExpr*>(expr)) {
+        return callsScript(field->base.get());
+    } else if (auto* create = dynamic_cast<const CreateExpr*>(expr)) {
+        for (const auto& arg : create->arguments) {
+            if (callsScript(arg.get())) return true;
+        }
+        return false;
+    } else if (auto* call = dynamic_cast<const CallExpr*>(expr)) {
+        const BuiltinSignature* builtin = findBuiltin(call->name.lexeme);
+        if (!builtin || !builtin->pure || shadowedBuiltins.count(builtin->name)) return true;
+        for (const auto& arg : call->arguments) {
+            if (callsScript(arg.get())) return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+bool Optimizer::definesFunction(const std::vector<StmtPtr>& body) {
+    for (const auto& stmt : body) {
+        if (dynamic_cast<const FunctionDefStmt*>(stmt.get())) {
+            return true;
+        } else if (auto* whenStmt = dynamic_cast<const WhenStmt*>(stmt.get())) {
+            for (const auto& branch : whenStmt->branches) {
+                if (definesFunction(branch.body)) return true;
+            }
+        } else if (auto* matchStmt = dynamic_cast<const MatchStmt*>(stmt.get())) {
+            for (const auto& c : matchStmt->cases) {
+                if (definesFunction(c.body)) return true;
+            }
+        } else if (auto* whileStmt = dynamic_cast<const WhileStmt*>(stmt.get())) {
+            if (definesFunction(whileStmt->body)) return true;
+        } else if (auto* forStmt = dynamic_cast<const ForStmt*>(stmt.get())) {
+            if (definesFunction(forStmt->body)) return true;
+        } else if (auto* withStmt = dynamic_cast<const WithStmt*>(stmt.get())) {
+            if (definesFunction(withStmt->body)) return true;
+        } else if (auto* block = dynamic_cast<const BlockStmt*>(stmt.get())) {
+            if (definesFunction(block->body)) return true;
+        } else if (auto* tryCatch = dynamic_cast<const TryCatchStmt*>(stmt.get())) {
+            if (definesFunction(tryCatch->tryBody) || definesFunction(tryCatch->catchBody)) return true;
+        }
+    }
+    return false;
+}
+
+size_t Optimizer::countStatements(const std::vector<StmtPtr>& body) {
+    size_t count = 0;
+    for (const auto& stmt : body) {
+        count++;
+        if (auto* whenStmt = dynamic_cast<const WhenStmt*>(stmt.get())) {
+            for (const auto& branch : whenStmt->branches) {
+                count += countStatements(branch.body);
+            }
+        } else if (auto* whileStmt = dynamic_cast<const WhileStmt*>(stmt.get())) {
+            count += countStatements(whileStmt->body);
+        } else if (auto* forStmt = dynamic_cast<const ForStmt*>(stmt.get())) {
+            count += countStatements(forStmt->body);
+        } else if (auto* block = dynamic_cast<const BlockStmt*>(stmt.get())) {
+            count += countStatements(block->body);
+        } else if (auto* tryCatch = dynamic_cast<const TryCatchStmt*>(stmt.get())) {
+            count += countStatements(tryCatch->tryBody) + countStatements(tryCatch->catchBody);
+        } else if (auto* funcDef = dynamic_cast<const FunctionDefStmt*>(stmt.get())) {
+            count += countStatements(funcDef->body);
+        }
+    }
+    return count;
+}
+
+bool Optimizer::literalInteger(const ExprPtr& expr, int64_t& value) {
+    auto* lit = dynamic_cast<const LiteralExpr*>(expr.get());
+    if (!lit || lit->value.type != TokenType::NUMBER) return false;
+    value = std::stoll(lit->value.lexeme);
+    return true;
+}
+
+void Optimizer::countReference(const std::string& name) {
+    if (name != currentFunction) {
+        references[name]++;
+    }
+}
+
+void Optimizer::removeUnusedFunctions(Program& program) {
+    std::vector<StmtPtr> kept;
+    for (auto& stmt : program.statements) {
+        auto* funcDef = dynamic_cast<FunctionDefStmt*>(stmt.get());
+        if (funcDef && references[funcDef->name.lexeme] == 0) {
+            removed++;
+            continue;
+        }
+        kept.push_back(std::move(stmt));
+    }
+    program.statements = std::move(kept);
+}
+
+void Optimizer::foldBody(std::vector<StmtPtr>& body) {
+    for (auto& stmt : body) {
+        foldStmt(stmt.get());
+    }
+}
+
+void Optimizer::foldStmt(Stmt* stmt) {
+    if (auto* varDecl = dynamic_cast<VarDeclStmt*>(stmt)) {
+        if (varDecl->init) foldExpr(varDecl->init);
+    } else if (auto* destructure = dynamic_cast<DestructureStmt*>(stmt)) {
+        // Folding the call itself would keep only its first value
+        for (auto& arg : static_cast<CallExpr*>(destructure->init.get())->arguments) {
+            foldExpr(arg);
+        }
+    } else if (auto* setStmt = dynamic_cast<SetStmt*>(stmt)) {
+        foldExpr(setStmt->value);
+    } else if (auto* indexAssign = dynamic_cast<IndexAssignStmt*>(stmt)) {
+        foldExpr(indexAssign->value);
+    } else if (auto* fieldAssign = dynamic_cast<FieldAssignStmt*>(stmt)) {
+        foldExpr(fieldAssign->value);
+    } else if (auto* sayStmt = dynamic_cast<SayStmt*>(stmt)) {
+        foldExpr(sayStmt->expr);
+    } else if (auto* returnStmt = dynamic_cast<ReturnStmt*>(stmt)) {
+        if (returnStmt->value) foldExpr(returnStmt->value);
+        for (auto& more : returnStmt->moreValues) {
+            foldExpr(more);
+        }
+    } else if (auto* throwStmt = dynamic_cast<ThrowStmt*>(stmt)) {
+        foldExpr(throwStmt->expr);
+    } else if (auto* callStmt = dynamic_cast<CallStmt*>(stmt)) {
+        for (auto& arg : callStmt->arguments) {
+            foldExpr(arg);
+        }
+    } else if (auto* whenStmt = dynamic_cast<WhenStmt*>(stmt)) {
+        for (auto& branch : whenStmt->branches) {
+            if (branch.condition) foldExpr(branch.condition);
+            foldBody(branch.body);
+        }
+    } else if (auto* matchStmt = dynamic_cast<MatchStmt*>(stmt)) {
+        foldExpr(matchStmt->condition);
+        for (auto& c : matchStmt->cases) {
+            foldBody(c.body);
+        }
+    } else if (auto* whileStmt = dynamic_cast<WhileStmt*>(stmt)) {
+        foldExpr(whileStmt->condition);
+        foldBody(whileStmt->body);
+    } else if (auto* forStmt = dynamic_cast<ForStmt*>(stmt)) {
+        foldExpr(forStmt->start);
+        foldExpr(forStmt->end);
+        if (forStmt->step) foldExpr(forStmt->step);
+        foldBody(forStmt->body);
+    } else if (auto* withStmt = dynamic_cast<WithStmt*>(stmt)) {
+        foldExpr(withStmt->start);
+        foldExpr(withStmt->end);
+        if (withStmt->step) foldExpr(withStmt->step);
+        foldBody(withStmt->body);
+    } else if (auto* block = dynamic_cast<BlockStmt*>(stmt)) {
+        foldBody(block->body);
+    } else if (auto* tryCatch = dynamic_cast<TryCatchStmt*>(stmt)) {
+        foldBody(tryCatch->tryBody);
+        foldBody(tryCatch->catchBody);
+    } else if (auto* funcDef = dynamic_cast<FunctionDefStmt*>(stmt)) {
+        std::unordered_set<std::string> enclosing = localNames;
+        for (const auto& param : funcDef->parameters) {
+            localNames.insert(param.lexeme);
+        }
+        collectBoundNames(funcDef->body, localNames);
+        foldBody(funcDef->body);
+        for (auto& version : funcDef->specializations) {
+            foldBody(version->body);
+        }
+        localNames = std::move(enclosing);
+    }
+}
+
+void Optimizer::foldExpr(ExprPtr& expr) {
+    if (auto* bin = dynamic_cast<BinaryExpr*>(expr.get())) {
+        foldExpr(bin->left);
+        foldExpr(bin->right);
+    } else if (auto* paren = dynamic_cast<ParenExpr*>(expr.get())) {
+        foldExpr(paren->expr);
+    } else if (auto* list = dynamic_cast<ListLiteralExpr*>(expr.get())) {
+        for (auto& elem : list->elements) {
+            foldExpr(elem);
+        }
+    } else if (auto* dict = dynamic_cast<DictLiteralExpr*>(expr.get())) {
+        for (auto& entry : dict->entries) {
+            foldExpr(entry.first);
+            foldExpr(entry.second);
+        }
+    } else if (auto* index = dynamic_cast<IndexExpr*>(expr.get())) {
+        foldExpr(index->base);
+        foldExpr(index->index);
+    } else if (auto* field = dynamic_cast<FieldExpr*>(expr.get())) {
+        foldExpr(field->base);
+    } else if (auto* create = dynamic_cast<CreateExpr*>(expr.get())) {
+        for (auto& arg : create->arguments) {
+            foldExpr(arg);
+        }
+    } else if (auto* call = dynamic_cast<CallExpr*>(expr.get())) {
+        bool constantArgs = true;
+        for (auto& arg : call->arguments) {
+            foldExpr(arg);
+            constantArgs = constantArgs && dynamic_cast<LiteralExpr*>(arg.get());
+        }
+        // A call through a local is to whatever it holds, not to the global of that name
+        if (constantArgs && pureFunctions.count(call->name.lexeme) && !localNames.count(call->name.lexeme)) {
+            if (ExprPtr literal = evaluateCall(call)) {
+                expr = std::move(literal);
+                folded++;
+            }
+        }
+    }
+}
+
+ExprPtr Optimizer::evaluateCall(const CallExpr* call) {
+    Value result;
+    try {
+        result = sandbox->evaluate(call);
+    } catch (const StepLimitExceeded&) {
+        return nullptr; // Too expensive to fold; runs as written
+    } catch (const std::runtime_error&) {
+        return nullptr; // Left in place so the error surfaces at run time
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+
+    return makeLiteral(result, call->name.line);
+}
+
+// Literal for an integer or string value, typed as the analyzer would have
+ExprPtr Optimizer::makeLiteral(const Value& value, int line) {
+    ExprPtr literal;
+    if (std::holds_alternative<int64_t>(value)) {
+        literal = std::make_unique<LiteralExpr>(
+            Token(TokenType::NUMBER, std::to_string(std::get<int64_t>(value)), line));
+        literal->inferredType = Type::INTEGER;
+    } else if (std::holds_alternative<std::string>(value)) {
+        literal = std::make_unique<LiteralExpr>(Token(TokenType::STRING, std::get<std::string>(value), line));
+        literal->inferredType = Type::STRING;
+    }
+    return literal;
+}
+
+} // namespace MyCustomLang
@@ -1,10 +1,21 @@
 #include "Parser.h"
+#include "Builtins.h"
 #include <stdexcept>
 #include <iostream>
 
 namespace MyCustomLang {
 
-Parser::Parser(std::vector<Token> t) : tokens(std::move(t)), current(0), symbolTable() {}
+Parser::Parser(std::vector<Token> t) : tokens(std::move(t)), current(0), symbolTable() {
+    for (const auto& builtin : builtinSignatures()) {
+        std::vector<Token> parameters;
+        for (size_t i = 0; i < builtin.arity; ++i) {
+            parameters.emplace_back(TokenType::IDENTIFIER, "arg" + std::to_string(i), 0);
+        }
+        symbolTable.addSymbol(Token(TokenType::IDENTIFIER, builtin.name, 0), Type::FUNCTION, false, parameters);
+        symbolTable.updateSymbolReturnType(builtin.name, builtin.returnType);
+    }
+    symbolTable.closeBuiltinScope();
+}
 
 Token Parser::peek() const {
     return isAtEnd() ? Token(TokenType::END_OF_FILE, "", 0) : tokens[current];
@@ -48,6 +59,7 @@ void Parser::synchronize() {
         if (peek().type == TokenType::NEWLINE ||
             peek().type == TokenType::END ||
             peek().type == TokenType::LET ||
+            peek().type == TokenType::CONST ||
             peek().type == TokenType::SET ||
             peek().type == TokenType::MATCH ||
             peek().type == TokenType::REPEAT ||
@@ -58,6 +70,8 @@ void Parser::synchronize() {
             peek().type == TokenType::CALL || 
             peek().type == TokenType::DEDENT ||
             peek().type == TokenType::TRY ||
+            peek().type == TokenType::CREATE ||
+            peek().type == TokenType::BLOCK ||
             peek().type == TokenType::END_OF_FILE) {
             break;
         }
@@ -97,6 +111,9 @@ StmtPtr Parser::parseStmt() {
         if (match(TokenType::LET)) {
             return parseVarDecl();
         }
+        if (match(TokenType::CONST)) {
+            return parseVarDecl(true);
+        }
         if (match(TokenType::SET)) {
             return parseSetStmt();
         }
@@ -141,6 +158,15 @@ StmtPtr Parser::parseStmt() {
         if (match(TokenType::RETURN)) {
             return parseReturnStmt();
         }
+        if (match(TokenType::BLOCK)) {
+            return parseBlockStmt();
+        }
+        if (match(TokenType::CREATE)) {
+            if (!match(TokenType::MODEL)) {
+                throw ParserError(peek(), "Expected 'model' after 'create'");
+            }
+            return parseModelDef();
+        }
         throw ParserError(peek(), "Expected statement (let, set, when, say, match, or repeat)");
     } catch (const ParserError& e) {
         synchronize();
@@ -148,14 +174,20 @@ StmtPtr Parser::parseStmt() {
     }
 }
 
-StmtPtr Parser::parseVarDecl() {
+StmtPtr Parser::parseVarDecl(bool isConst) {
     Token name = advance();
     if (name.type != TokenType::IDENTIFIER) {
-        throw ParserError(name, "Expected identifier after 'let'");
+        throw ParserError(name, isConst ? "Expected identifier after 'const'" : "Expected identifier after 'let'");
     }
     if (symbolTable.symbolExistsInCurrentScope(name.lexeme)) { // Changed from symbolExists
         throw ParserError(name, "Variable '" + name.lexeme + "' already declared in this scope");
     }
+    if (check(TokenType::COMMA)) {
+        if (isConst) {
+            throw ParserError(peek(), "Constants are declared one at a time");
+        }
+        return parseDestructure(name);
+    }
 
     if (!match(TokenType::BE) && !match(TokenType::EQUAL)) {
         throw ParserError(peek(), "Expected 'be' or '=' after identifier in 'let' statement");
@@ -188,8 +220,40 @@ StmtPtr Parser::parseVarDecl() {
 
     while (match(TokenType::NEWLINE)) {}
 
-    return std::make_unique<VarDeclStmt>(name, std::move(init), typeHint, isLong);
+    return std::make_unique<VarDeclStmt>(name, std::move(init), typeHint, isLong, isConst);
 }
+// `let x, y be call f()`, with the first name already consumed
+StmtPtr Parser::parseDestructure(Token first) {
+    std::vector<Token> names{first};
+    while (match(TokenType::COMMA)) {
+        Token name = advance();
+        if (name.type != TokenType::IDENTIFIER) {
+            throw ParserError(name, "Expected identifier after ','");
+        }
+        for (const auto& other : names) {
+            if (other.lexeme == name.lexeme) {
+                throw ParserError(name, "Variable '" + name.lexeme + "' bound twice");
+            }
+        }
+        if (symbolTable.symbolExistsInCurrentScope(name.lexeme)) {
+            throw ParserError(name, "Variable '" + name.lexeme + "' already declared in this scope");
+        }
+        names.push_back(name);
+    }
+    if (!match(TokenType::BE) && !match(TokenType::EQUAL)) {
+        throw ParserError(peek(), "Expected 'be' or '=' after identifiers in 'let' statement");
+    }
+    ExprPtr init = parseExpr();
+    if (!dynamic_cast<CallExpr*>(init.get())) {
+        throw ParserError(init->getToken(), "Only a function call can be unpacked into several variables");
+    }
+    for (const auto& name : names) {
+        symbolTable.addSymbol(name, Token(TokenType::NONE, "", 0), false);
+    }
+    while (match(TokenType::NEWLINE)) {}
+    return std::make_unique<DestructureStmt>(std::move(names), std::move(init));
+}
+
 // In Parser::parseSetStmt()
 StmtPtr Parser::parseSetStmt() {
     Token name = advance();
@@ -200,21 +264,38 @@ StmtPtr Parser::parseSetStmt() {
         throw ParserError(name, "Variable '" + name.lexeme + "' not declared");
     }
     
-    // Handle index assignment (list[index] = value)
+    // Handle index assignment (list[index] = value, or grid[i][j] = value)
     if (match(TokenType::LEFT_BRACKET)) {
-        ExprPtr index = parseExpr();
-        if (!match(TokenType::RIGHT_BRACKET)) {
-            throw ParserError(peek(), "Expected ']' after index");
-        }
+        ExprPtr target = std::make_unique<VariableExpr>(name);
+        do {
+            ExprPtr index = parseExpr();
+            if (!match(TokenType::RIGHT_BRACKET)) {
+                throw ParserError(peek(), "Expected ']' after index");
+            }
+            target = std::make_unique<IndexExpr>(std::move(target), std::move(index));
+        } while (match(TokenType::LEFT_BRACKET));
         if (!match(TokenType::EQUAL)) {
             throw ParserError(peek(), "Expected '=' after index expression");
         }
         ExprPtr value = parseExpr();
-        ExprPtr target = std::make_unique<VariableExpr>(name);
-        ExprPtr indexExpr = std::make_unique<IndexExpr>(std::move(target), std::move(index));
-        return std::make_unique<IndexAssignStmt>(std::move(indexExpr), std::move(value));
+        return std::make_unique<IndexAssignStmt>(std::move(target), std::move(value));
     }
     
+    // Handle field assignment (record.field = value)
+    if (match(TokenType::DOT)) {
+        Token field = advance();
+        if (field.type != TokenType::IDENTIFIER) {
+            throw ParserError(field, "Expected field name after '.'");
+        }
+        if (!match(TokenType::EQUAL)) {
+            throw ParserError(peek(), "Expected '=' after field name");
+        }
+        ExprPtr value = parseExpr();
+        ExprPtr target = std::make_unique<FieldExpr>(std::make_unique<VariableExpr>(name), field);
+        while (match(TokenType::NEWLINE)) {}
+        return std::make_unique<FieldAssignStmt>(std::move(target), std::move(value));
+    }
+
     // Regular assignment
     if (!match(TokenType::EQUAL)) {
         throw ParserError(peek(), "Expected '=' after identifier in 'set' statement");
@@ -423,6 +504,23 @@ StmtPtr Parser::parseWithLoop() {
     return std::make_unique<WithStmt>(iterator, std::move(start), std::move(end), std::move(step), std::move(body));
 }
 
+StmtPtr Parser::parseBlockStmt() {
+    symbolTable.enterScope();
+    if (!match(TokenType::INDENT)) {
+        throw ParserError(peek(), "Expected indentation after 'block'");
+    }
+    auto body = parseStmtList();
+    if (!match(TokenType::DEDENT) && !check(TokenType::END)) {
+        throw ParserError(peek(), "Expected dedent after block");
+    }
+    if (!match(TokenType::END)) {
+        throw ParserError(peek(), "Expected 'end' to close block");
+    }
+    symbolTable.exitScope();
+    while (match(TokenType::NEWLINE)) {}
+    return std::make_unique<BlockStmt>(std::move(body));
+}
+
 std::vector<StmtPtr> Parser::parseStmtList() {
     std::vector<StmtPtr> statements;
     while (!check(TokenType::DEDENT) && !check(TokenType::END) && !check(TokenType::CASE) && 
@@ -479,9 +577,20 @@ ExprPtr Parser::parseBinaryExpr() {
     return left;
 }
 
+// Every later stage reads a number's lexeme with std::stoll, so one that
+// does not fit in 64 bits is rejected here
+ExprPtr Parser::integerLiteral(const Token& number) {
+    try {
+        std::stoll(number.lexeme);
+    } catch (const std::out_of_range&) {
+        throw ParserError(number, "Integer literal does not fit in 64 bits");
+    }
+    return std::make_unique<LiteralExpr>(number);
+}
+
 ExprPtr Parser::parsePrimary() {
     if (match(TokenType::NUMBER)) {
-        return std::make_unique<LiteralExpr>(previous());
+        return integerLiteral(previous());
     }
     if (match(TokenType::STRING)) {
         return std::make_unique<LiteralExpr>(previous());
@@ -490,7 +599,7 @@ ExprPtr Parser::parsePrimary() {
         if (match(TokenType::NUMBER)) {
             Token number = previous();
             std::string lexeme = "-" + number.lexeme;
-            return std::make_unique<LiteralExpr>(Token(TokenType::NUMBER, lexeme, number.line));
+            return integerLiteral(Token(TokenType::NUMBER, lexeme, number.line));
         }
         throw ParserError(peek(), "Expected number after unary minus");
     }
@@ -503,7 +612,8 @@ ExprPtr Parser::parsePrimary() {
                 throw ParserError(name, "Function '" + name.lexeme + "' not declared");
             }
             Symbol symbol = symbolTable.getSymbol(name.lexeme);
-            if (symbol.type != Type::FUNCTION) { // Fixed: Use symbol.type instead of symbol.typeHint.type
+            // NONE: a parameter or variable that may hold a function value
+            if (symbol.type != Type::FUNCTION && symbol.type != Type::NONE) {
                 throw ParserError(name, "'" + name.lexeme + "' is not a function");
             }
             if (!check(TokenType::RIGHT_PAREN)) {
@@ -520,8 +630,15 @@ ExprPtr Parser::parsePrimary() {
             throw ParserError(name, "Variable or function '" + name.lexeme + "' not declared");
         }
         ExprPtr var = std::make_unique<VariableExpr>(name);
-        if (match(TokenType::LEFT_BRACKET)) {
-            return parseIndexExpr(std::move(var));
+        while (match(TokenType::LEFT_BRACKET)) {
+            var = parseIndexExpr(std::move(var));
+        }
+        while (match(TokenType::DOT)) {
+            Token field = advance();
+            if (field.type != TokenType::IDENTIFIER) {
+                throw ParserError(field, "Expected field name after '.'");
+            }
+            var = std::make_unique<FieldExpr>(std::move(var), field);
         }
         return var;
     }
@@ -558,6 +675,23 @@ ExprPtr Parser::parsePrimary() {
     }
     return std::make_unique<CallExpr>(name, std::move(arguments));
 }
+    if (match(TokenType::CREATE)) {
+        Token model = advance();
+        if (model.type != TokenType::IDENTIFIER) {
+            throw ParserError(model, "Expected model name after 'create'");
+        }
+        if (!symbolTable.symbolExists(model.lexeme) ||
+            symbolTable.getSymbol(model.lexeme).type != Type::MODEL) {
+            throw ParserError(model, "Model '" + model.lexeme + "' not declared");
+        }
+        std::vector<ExprPtr> arguments;
+        if (match(TokenType::WITH)) {
+            do {
+                arguments.push_back(parseExpr());
+            } while (match(TokenType::COMMA));
+        }
+        return std::make_unique<CreateExpr>(model, std::move(arguments));
+    }
     throw ParserError(peek(), "Expected expression");
 }
 
@@ -637,7 +771,7 @@ StmtPtr Parser::parseFunctionDef() {
     if (name.type != TokenType::IDENTIFIER) {
         throw ParserError(name, "Expected function name after 'define function'");
     }
-    if (symbolTable.symbolExists(name.lexeme)) {
+    if (symbolTable.declaredByScript(name.lexeme)) {
         throw ParserError(name, "Function '" + name.lexeme + "' already declared in this scope");
     }
     std::vector<Token> parameters;
@@ -659,8 +793,8 @@ StmtPtr Parser::parseFunctionDef() {
     symbolTable.addSymbol(name, Type::FUNCTION, false, parameters); // Use Type::FUNCTION
     symbolTable.enterScope();
     for (const auto& param : parameters) {
-    symbolTable.addSymbol(param, Type::INTEGER, false, {});
-}
+        symbolTable.addSymbol(param, Type::NONE, false, {}); // Typed per call site by SemanticAnalyzer
+    }
     if (!match(TokenType::INDENT)) {
         throw ParserError(peek(), "Expected indentation after function definition");
     }
@@ -675,6 +809,30 @@ StmtPtr Parser::parseFunctionDef() {
     while (match(TokenType::NEWLINE)) {}
     return std::make_unique<FunctionDefStmt>(name, std::move(parameters), std::move(body));
 }
+StmtPtr Parser::parseModelDef() {
+    Token name = advance();
+    if (name.type != TokenType::IDENTIFIER) {
+        throw ParserError(name, "Expected model name after 'create model'");
+    }
+    if (symbolTable.declaredByScript(name.lexeme)) {
+        throw ParserError(name, "Model '" + name.lexeme + "' already declared");
+    }
+    if (!match(TokenType::WITH)) {
+        throw ParserError(peek(), "Expected 'with' after model name");
+    }
+    std::vector<Token> fields;
+    do {
+        Token field = advance();
+        if (field.type != TokenType::IDENTIFIER) {
+            throw ParserError(field, "Expected field name");
+        }
+        fields.push_back(field);
+    } while (match(TokenType::COMMA));
+    symbolTable.addSymbol(name, Type::MODEL, false, fields);
+    while (match(TokenType::NEWLINE)) {}
+    return std::make_unique<ModelDefStmt>(name, std::move(fields));
+}
+
 ExprPtr Parser::parseCallExpr() {
     Token name = previous();
     std::vector<ExprPtr> arguments;
@@ -682,7 +840,7 @@ ExprPtr Parser::parseCallExpr() {
         throw ParserError(name, "Function '" + name.lexeme + "' not declared");
     }
     Symbol symbol = symbolTable.getSymbol(name.lexeme);
-    if (symbol.type != Type::FUNCTION) { // Fixed: Use symbol.type
+    if (symbol.type != Type::FUNCTION && symbol.type != Type::NONE) {
         throw ParserError(name, "'" + name.lexeme + "' is not a function");
     }
     if (!check(TokenType::RIGHT_PAREN)) {
@@ -705,7 +863,7 @@ StmtPtr Parser::parseCallStmt() {
         throw ParserError(name, "Function '" + name.lexeme + "' not declared");
     }
     Symbol symbol = symbolTable.getSymbol(name.lexeme);
-    if (symbol.type != Type::FUNCTION) { // Fixed: Use symbol.type
+    if (symbol.type != Type::FUNCTION && symbol.type != Type::NONE) {
         throw ParserError(name, "'" + name.lexeme + "' is not a function");
     }
     if (!match(TokenType::LEFT_PAREN)) {
@@ -726,10 +884,14 @@ StmtPtr Parser::parseCallStmt() {
 StmtPtr Parser::parseReturnStmt() {
     Token token = previous();
     ExprPtr value = nullptr;
+    std::vector<ExprPtr> moreValues;
     if (!check(TokenType::NEWLINE) && !check(TokenType::DEDENT) && !check(TokenType::END)) {
         value = parseExpr();
+        while (match(TokenType::COMMA)) {
+            moreValues.push_back(parseExpr());
+        }
     }
     while (match(TokenType::NEWLINE)) {}
-    return std::make_unique<ReturnStmt>(std::move(value));
+    return std::make_unique<ReturnStmt>(std::move(value), token, std::move(moreValues));
 }
 } // namespace MyCustomLang
@@ -0,0 +1,210 @@
+#include "Interpreter.h"
+
+namespace MyCustomLang {
+
+namespace {
+
+constexpr unsigned BITS = 5;                // Hash bits consumed per level: 32-way nodes
+constexpr unsigned LAST_SHIFT = 60;         // Deepest level with hash bits left
+constexpr uint32_t FRAGMENT_MASK = (1u << BITS) - 1;
+
+struct Leaf {
+    uint64_t hash;
+    std::string key;
+    Value value;
+};
+
+uint32_t fragment(uint64_t hash, unsigned shift) {
+    return static_cast<uint32_t>(hash >> shift) & FRAGMENT_MASK;
+}
+
+uint64_t hashKey(const std::string& key) {
+    return std::hash<std::string>{}(key);
+}
+
+} // namespace
+
+// An entry is either a subtree or a leaf. Leaves are shared like nodes, so
+// copying a node on the way to an update never copies its siblings' values.
+struct PersistentDict::Node {
+    struct Entry {
+        std::shared_ptr<const Node> child;
+        std::shared_ptr<const Leaf> leaf;
+    };
+    uint32_t bitmap = 0;      // Which hash fragments at this level have an entry
+    bool collision = false;   // Below the last level: leaves with one hash, unordered
+    std::vector<Entry> entries; // One per set bit, in fragment order
+
+    size_t indexOf(uint32_t bit) const { return __builtin_popcount(bitmap & (bit - 1)); }
+};
+
+namespace {
+
+using Node = PersistentDict::Node;
+using NodePtr = std::shared_ptr<const Node>;
+
+NodePtr pairOf(std::shared_ptr<const Leaf> a, std::shared_ptr<const Leaf> b, unsigned shift) {
+    auto node = std::make_shared<Node>();
+    if (shift > LAST_SHIFT) {
+        node->collision = true;
+        node->entries = {{nullptr, std::move(a)}, {nullptr, std::move(b)}};
+        return node;
+    }
+    uint32_t fa = fragment(a->hash, shift);
+    uint32_t fb = fragment(b->hash, shift);
+    if (fa == fb) {
+        node->bitmap = 1u << fa;
+        node->entries.push_back({pairOf(std::move(a), std::move(b), shift + BITS), nullptr});
+    } else {
+        node->bitmap = (1u << fa) | (1u << fb);
+        if (fa < fb) {
+            node->entries = {{nullptr, std::move(a)}, {nullptr, std::move(b)}};
+        } else {
+            node->entries = {{nullptr, std::move(b)}, {nullptr, std::move(a)}};
+        }
+    }
+    return node;
+}
+
+NodePtr insert(const NodePtr& node, unsigned shift, std::shared_ptr<const Leaf> leaf, bool& added) {
+    if (!node) {
+        auto fresh = std::make_shared<Node>();
+        fresh->bitmap = 1u << fragment(leaf->hash, shift);
+        fresh->entries.push_back({nullptr, std::move(leaf)});
+        added = true;
+        return fresh;
+    }
+    auto copy = std::make_shared<Node>(*node);
+    if (node->collision) {
+        for (auto& entry : copy->entries) {
+            if (entry.leaf->key == leaf->key) {
+                entry.leaf = std::move(leaf);
+                return copy;
+            }
+        }
+        copy->entries.push_back({nullptr, std::move(leaf)});
+        added = true;
+        return copy;
+    }
+    uint32_t bit = 1u << fragment(leaf->hash, shift);
+    size_t index = node->indexOf(bit);
+    if (!(node->bitmap & bit)) {
+        copy->bitmap |= bit;
+        copy->entries.insert(copy->entries.begin() + index, {nullptr, std::move(leaf)});
+        added = true;
+        return copy;
+    }
+    auto& entry = copy->entries[index];
+    if (entry.child) {
+        entry.child = insert(entry.child, shift + BITS, std::move(leaf), added);
+    } else if (entry.leaf->key == leaf->key) {
+        entry.leaf = std::move(leaf);
+    } else {
+        entry.child = pairOf(std::move(entry.leaf), std::move(leaf), shift + BITS);
+        entry.leaf = nullptr;
+        added = true;
+    }
+    return copy;
+}
+
+// Returns the node without `key`: the same node when the key is absent,
+// nullptr when nothing is left
+NodePtr erase(const NodePtr& node, unsigned shift, uint64_t hash, const std::string& key, bool& removed) {
+    if (node->collision) {
+        for (size_t i = 0; i < node->entries.size(); ++i) {
+            if (node->entries[i].leaf->key != key) continue;
+            removed = true;
+            if (node->entries.size() == 1) return nullptr;
+            auto copy = std::make_shared<Node>(*node);
+            copy->entries.erase(copy->entries.begin() + i);
+            return copy;
+        }
+        return node;
+    }
+    uint32_t bit = 1u << fragment(hash, shift);
+    if (!(node->bitmap & bit)) return node;
+    size_t index = node->indexOf(bit);
+    const auto& entry = node->entries[index];
+
+    NodePtr child;
+    std::shared_ptr<const Leaf> leaf;
+    if (entry.child) {
+        child = erase(entry.child, shift + BITS, hash, key, removed);
+        if (child == entry.child) return node;
+        // A subtree left holding one leaf is folded into this node
+        if (child && child->entries.size() == 1 && child->entries[0].leaf) {
+            leaf = child->entries[0].leaf;
+            child = nullptr;
+        }
+    } else if (entry.leaf->key == key) {
+        removed = true;
+    } else {
+        return node;
+    }
+
+    auto copy = std::make_shared<Node>(*node);
+    if (child || leaf) {
+        copy->entries[index] = {std::move(child), std::move(leaf)};
+        return copy;
+    }
+    if (copy->entries.size() == 1) return nullptr;
+    copy->bitmap &= ~bit;
+    copy->entries.erase(copy->entries.begin() + index);
+    return copy;
+}
+
+void visitAll(const Node& node, const std::function<void(const std::string&, const Value&)>& visit) {
+    for (const auto& entry : node.entries) {
+        if (entry.child) {
+            visitAll(*entry.child, visit);
+        } else {
+            visit(entry.leaf->key, entry.leaf->value);
+        }
+    }
+}
+
+} // namespace
+
+const Value* PersistentDict::find(const std::string& key) const {
+    uint64_t hash = hashKey(key);
+    const Node* node = root.get();
+    for (unsigned shift = 0; node; shift += BITS) {
+        if (node->collision) {
+            for (const auto& entry : node->entries) {
+                if (entry.leaf->key == key) return &entry.leaf->value;
+            }
+            return nullptr;
+        }
+        uint32_t bit = 1u << fragment(hash, shift);
+        if (!(node->bitmap & bit)) return nullptr;
+        const auto& entry = node->entries[node->indexOf(bit)];
+        if (!entry.child) {
+            return entry.leaf->key == key ? &entry.leaf->value : nullptr;
+        }
+        node = entry.child.get();
+    }
+    return nullptr;
+}
+
+PersistentDict PersistentDict::set(const std::string& key, Value value) const {
+    bool added = false;
+    PersistentDict result;
+    result.root = insert(root, 0, std::make_shared<const Leaf>(Leaf{hashKey(key), key, std::move(value)}), added);
+    result.count = count + (added ? 1 : 0);
+    return result;
+}
+
+PersistentDict PersistentDict::erase(const std::string& key) const {
+    if (!root) return *this;
+    bool removed = false;
+    PersistentDict result;
+    result.root = MyCustomLang::erase(root, 0, hashKey(key), key, removed);
+    result.count = count - (removed ? 1 : 0);
+    return result;
+}
+
+void PersistentDict::forEach(const std::function<void(const std::string&, const Value&)>& visit) const {
+    if (root) visitAll(*root, visit);
+}
+
+} // namespace MyCustomLang
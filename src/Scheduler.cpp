@@ -0,0 +1,283 @@
+#include "Scheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <limits>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <thread>
+#include <ucontext.h>
+#include <unistd.h>
+
+namespace MyCustomLang {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t NOT_PINNED = std::numeric_limits<size_t>::max();
+
+double millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// CPU time consumed by the calling thread. A task only runs on a worker
+// between two reads of this clock, so the difference is the task's slice.
+double threadCpuMs() {
+    timespec now{};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+} // namespace
+
+struct Scheduler::Tenant {
+    TenantUsage usage;
+    double virtualTime = 0; // CPU milliseconds used, divided by weight
+    size_t running = 0;
+    std::deque<Task*> ready;
+
+    bool active() const { return running > 0 || !ready.empty(); }
+};
+
+struct Scheduler::Task {
+    Scheduler* scheduler;
+    Tenant* tenant;
+    std::string source;
+    Bindings globals;
+    Clock::time_point submitted;
+    TaskReport report;
+
+    ucontext_t context;
+    ucontext_t* resume = nullptr; // The worker running the current slice
+    size_t worker = NOT_PINNED;   // The worker that started it, and the only one that resumes it
+    void* stack = nullptr;
+    size_t mappedBytes = 0;
+    bool started = false;
+    bool finished = false;
+};
+
+Scheduler::Scheduler(Engine& engine, SchedulerOptions opts) : engine(engine), options(opts) {
+    options.workers = std::max<size_t>(1, options.workers);
+}
+
+Scheduler::~Scheduler() {
+    for (auto& task : tasks) {
+        if (task->stack) ::munmap(task->stack, task->mappedBytes);
+    }
+}
+
+Scheduler::Tenant& Scheduler::tenantFor(const std::string& name) {
+    auto& tenant = tenants[name];
+    if (!tenant) {
+        tenant = std::make_unique<Tenant>();
+        tenant->usage.name = name;
+    }
+    return *tenant;
+}
+
+void Scheduler::addTenant(const std::string& name, unsigned weight, int priority) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Tenant& tenant = tenantFor(name);
+    tenant.usage.weight = std::max(1u, weight);
+    tenant.usage.priority = priority;
+}
+
+size_t Scheduler::submit(const std::string& tenant, const std::string& name, std::string source, Bindings globals) {
+    auto task = std::make_unique<Task>();
+    task->scheduler = this;
+    task->source = std::move(source);
+    task->globals = std::move(globals);
+    task->submitted = Clock::now();
+    task->report.tenant = tenant;
+    task->report.name = name;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    task->tenant = &tenantFor(tenant);
+    task->tenant->usage.tasks++;
+    makeReady(*task);
+    tasks.push_back(std::move(task));
+    unfinished++;
+    changed.notify_all(); // Any idle worker may start it
+    return tasks.size() - 1;
+}
+
+// Caller holds the mutex. A started task comes back here after each slice,
+// when its tenant has only just stopped running it: that is not idleness,
+// and catching up would throw away the credit the tenant's weight earned.
+void Scheduler::makeReady(Task& task) {
+    Tenant& tenant = *task.tenant;
+    if (!task.started && !tenant.active()) {
+        double floor = std::numeric_limits<double>::max();
+        for (const auto& [name, other] : tenants) {
+            if (other->active()) floor = std::min(floor, other->virtualTime);
+        }
+        if (floor != std::numeric_limits<double>::max()) {
+            tenant.virtualTime = std::max(tenant.virtualTime, floor);
+        }
+    }
+    tenant.ready.push_back(&task);
+}
+
+// Caller holds the mutex. Only tasks not yet started or started on this
+// worker are considered; each tenant offers the first of those it has.
+Scheduler::Task* Scheduler::pickReady(size_t worker) {
+    Tenant* best = nullptr;
+    std::deque<Task*>::iterator bestTask;
+    for (const auto& [name, tenant] : tenants) {
+        auto task = std::find_if(tenant->ready.begin(), tenant->ready.end(), [worker](const Task* candidate) {
+            return candidate->worker == NOT_PINNED || candidate->worker == worker;
+        });
+        if (task == tenant->ready.end()) continue;
+        if (!best || tenant->usage.priority > best->usage.priority ||
+            (tenant->usage.priority == best->usage.priority && tenant->virtualTime < best->virtualTime)) {
+            best = tenant.get();
+            bestTask = task;
+        }
+    }
+    if (!best) {
+        return nullptr;
+    }
+    Task* task = *bestTask;
+    best->ready.erase(bestTask);
+    best->running++;
+    task->worker = worker;
+    return task;
+}
+
+std::vector<TaskReport> Scheduler::run() {
+    while (true) {
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < options.workers; ++i) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+        workerLoop(0);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        // Tasks submitted after the workers saw nothing left need new ones
+        std::lock_guard<std::mutex> lock(mutex);
+        if (unfinished == 0) break;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<TaskReport> reports;
+    for (auto& task : tasks) {
+        reports.push_back(task->report);
+    }
+    return reports;
+}
+
+std::vector<TenantUsage> Scheduler::usage() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<TenantUsage> result;
+    for (const auto& [name, tenant] : tenants) {
+        result.push_back(tenant->usage);
+    }
+    return result;
+}
+
+void Scheduler::workerLoop(size_t worker) {
+    ucontext_t home;
+    while (true) {
+        Task* task = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (unfinished > 0 && !(task = pickReady(worker))) {
+                changed.wait(lock);
+            }
+            if (!task) {
+                return;
+            }
+        }
+
+        double cpu = 0;
+        if (!task->started) {
+            task->report.waitMs = millisecondsSince(task->submitted);
+            if (!startTask(*task)) {
+                task->report.result = RunResult{1, "", "Could not allocate a stack for the task\n"};
+                task->finished = true;
+            }
+        }
+        if (!task->finished) {
+            task->resume = &home;
+            double cpuBefore = threadCpuMs();
+            ::swapcontext(&home, &task->context);
+            cpu = threadCpuMs() - cpuBefore;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        Tenant& tenant = *task->tenant;
+        tenant.running--;
+        tenant.usage.cpuMs += cpu;
+        tenant.usage.slices++;
+        tenant.virtualTime += cpu / tenant.usage.weight;
+        task->report.cpuMs += cpu;
+        task->report.slices++;
+        slicesRun++;
+        if (task->finished) {
+            task->report.wallMs = millisecondsSince(task->submitted);
+            task->report.doneAtSlice = slicesRun;
+            if (task->stack) ::munmap(task->stack, task->mappedBytes);
+            task->stack = nullptr;
+            task->source.clear();
+            unfinished--;
+            changed.notify_all();
+        } else {
+            makeReady(*task);
+            changed.notify_all(); // Whichever worker it is pinned to may be the one waiting
+        }
+    }
+}
+
+bool Scheduler::startTask(Task& task) {
+    size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t stackBytes = (options.stackBytes + page - 1) / page * page;
+    task.mappedBytes = stackBytes + page;
+    task.stack = ::mmap(nullptr, task.mappedBytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (task.stack == MAP_FAILED) {
+        task.stack = nullptr;
+        return false;
+    }
+    // Guard page: overflowing the stack faults instead of corrupting
+    if (::mprotect(task.stack, page, PROT_NONE) != 0) {
+        ::munmap(task.stack, task.mappedBytes);
+        task.stack = nullptr;
+        return false;
+    }
+
+    ::getcontext(&task.context);
+    task.context.uc_stack.ss_sp = static_cast<char*>(task.stack) + page;
+    task.context.uc_stack.ss_size = stackBytes;
+    task.context.uc_link = nullptr;
+    auto address = reinterpret_cast<uintptr_t>(&task);
+    ::makecontext(&task.context, reinterpret_cast<void (*)()>(&Scheduler::taskEntry), 2,
+                  static_cast<uint32_t>(address >> 32), static_cast<uint32_t>(address));
+    task.started = true;
+    return true;
+}
+
+// makecontext only passes int arguments, so the task pointer arrives in halves
+void Scheduler::taskEntry(uint32_t high, uint32_t low) {
+    auto* task = reinterpret_cast<Task*>((static_cast<uintptr_t>(high) << 32) | low);
+    task->scheduler->runTask(*task);
+    task->finished = true;
+    ::setcontext(task->resume);
+}
+
+void Scheduler::runTask(Task& task) {
+    RunResult& result = task.report.result;
+    try {
+        auto script = engine.compile(task.source, task.globals);
+        result = engine.execute(*script, task.globals, [&](Interpreter& interpreter) {
+            interpreter.setPreemption(options.quantum, [&task] { ::swapcontext(&task.context, task.resume); });
+        });
+    } catch (const std::runtime_error& e) {
+        result = RunResult{1, "", formatCompileError(e)};
+    } catch (const std::exception& e) { // Nothing may unwind past the coroutine's entry
+        result = RunResult{1, "", std::string("Error: ") + e.what() + "\n"};
+    }
+}
+
+} // namespace MyCustomLang
@@ -20,48 +20,90 @@ void SemanticAnalyzer::analyzeStmt(Stmt* stmt) {
             } else {
                 varDecl->declaredType = initType;
             }
+            // Nested scopes are popped by the parser, so locals are redeclared here
+            if (!symbolTable.symbolExistsInCurrentScope(varDecl->name.lexeme)) {
+                symbolTable.addSymbol(varDecl->name, varDecl->typeHint, varDecl->isLong);
+            }
             symbolTable.updateSymbolType(varDecl->name.lexeme, varDecl->declaredType);
+            if (varDecl->isConst) {
+                symbolTable.markConstant(varDecl->name.lexeme);
+            }
+            if (varDecl->declaredType == Type::RECORD) {
+                symbolTable.updateSymbolModel(varDecl->name.lexeme, recordModelOf(varDecl->init.get()));
+            }
+        }
+        noteBound(varDecl->name);
+    } else if (auto* destructure = dynamic_cast<DestructureStmt*>(stmt)) {
+        // Only the first value's type is tracked; the rest are checked at runtime
+        analyzeExpr(destructure->init.get());
+        for (size_t i = 0; i < destructure->names.size(); ++i) {
+            const Token& name = destructure->names[i];
+            if (!symbolTable.symbolExistsInCurrentScope(name.lexeme)) {
+                symbolTable.addSymbol(name, Type::NONE, false);
+            }
+            symbolTable.updateSymbolType(name.lexeme, i == 0 ? destructure->init->inferredType : Type::NONE);
+            noteBound(name);
         }
     } else if (auto* setStmt = dynamic_cast<SetStmt*>(stmt)) {
         analyzeExpr(setStmt->value.get());
+        checkAssignable(setStmt->name);
         Type valueType = setStmt->value->inferredType;
         Symbol sym = symbolTable.getSymbol(setStmt->name.lexeme);
         checkTypeCompatibility(sym.type, valueType, setStmt->name);
+        if (valueType == Type::RECORD) {
+            std::string model = recordModelOf(setStmt->value.get());
+            if (!sym.modelName.empty() && !model.empty() && model != sym.modelName) {
+                throw SemanticError(setStmt->name, "Type mismatch: expected model " + sym.modelName + ", got " + model);
+            }
+        }
         symbolTable.updateSymbolType(setStmt->name.lexeme, valueType);
+    } else if (auto* sayStmt = dynamic_cast<SayStmt*>(stmt)) {
+        analyzeExpr(sayStmt->expr.get());
     } else if (auto* whenStmt = dynamic_cast<WhenStmt*>(stmt)) {
         for (auto& branch : whenStmt->branches) {
             if (branch.condition) {
                 analyzeExpr(branch.condition.get());
-                if (branch.condition->inferredType != Type::INTEGER) {
+                if (branch.condition->inferredType != Type::INTEGER && branch.condition->inferredType != Type::NONE) {
                     throw SemanticError(branch.condition->getToken(), "Condition must be an integer (boolean-like)");
                 }
             }
+            symbolTable.enterScope();
             for (auto& s : branch.body) {
                 analyzeStmt(s.get());
             }
+            symbolTable.exitScope();
         }
     } else if (auto* whileStmt = dynamic_cast<WhileStmt*>(stmt)) {
         analyzeExpr(whileStmt->condition.get());
-        if (whileStmt->condition->inferredType != Type::INTEGER) {
+        if (whileStmt->condition->inferredType != Type::INTEGER && whileStmt->condition->inferredType != Type::NONE) {
             throw SemanticError(whileStmt->condition->getToken(), "While condition must be an integer (boolean-like)");
         }
+        symbolTable.enterScope();
         for (auto& s : whileStmt->body) {
             analyzeStmt(s.get());
         }
+        symbolTable.exitScope();
+    } else if (auto* block = dynamic_cast<BlockStmt*>(stmt)) {
+        symbolTable.enterScope();
+        for (auto& s : block->body) {
+            analyzeStmt(s.get());
+        }
+        symbolTable.exitScope();
     } else if (auto* forStmt = dynamic_cast<ForStmt*>(stmt)) {
         analyzeExpr(forStmt->start.get());
         analyzeExpr(forStmt->end.get());
-        if (forStmt->start->inferredType != Type::INTEGER || forStmt->end->inferredType != Type::INTEGER) {
+        if (!isIntegerLike(forStmt->start->inferredType) || !isIntegerLike(forStmt->end->inferredType)) {
             throw SemanticError(forStmt->iterator, "For loop start and end must be integers");
         }
         if (forStmt->step) {
             analyzeExpr(forStmt->step.get());
-            if (forStmt->step->inferredType != Type::INTEGER) {
+            if (!isIntegerLike(forStmt->step->inferredType)) {
                 throw SemanticError(forStmt->iterator, "For loop step must be an integer");
             }
         }
         symbolTable.enterScope();
         symbolTable.addSymbol(forStmt->iterator, Type::INTEGER, false);
+        noteBound(forStmt->iterator);
         for (auto& s : forStmt->body) {
             analyzeStmt(s.get());
         }
@@ -69,71 +111,59 @@ void SemanticAnalyzer::analyzeStmt(Stmt* stmt) {
     } else if (auto* withStmt = dynamic_cast<WithStmt*>(stmt)) {
         analyzeExpr(withStmt->start.get());
         analyzeExpr(withStmt->end.get());
-        if (withStmt->start->inferredType != Type::INTEGER || withStmt->end->inferredType != Type::INTEGER) {
+        if (!isIntegerLike(withStmt->start->inferredType) || !isIntegerLike(withStmt->end->inferredType)) {
             throw SemanticError(withStmt->iterator, "With loop start and end must be integers");
         }
         if (withStmt->step) {
             analyzeExpr(withStmt->step.get());
-            if (withStmt->step->inferredType != Type::INTEGER) {
+            if (!isIntegerLike(withStmt->step->inferredType)) {
                 throw SemanticError(withStmt->iterator, "With loop step must be an integer");
             }
         }
         symbolTable.enterScope();
         symbolTable.addSymbol(withStmt->iterator, Type::INTEGER, false);
+        noteBound(withStmt->iterator);
         for (auto& s : withStmt->body) {
             analyzeStmt(s.get());
         }
         symbolTable.exitScope();
     } else if (auto* funcDef = dynamic_cast<FunctionDefStmt*>(stmt)) {
-        symbolTable.enterScope();
-        for (const auto& param : funcDef->parameters) {
-            if (args.size() != func->parameters.size()) {
-                throw std::runtime_error("Function " + call->name.lexeme + " expected " +
-                                    std::to_string(func->parameters.size()) + " arguments but got " +
-                                    std::to_string(args.size()));
-            }
-        symbolTable.enterScope();
-        for (const auto& param : funcDef->parameters) {
-            symbolTable.addSymbol(param, Type::INTEGER, false); // Set INTEGER for parameters
+        if (!enclosingLocals.empty()) {
+            findCaptures(funcDef);
         }
-        Type inferredReturnType = Type::NONE;
-        for (auto& s : funcDef->body) {
-            analyzeStmt(s.get());
-            if (auto* returnStmt = dynamic_cast<ReturnStmt*>(s.get())) {
-                if (returnStmt->value) {
-                    analyzeExpr(returnStmt->value.get());
-                    Type returnType = returnStmt->value->inferredType;
-                    returnStmt->returnType = returnType;
-                    if (inferredReturnType == Type::NONE) {
-                        inferredReturnType = returnType;
-                    } else if (returnType != Type::NONE && returnType != inferredReturnType) {
-                        throw SemanticError(returnStmt->value->getToken(), "Inconsistent return type in function");
-                    }
-                }
-            }
+        noteBound(funcDef->name);
+        // Nested scopes, of functions or of when, while and block bodies, are
+        // popped by the parser, so the name is redeclared here
+        if (!symbolTable.symbolExistsInCurrentScope(funcDef->name.lexeme)) {
+            symbolTable.addSymbol(funcDef->name, Type::FUNCTION, false, funcDef->parameters);
         }
-        symbolTable.updateSymbolReturnType(funcDef->name.lexeme, inferredReturnType);
-        symbolTable.updateSymbolReturnType(funcDef->name.lexeme, inferredReturnType);
-        symbolTable.exitScope();
+        // The definition itself is the generic version: parameter types are
+        // unknown and checked at runtime. Typed versions are made per call site.
+        functionDefs[funcDef->name.lexeme] = funcDef;
+        std::vector<Type> genericTypes(funcDef->parameters.size(), Type::NONE);
+        Type returnType = analyzeFunctionBody(funcDef, genericTypes);
+        symbolTable.updateSymbolReturnType(funcDef->name.lexeme, returnType);
     } else if (auto* callStmt = dynamic_cast<CallStmt*>(stmt)) {
-        Symbol sym = symbolTable.getSymbol(callStmt->name.lexeme);
-        if (sym.type != Type::FUNCTION) {
-            throw SemanticError(callStmt->name, "'" + callStmt->name.lexeme + "' is not a function");
-        }
-        if (sym.parameters.size() != callStmt->arguments.size()) {
-            throw SemanticError(callStmt->name, "Incorrect number of arguments for function '" + callStmt->name.lexeme + "'");
-        }
-        for (auto& arg : callStmt->arguments) {
-            analyzeExpr(arg.get());
-        }
+        analyzeCall(callStmt->name, callStmt->arguments, callStmt->specialization);
     } else if (auto* returnStmt = dynamic_cast<ReturnStmt*>(stmt)) {
         if (returnStmt->value) {
             analyzeExpr(returnStmt->value.get());
             returnStmt->returnType = returnStmt->value->inferredType;
+            if (!returnTypes.empty()) {
+                Type& inferredReturnType = returnTypes.back();
+                if (inferredReturnType == Type::NONE) {
+                    inferredReturnType = returnStmt->returnType;
+                } else if (returnStmt->returnType != Type::NONE && returnStmt->returnType != inferredReturnType) {
+                    throw SemanticError(returnStmt->value->getToken(), "Inconsistent return type in function");
+                }
+            }
+        }
+        for (auto& more : returnStmt->moreValues) {
+            analyzeExpr(more.get());
         }
     } else if (auto* throwStmt = dynamic_cast<ThrowStmt*>(stmt)) {
         analyzeExpr(throwStmt->expr.get());
-        if (throwStmt->expr->inferredType != Type::STRING) {
+        if (throwStmt->expr->inferredType != Type::STRING && throwStmt->expr->inferredType != Type::NONE) {
             throw SemanticError(throwStmt->expr->getToken(), "Throw expression must be a string");
         }
     } else if (auto* tryCatch = dynamic_cast<TryCatchStmt*>(stmt)) {
@@ -141,7 +171,8 @@ void SemanticAnalyzer::analyzeStmt(Stmt* stmt) {
             analyzeStmt(s.get());
         }
         symbolTable.enterScope();
-        symbolTable.addSymbol(tryCatch->exceptionName, Type::STRING, false);
+        symbolTable.addSymbol(tryCatch->exceptionVar, Type::STRING, false);
+        noteBound(tryCatch->exceptionVar);
         for (auto& s : tryCatch->catchBody) {
             analyzeStmt(s.get());
         }
@@ -151,14 +182,41 @@ void SemanticAnalyzer::analyzeStmt(Stmt* stmt) {
         for (auto& case_ : matchStmt->cases) {
             analyzeExpr(case_.pattern.get());
             checkTypeCompatibility(matchStmt->condition->inferredType, case_.pattern->inferredType, case_.pattern->getToken());
+            symbolTable.enterScope();
             for (auto& s : case_.body) {
                 analyzeStmt(s.get());
             }
+            symbolTable.exitScope();
+        }
+    } else if (auto* modelDef = dynamic_cast<ModelDefStmt*>(stmt)) {
+        for (size_t i = 0; i < modelDef->fields.size(); ++i) {
+            for (size_t j = 0; j < i; ++j) {
+                if (modelDef->fields[j].lexeme == modelDef->fields[i].lexeme) {
+                    throw SemanticError(modelDef->fields[i], "Duplicate field '" + modelDef->fields[i].lexeme +
+                                        "' in model '" + modelDef->name.lexeme + "'");
+                }
+            }
+        }
+    } else if (auto* fieldAssign = dynamic_cast<FieldAssignStmt*>(stmt)) {
+        analyzeExpr(fieldAssign->target.get());
+        analyzeExpr(fieldAssign->value.get());
+        auto* field = static_cast<FieldExpr*>(fieldAssign->target.get());
+        checkAssignable(field->base.get());
+        std::string model = recordModelOf(field->base.get());
+        if (!model.empty()) {
+            Type fieldType = fieldAssign->target->inferredType;
+            checkTypeCompatibility(fieldType, fieldAssign->value->inferredType, field->field);
+            if (fieldType == Type::NONE) {
+                symbolTable.updateModelFieldType(model, field->slot, fieldAssign->value->inferredType);
+            }
         }
     } else if (auto* indexAssign = dynamic_cast<IndexAssignStmt*>(stmt)) {
         analyzeExpr(indexAssign->target.get());
         analyzeExpr(indexAssign->value.get());
-        if (indexAssign->target->inferredType != Type::LIST && indexAssign->target->inferredType != Type::DICT) {
+        auto* indexTarget = static_cast<IndexExpr*>(indexAssign->target.get());
+        checkAssignable(indexTarget->base.get());
+        Type targetType = indexTarget->base->inferredType;
+        if (targetType != Type::LIST && targetType != Type::DICT && targetType != Type::NONE) {
             throw SemanticError(indexAssign->target->getToken(), "Index target must be a list or dictionary");
         }
     }
@@ -171,10 +229,12 @@ void SemanticAnalyzer::analyzeExpr(Expr* expr) {
 Type SemanticAnalyzer::inferExprType(Expr* expr) {
     if (auto* list = dynamic_cast<ListLiteralExpr*>(expr)) {
         if (!list->elements.empty()) {
-            Type elementType = inferExprType(list->elements[0].get());
-            for (size_t i = 1; i < list->elements.size(); ++i++) {
-                Type currentType = inferExprType(list->elements[i]->get());
-                if (currentType != elementType && currentType != Type::NONE) {
+            analyzeExpr(list->elements[0].get());
+            Type elementType = list->elements[0]->inferredType;
+            for (size_t i = 1; i < list->elements.size(); ++i) {
+                analyzeExpr(list->elements[i].get());
+                Type currentType = list->elements[i]->inferredType;
+                if (currentType != elementType && currentType != Type::NONE && elementType != Type::NONE) {
                     throw SemanticError(list->elements[i]->getToken(), 
                         "All list elements must have the same type");
                 }
@@ -183,11 +243,13 @@ Type SemanticAnalyzer::inferExprType(Expr* expr) {
         return Type::LIST;
     } else if (auto* dict = dynamic_cast<DictLiteralExpr*>(expr)) {
         for (const auto& entry : dict->entries) {
-            Type keyType = inferExprType(entry.first.get());
-            if (keyType != Type::STRING) {
+            analyzeExpr(entry.first.get());
+            Type keyType = entry.first->inferredType;
+            if (keyType != Type::STRING && keyType != Type::NONE) {
                 throw SemanticError(entry.first->getToken(), 
                     "Dictionary keys must be strings");
             }
+            analyzeExpr(entry.second.get());
         }
         return Type::DICT;
     } else if (auto* literal = dynamic_cast<LiteralExpr*>(expr)) {
@@ -195,51 +257,31 @@ Type SemanticAnalyzer::inferExprType(Expr* expr) {
         if (literal->value.type == TokenType::STRING) return Type::STRING;
         return Type::ERROR;
     } else if (auto* binary = dynamic_cast<BinaryExpr*>(expr)) {
-        Type leftType = inferExprType(binary->left.get());
-        Type rightType = inferExprType(binary->right.get());
+        // NONE operands (generic function parameters, list elements, ...)
+        // are left to the interpreter's runtime checks
+        analyzeExpr(binary->left.get());
+        analyzeExpr(binary->right.get());
+        Type leftType = binary->left->inferredType;
+        Type rightType = binary->right->inferredType;
         switch (binary->op.type) {
             case TokenType::PLUS:
             case TokenType::MINUS:
             case TokenType::STAR:
             case TokenType::SLASH:
-                if (leftType == Type::INTEGER && rightType == Type::INTEGER) {
-                    return Type::INTEGER;
-                }
-                if (leftType != Type::INTEGER) {
+                if (leftType != Type::INTEGER && leftType != Type::NONE) {
                     throw SemanticError(binary->left->getToken(), "Left operand must be an integer");
                 }
-                binary->left->inferredType = Type::INTEGER;
-                if (rightType != Type::INTEGER) {
-                    throw SemanticError(binary->right->getToken(), "Right operand type");
+                if (rightType != Type::INTEGER && rightType != Type::NONE) {
+                    throw SemanticError(binary->right->getToken(), "Right operand must be an integer");
                 }
-                binary->right->inferredType = Type::INTEGER;
-                return Type::ERROR;
+                return Type::INTEGER;
             case TokenType::GREATER:
             case TokenType::LESS:
             case TokenType::GREATER_EQUAL:
             case TokenType::LESS_EQUAL:
             case TokenType::EQUAL_EQUAL:
             case TokenType::NOT_EQUAL:
-                if (leftType == Type::NONE || rightType == Type::NONE) {
-                    if (leftType == Type::NONE) {
-                        if (auto* var = dynamic_cast<VariableExpr*>(binary->left.get())) {
-                            symbolTable.updateSymbolType(var->name.lexeme, Type::INTEGER);
-                            leftType = Type::INTEGER;
-                            binary->left->inferredType = Type::INTEGER;
-                        }
-                    }
-                    if (rightType == Type::NONE) {
-                        if (auto* var = dynamic_cast<VariableExpr*>(binary->right.get())) {
-                            symbolTable.updateSymbolType(var->name.lexeme, Type::INTEGER);
-                            rightType = Type::INTEGER;
-                            binary->right->inferredType = Type::INTEGER;
-                        }
-                    }
-                    if (leftType == Type::NONE || rightType == Type::NONE) {
-                        throw SemanticError(binary->op, "Cannot compare operands with unknown types");
-                    }
-                }
-                if (leftType == rightType) {
+                if (leftType == Type::NONE || rightType == Type::NONE || leftType == rightType) {
                     return Type::INTEGER; // Boolean-like result
                 }
                 throw SemanticError(binary->op, "Operands must have the same type for comparison");
@@ -247,50 +289,415 @@ Type SemanticAnalyzer::inferExprType(Expr* expr) {
                 return Type::ERROR;
         }
     } else if (auto* paren = dynamic_cast<ParenExpr*>(expr)) {
-        return inferExprType(paren->expr.get());
+        analyzeExpr(paren->expr.get());
+        return paren->expr->inferredType;
     } else if (auto* index = dynamic_cast<IndexExpr*>(expr)) {
-        Type baseType = inferExprType(index->base.get());
-        Type indexType = inferExprType(index->index.get());
-        if (baseType != Type::LIST && baseType != Type::DICT) {
+        analyzeExpr(index->base.get());
+        analyzeExpr(index->index.get());
+        Type baseType = index->base->inferredType;
+        Type indexType = index->index->inferredType;
+        if (baseType != Type::LIST && baseType != Type::DICT && baseType != Type::NONE) {
             throw SemanticError(index->base->getToken(), "Index base must be a list or dictionary");
         }
-        if (indexType != Type::INTEGER) {
+        if (baseType == Type::LIST && indexType != Type::INTEGER && indexType != Type::NONE) {
             throw SemanticError(index->index->getToken(), "Index must be an integer");
         }
-        if (baseType == Type::LIST) {
-            return Type::INTEGER; // Assume list elements are integers for simplicity
+        if (baseType == Type::DICT && indexType != Type::STRING && indexType != Type::NONE) {
+            throw SemanticError(index->index->getToken(), "Dictionary key must be a string");
         }
-        return Type::INTEGER; // Assume dict values are integers for simplicity
+        return Type::NONE; // Element types are not tracked
     } else if (auto* call = dynamic_cast<CallExpr*>(expr)) {
-        Symbol sym = symbolTable.getSymbol(call->name.lexeme);
-        if (sym.type != Type::FUNCTION) {
-            throw SemanticError(call->name, "'" + call->name.lexeme + "' is not a function");
+        return analyzeCall(call->name, call->arguments, call->specialization);
+    } else if (auto* create = dynamic_cast<CreateExpr*>(expr)) {
+        Symbol model = symbolTable.getSymbol(create->model.lexeme);
+        if (model.type != Type::MODEL) {
+            throw SemanticError(create->model, "'" + create->model.lexeme + "' is not a model");
         }
-        if (sym.parameters.size() != call->arguments.size()) {
-            throw SemanticError(call->name, "Incorrect number of arguments for function '" + call->name.lexeme + "'");
+        if (model.parameters.size() != create->arguments.size()) {
+            throw SemanticError(create->model, "Model '" + create->model.lexeme + "' has " +
+                                std::to_string(model.parameters.size()) + " fields but got " +
+                                std::to_string(create->arguments.size()) + " values");
         }
-        for (size_t i = 0; i < call->arguments.size(); ++i) {
-            Type argType = inferExprType(call->arguments[i].get());
+        for (size_t i = 0; i < create->arguments.size(); ++i) {
+            analyzeExpr(create->arguments[i].get());
+            Type argType = create->arguments[i]->inferredType;
+            Type fieldType = i < model.fieldTypes.size() ? model.fieldTypes[i] : Type::NONE;
+            checkTypeCompatibility(fieldType, argType, create->arguments[i]->getToken());
+            if (fieldType == Type::NONE && argType != Type::NONE) {
+                symbolTable.updateModelFieldType(create->model.lexeme, i, argType);
+            }
         }
-        return sym.returnType;
+        return Type::RECORD;
+    } else if (auto* field = dynamic_cast<FieldExpr*>(expr)) {
+        analyzeExpr(field->base.get());
+        Type baseType = field->base->inferredType;
+        if (baseType != Type::RECORD && baseType != Type::NONE) {
+            throw SemanticError(field->field, "Field access on non-record value");
+        }
+        std::string modelName = recordModelOf(field->base.get());
+        if (modelName.empty()) {
+            return Type::NONE; // Model unknown statically, resolved by name at runtime
+        }
+        Symbol model = symbolTable.getSymbol(modelName);
+        for (size_t i = 0; i < model.parameters.size(); ++i) {
+            if (model.parameters[i].lexeme == field->field.lexeme) {
+                field->slot = static_cast<int>(i);
+                return i < model.fieldTypes.size() ? model.fieldTypes[i] : Type::NONE;
+            }
+        }
+        throw SemanticError(field->field, "Model '" + modelName + "' has no field '" + field->field.lexeme + "'");
     } else if (auto* var = dynamic_cast<VariableExpr*>(expr)) {
         Symbol sym = symbolTable.getSymbol(var->name.lexeme);
         return sym.type;
     } else if (auto* assign = dynamic_cast<AssignExpr*>(expr)) {
-        Type valueType = inferExprType(assign->value.get());
+        analyzeExpr(assign->value.get());
+        checkAssignable(assign->name);
         Symbol sym = symbolTable.getSymbol(assign->name.lexeme);
         checkTypeCompatibility(sym.type, assign->value->inferredType, assign->name);
-        return valueType;
+        return assign->value->inferredType;
     } else if (auto* indexAssign = dynamic_cast<IndexAssignExpr*>(expr)) {
-        Type targetType = inferExprType(indexAssign->target.get());
-        if (indexAssign->target->inferredType != Type::LIST && indexAssign->target->inferredType != Type::DICT) {
+        analyzeExpr(indexAssign->target.get());
+        Type targetType = indexAssign->target->inferredType;
+        if (targetType != Type::LIST && targetType != Type::DICT && targetType != Type::NONE) {
             throw SemanticError(indexAssign->target->getToken(), "Index assign target must be a list or dictionary");
         }
-        return inferExprType(indexAssign->value.get());
+        analyzeExpr(indexAssign->value.get());
+        return indexAssign->value->inferredType;
     }
     return Type::ERROR;
 }
 
+Type SemanticAnalyzer::analyzeFunctionBody(FunctionDefStmt* func, const std::vector<Type>& paramTypes) {
+    symbolTable.enterScope();
+    for (size_t i = 0; i < func->parameters.size(); ++i) {
+        symbolTable.addSymbol(func->parameters[i], paramTypes[i], false);
+    }
+    returnTypes.push_back(Type::NONE);
+    std::unordered_set<std::string> locals;
+    for (const auto& param : func->parameters) {
+        locals.insert(param.lexeme);
+    }
+    collectBindings(func->body, locals);
+    enclosingLocals.push_back(std::move(locals));
+    boundLocals.emplace_back();
+    for (const auto& param : func->parameters) {
+        boundLocals.back().insert(param.lexeme);
+    }
+    for (auto& s : func->body) {
+        analyzeStmt(s.get());
+    }
+    boundLocals.pop_back();
+    enclosingLocals.pop_back();
+    Type returnType = returnTypes.back();
+    returnTypes.pop_back();
+    symbolTable.exitScope();
+    return returnType;
+}
+
+Type SemanticAnalyzer::analyzeCall(const Token& name, std::vector<ExprPtr>& arguments, int& specialization) {
+    Symbol sym = symbolTable.getSymbol(name.lexeme);
+    if (sym.type != Type::FUNCTION && sym.type != Type::NONE) {
+        throw SemanticError(name, "'" + name.lexeme + "' is not a function");
+    }
+    bool local = false; // A parameter or local hides any global function of the same name
+    for (const auto& locals : enclosingLocals) {
+        local = local || locals.count(name.lexeme) > 0;
+    }
+    if (sym.type == Type::NONE || local || (!functionDefs.count(name.lexeme) && !symbolTable.isBuiltin(name.lexeme))) {
+        // A variable holding a function value: the callee and its arity are only known at runtime
+        for (auto& arg : arguments) {
+            analyzeExpr(arg.get());
+        }
+        return Type::NONE;
+    }
+    if (sym.parameters.size() != arguments.size()) {
+        throw SemanticError(name, "Incorrect number of arguments for function '" + name.lexeme + "'");
+    }
+    std::vector<Type> argTypes;
+    bool allKnown = true;
+    for (auto& arg : arguments) {
+        analyzeExpr(arg.get());
+        argTypes.push_back(arg->inferredType);
+        allKnown = allKnown && arg->inferredType != Type::NONE;
+    }
+
+    auto def = functionDefs.find(name.lexeme);
+    if (!allKnown || def == functionDefs.end()) {
+        return sym.returnType; // Generic version
+    }
+    FunctionDefStmt* func = def->second;
+    for (size_t i = 0; i < func->specializations.size(); ++i) {
+        if (func->specializations[i]->paramTypes == argTypes) {
+            specialization = static_cast<int>(i);
+            return func->specializations[i]->returnType;
+        }
+    }
+    if (func->specializations.size() >= MAX_SPECIALIZATIONS) {
+        return sym.returnType;
+    }
+
+    // Registered before its body is analyzed so recursive calls find it
+    auto version = std::make_shared<FunctionDefStmt>(*func);
+    version->specializations.clear();
+    version->paramTypes = argTypes;
+    func->specializations.push_back(version);
+    specialization = static_cast<int>(func->specializations.size() - 1);
+    version->returnType = analyzeFunctionBody(version.get(), argTypes);
+    return version->returnType;
+}
+
+std::string SemanticAnalyzer::recordModelOf(Expr* expr) {
+    if (auto* create = dynamic_cast<CreateExpr*>(expr)) {
+        return create->model.lexeme;
+    } else if (auto* var = dynamic_cast<VariableExpr*>(expr)) {
+        return symbolTable.getSymbol(var->name.lexeme).modelName;
+    } else if (auto* paren = dynamic_cast<ParenExpr*>(expr)) {
+        return recordModelOf(paren->expr.get());
+    }
+    return "";
+}
+
+void SemanticAnalyzer::checkAssignable(const Token& name) {
+    if (symbolTable.symbolExists(name.lexeme) && symbolTable.getSymbol(name.lexeme).isConst) {
+        throw SemanticError(name, "Cannot assign to constant '" + name.lexeme + "'");
+    }
+}
+
+// Containers bound by `const` are immutable too, however deeply indexed
+void SemanticAnalyzer::checkAssignable(const Expr* target) {
+    while (auto* index = dynamic_cast<const IndexExpr*>(target)) {
+        target = index->base.get();
+    }
+    if (auto* var = dynamic_cast<const VariableExpr*>(target)) {
+        if (symbolTable.getSymbol(var->name.lexeme).isConst) {
+            throw SemanticError(var->name, "Cannot modify constant '" + var->name.lexeme + "'");
+        }
+    }
+}
+
+// Closures capture by value: names the body uses that are locals of an
+// enclosing function, other than ones it binds itself
+void SemanticAnalyzer::findCaptures(FunctionDefStmt* func) {
+    std::unordered_set<std::string> own;
+    for (const auto& param : func->parameters) {
+        own.insert(param.lexeme);
+    }
+    own.insert(func->name.lexeme); // Bound to the function itself by each call
+    collectBindings(func->body, own);
+
+    std::vector<Token> uses;
+    std::vector<Token> assigned;
+    collectUses(func->body, uses, assigned);
+    std::unordered_set<std::string> seen;
+    func->captures.clear();
+    func->bindsSelf = false;
+    for (const auto& use : uses) {
+        func->bindsSelf = func->bindsSelf || use.lexeme == func->name.lexeme;
+    }
+    for (const auto& use : uses) {
+        if (own.count(use.lexeme) || !seen.insert(use.lexeme).second) continue;
+        for (size_t level = enclosingLocals.size(); level-- > 0;) {
+            if (!enclosingLocals[level].count(use.lexeme)) continue;
+            // Captured values are copied when the definition runs, so the
+            // name must already be bound there; later bindings are not seen
+            if (!boundLocals[level].count(use.lexeme)) {
+                throw SemanticError(use, "Function '" + func->name.lexeme + "' uses '" + use.lexeme +
+                                    "' before it is bound in the enclosing function");
+            }
+            func->captures.push_back(use);
+            break;
+        }
+    }
+    for (const auto& target : assigned) {
+        for (const auto& capture : func->captures) {
+            if (capture.lexeme == target.lexeme) {
+                throw SemanticError(target, "Cannot assign to '" + target.lexeme +
+                                    "': it is captured by value from an enclosing function");
+            }
+        }
+    }
+}
+
+// Records that a local of the innermost function being analyzed is bound
+// from here on, so closures defined after this point may capture it
+void SemanticAnalyzer::noteBound(const Token& name) {
+    if (!boundLocals.empty()) {
+        boundLocals.back().insert(name.lexeme);
+    }
+}
+
+// Names a body declares for itself; nested function bodies are not entered
+void SemanticAnalyzer::collectBindings(const std::vector<StmtPtr>& body, std::unordered_set<std::string>& names) {
+    for (const auto& stmt : body) {
+        if (auto* varDecl = dynamic_cast<const VarDeclStmt*>(stmt.get())) {
+            names.insert(varDecl->name.lexeme);
+        } else if (auto* destructure = dynamic_cast<const DestructureStmt*>(stmt.get())) {
+            for (const auto& name : destructure->names) {
+                names.insert(name.lexeme);
+            }
+        } else if (auto* whenStmt = dynamic_cast<const WhenStmt*>(stmt.get())) {
+            for (const auto& branch : whenStmt->branches) {
+                collectBindings(branch.body, names);
+            }
+        } else if (auto* matchStmt = dynamic_cast<const MatchStmt*>(stmt.get())) {
+            for (const auto& c : matchStmt->cases) {
+                collectBindings(c.body, names);
+            }
+        } else if (auto* whileStmt = dynamic_cast<const WhileStmt*>(stmt.get())) {
+            collectBindings(whileStmt->body, names);
+        } else if (auto* forStmt = dynamic_cast<const ForStmt*>(stmt.get())) {
+            names.insert(forStmt->iterator.lexeme);
+            collectBindings(forStmt->body, names);
+        } else if (auto* withStmt = dynamic_cast<const WithStmt*>(stmt.get())) {
+            names.insert(withStmt->iterator.lexeme);
+            collectBindings(withStmt->body, names);
+        } else if (auto* block = dynamic_cast<const BlockStmt*>(stmt.get())) {
+            collectBindings(block->body, names);
+        } else if (auto* tryCatch = dynamic_cast<const TryCatchStmt*>(stmt.get())) {
+            names.insert(tryCatch->exceptionVar.lexeme);
+            collectBindings(tryCatch->tryBody, names);
+            collectBindings(tryCatch->catchBody, names);
+        } else if (auto* funcDef = dynamic_cast<const FunctionDefStmt*>(stmt.get())) {
+            names.insert(funcDef->name.lexeme);
+        }
+    }
+}
+
+// Every name a body reads, calls or assigns (the latter also go to
+// `assigned`), including the free names of functions nested in it
+void SemanticAnalyzer::collectUses(const std::vector<StmtPtr>& body, std::vector<Token>& uses,
+                                   std::vector<Token>& assigned) {
+    for (const auto& stmt : body) {
+        if (auto* varDecl = dynamic_cast<const VarDeclStmt*>(stmt.get())) {
+            if (varDecl->init) collectUses(varDecl->init.get(), uses, assigned);
+        } else if (auto* destructure = dynamic_cast<const DestructureStmt*>(stmt.get())) {
+            collectUses(destructure->init.get(), uses, assigned);
+        } else if (auto* setStmt = dynamic_cast<const SetStmt*>(stmt.get())) {
+            uses.push_back(setStmt->name);
+            assigned.push_back(setStmt->name);
+            collectUses(setStmt->value.get(), uses, assigned);
+        } else if (auto* indexAssign = dynamic_cast<const IndexAssignStmt*>(stmt.get())) {
+            const Expr* target = indexAssign->target.get();
+            while (auto* index = dynamic_cast<const IndexExpr*>(target)) {
+                target = index->base.get();
+            }
+            if (auto* var = dynamic_cast<const VariableExpr*>(target)) {
+                assigned.push_back(var->name);
+            }
+            collectUses(indexAssign->target.get(), uses, assigned);
+            collectUses(indexAssign->value.get(), uses, assigned);
+        } else if (auto* fieldAssign = dynamic_cast<const FieldAssignStmt*>(stmt.get())) {
+            auto* target = static_cast<const FieldExpr*>(fieldAssign->target.get());
+            if (auto* var = dynamic_cast<const VariableExpr*>(target->base.get())) {
+                assigned.push_back(var->name);
+            }
+            collectUses(fieldAssign->target.get(), uses, assigned);
+            collectUses(fieldAssign->value.get(), uses, assigned);
+        } else if (auto* sayStmt = dynamic_cast<const SayStmt*>(stmt.get())) {
+            collectUses(sayStmt->expr.get(), uses, assigned);
+        } else if (auto* returnStmt = dynamic_cast<const ReturnStmt*>(stmt.get())) {
+            if (returnStmt->value) collectUses(returnStmt->value.get(), uses, assigned);
+            for (const auto& more : returnStmt->moreValues) {
+                collectUses(more.get(), uses, assigned);
+            }
+        } else if (auto* throwStmt = dynamic_cast<const ThrowStmt*>(stmt.get())) {
+            collectUses(throwStmt->expr.get(), uses, assigned);
+        } else if (auto* callStmt = dynamic_cast<const CallStmt*>(stmt.get())) {
+            uses.push_back(callStmt->name);
+            for (const auto& arg : callStmt->arguments) {
+                collectUses(arg.get(), uses, assigned);
+            }
+        } else if (auto* whenStmt = dynamic_cast<const WhenStmt*>(stmt.get())) {
+            for (const auto& branch : whenStmt->branches) {
+                if (branch.condition) collectUses(branch.condition.get(), uses, assigned);
+                collectUses(branch.body, uses, assigned);
+            }
+        } else if (auto* matchStmt = dynamic_cast<const MatchStmt*>(stmt.get())) {
+            collectUses(matchStmt->condition.get(), uses, assigned);
+            for (const auto& c : matchStmt->cases) {
+                collectUses(c.pattern.get(), uses, assigned);
+                collectUses(c.body, uses, assigned);
+            }
+        } else if (auto* whileStmt = dynamic_cast<const WhileStmt*>(stmt.get())) {
+            collectUses(whileStmt->condition.get(), uses, assigned);
+            collectUses(whileStmt->body, uses, assigned);
+        } else if (auto* forStmt = dynamic_cast<const ForStmt*>(stmt.get())) {
+            collectUses(forStmt->start.get(), uses, assigned);
+            collectUses(forStmt->end.get(), uses, assigned);
+            if (forStmt->step) collectUses(forStmt->step.get(), uses, assigned);
+            collectUses(forStmt->body, uses, assigned);
+        } else if (auto* withStmt = dynamic_cast<const WithStmt*>(stmt.get())) {
+            collectUses(withStmt->start.get(), uses, assigned);
+            collectUses(withStmt->end.get(), uses, assigned);
+            if (withStmt->step) collectUses(withStmt->step.get(), uses, assigned);
+            collectUses(withStmt->body, uses, assigned);
+        } else if (auto* block = dynamic_cast<const BlockStmt*>(stmt.get())) {
+            collectUses(block->body, uses, assigned);
+        } else if (auto* tryCatch = dynamic_cast<const TryCatchStmt*>(stmt.get())) {
+            collectUses(tryCatch->tryBody, uses, assigned);
+            collectUses(tryCatch->catchBody, uses, assigned);
+        } else if (auto* funcDef = dynamic_cast<const FunctionDefStmt*>(stmt.get())) {
+            // Its own assignments are checked when it is analyzed
+            std::unordered_set<std::string> own;
+            for (const auto& param : funcDef->parameters) {
+                own.insert(param.lexeme);
+            }
+            collectBindings(funcDef->body, own);
+            std::vector<Token> inner;
+            std::vector<Token> innerAssigned;
+            collectUses(funcDef->body, inner, innerAssigned);
+            for (const auto& use : inner) {
+                if (!own.count(use.lexeme)) uses.push_back(use);
+            }
+        }
+    }
+}
+
+void SemanticAnalyzer::collectUses(const Expr* expr, std::vector<Token>& uses, std::vector<Token>& assigned) {
+    if (auto* var = dynamic_cast<const VariableExpr*>(expr)) {
+        uses.push_back(var->name);
+    } else if (auto* binary = dynamic_cast<const BinaryExpr*>(expr)) {
+        collectUses(binary->left.get(), uses, assigned);
+        collectUses(binary->right.get(), uses, assigned);
+    } else if (auto* paren = dynamic_cast<const ParenExpr*>(expr)) {
+        collectUses(paren->expr.get(), uses, assigned);
+    } else if (auto* list = dynamic_cast<const ListLiteralExpr*>(expr)) {
+        for (const auto& elem : list->elements) {
+            collectUses(elem.get(), uses, assigned);
+        }
+    } else if (auto* dict = dynamic_cast<const DictLiteralExpr*>(expr)) {
+        for (const auto& entry : dict->entries) {
+            collectUses(entry.first.get(), uses, assigned);
+            collectUses(entry.second.get(), uses, assigned);
+        }
+    } else if (auto* index = dynamic_cast<const IndexExpr*>(expr)) {
+        collectUses(index->base.get(), uses, assigned);
+        collectUses(index->index.get(), uses, assigned);
+    } else if (auto* field = dynamic_cast<const FieldExpr*>(expr)) {
+        collectUses(field->base.get(), uses, assigned);
+    } else if (auto* create = dynamic_cast<const CreateExpr*>(expr)) {
+        for (const auto& arg : create->arguments) {
+            collectUses(arg.get(), uses, assigned);
+        }
+    } else if (auto* call = dynamic_cast<const CallExpr*>(expr)) {
+        uses.push_back(call->name);
+        for (const auto& arg : call->arguments) {
+            collectUses(arg.get(), uses, assigned);
+        }
+    } else if (auto* assign = dynamic_cast<const AssignExpr*>(expr)) {
+        uses.push_back(assign->name);
+        assigned.push_back(assign->name);
+        collectUses(assign->value.get(), uses, assigned);
+    } else if (auto* indexAssign = dynamic_cast<const IndexAssignExpr*>(expr)) {
+        collectUses(indexAssign->target.get(), uses, assigned);
+        collectUses(indexAssign->value.get(), uses, assigned);
+    }
+}
+
+bool SemanticAnalyzer::isIntegerLike(Type type) {
+    return type == Type::INTEGER || type == Type::NONE;
+}
+
 void SemanticAnalyzer::checkTypeCompatibility(Type expected, Type actual, const Token& token) {
     if (expected == Type::NONE || actual == Type::NONE) return;
     if (expected != actual) {
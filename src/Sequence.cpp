@@ -0,0 +1,304 @@
+#include "Interpreter.h"
+#include "Builtins.h"
+#include "Columnar.h"
+#include <algorithm>
+
+namespace MyCustomLang {
+
+namespace {
+
+using Step = Sequence::Step;
+
+// A step of a chain while it runs, with its running state
+struct Stage {
+    Step step;
+    std::shared_ptr<FunctionDefStmt> function; // MAP, FILTER
+    const Closure* closure = nullptr;
+    const ColumnKernel* kernel = nullptr; // MAP, FILTER: set when the function has a column kernel
+    int64_t remaining = 0;                // TAKE, SKIP
+    size_t position = 0;                  // ZIP, ENUMERATE
+    Value partner;                        // ZIP: a list, collected first if it was a sequence
+};
+
+// A matrix counts as the list of its rows
+bool isList(const Value& value) {
+    return std::holds_alternative<List>(value) || std::holds_alternative<std::shared_ptr<SpillList>>(value) ||
+           std::holds_alternative<std::shared_ptr<Matrix>>(value);
+}
+
+size_t listSize(const Value& list) {
+    if (auto* spilled = std::get_if<std::shared_ptr<SpillList>>(&list)) return (*spilled)->size();
+    if (auto* matrix = std::get_if<std::shared_ptr<Matrix>>(&list)) return (*matrix)->rows();
+    return std::get<List>(list).size();
+}
+
+Value listElement(const Value& list, size_t index) {
+    if (auto* spilled = std::get_if<std::shared_ptr<SpillList>>(&list)) return (*spilled)->get(index);
+    if (auto* matrix = std::get_if<std::shared_ptr<Matrix>>(&list)) {
+        const int64_t* row = (*matrix)->row(index);
+        return List(row, row + (*matrix)->cols());
+    }
+    return std::get<List>(list)[index];
+}
+
+// Elements [start, start + rows) as integers; false if any is not one
+bool loadBatch(const Value& list, size_t start, size_t rows, std::vector<int64_t>& values) {
+    if (std::holds_alternative<std::shared_ptr<Matrix>>(list)) return false; // Rows, not integers
+    values.resize(rows);
+    if (auto* spilled = std::get_if<std::shared_ptr<SpillList>>(&list)) {
+        for (size_t i = 0; i < rows; ++i) {
+            values[i] = (*spilled)->get(start + i);
+        }
+        return true;
+    }
+    const List& elements = std::get<List>(list);
+    for (size_t i = 0; i < rows; ++i) {
+        auto* number = std::get_if<int64_t>(&elements[start + i]);
+        if (!number) return false;
+        values[i] = *number;
+    }
+    return true;
+}
+
+} // namespace
+
+Value Interpreter::extendSequence(const BuiltinSignature& builtin, std::vector<Value>& args) {
+    // Lists are copied out of any region, since the chain may outlive it
+    auto own = [&](Value& value) -> Value {
+        if (regionDepth > 0) return Value(value);
+        return std::move(value);
+    };
+    auto chainOf = [&](Value& value) -> std::shared_ptr<const Sequence> {
+        if (auto* sequence = std::get_if<std::shared_ptr<const Sequence>>(&value)) return *sequence;
+        if (!isList(value)) throw std::runtime_error(builtin.name + " expects a list");
+        auto source = std::make_shared<Sequence>();
+        source->step = Step::SOURCE;
+        source->argument = own(value);
+        return source;
+    };
+
+    auto node = std::make_shared<Sequence>();
+    node->input = chainOf(args[0]);
+    if (builtin.name == "map" || builtin.name == "filter") {
+        node->step = builtin.name == "map" ? Step::MAP : Step::FILTER;
+        const FunctionDefStmt* func = nullptr;
+        if (auto* plain = std::get_if<std::shared_ptr<FunctionDefStmt>>(&args[1])) {
+            func = plain->get();
+        } else if (auto* closure = std::get_if<std::shared_ptr<Closure>>(&args[1])) {
+            func = (*closure)->function.get();
+        }
+        if (!func || func->parameters.size() != 1) {
+            throw std::runtime_error(builtin.name + " expects a function of one argument");
+        }
+        node->argument = args[1];
+    } else if (builtin.name == "take" || builtin.name == "skip") {
+        node->step = builtin.name == "take" ? Step::TAKE : Step::SKIP;
+        if (!std::holds_alternative<int64_t>(args[1]) || std::get<int64_t>(args[1]) < 0) {
+            throw std::runtime_error(builtin.name + " expects a count of at least 0");
+        }
+        node->argument = args[1];
+    } else if (builtin.name == "zip") {
+        node->step = Step::ZIP;
+        if (!isList(args[1]) && !std::holds_alternative<std::shared_ptr<const Sequence>>(args[1])) {
+            throw std::runtime_error("zip expects a list");
+        }
+        node->argument = own(args[1]);
+    } else {
+        node->step = Step::ENUMERATE;
+    }
+    return std::shared_ptr<const Sequence>(std::move(node));
+}
+
+const List& Interpreter::materializeSequence(const Sequence& sequence) {
+    if (!sequence.collected) {
+        List elements;
+        runSequence(sequence, [&](Value& element) {
+            if (regionDepth > 0) {
+                elements.push_back(Value(element)); // Copying drops the region allocator
+            } else {
+                elements.push_back(std::move(element));
+            }
+            return true;
+        });
+        sequence.collected = std::make_shared<const Value>(std::move(elements));
+    }
+    return std::get<List>(*sequence.collected);
+}
+
+List Interpreter::collectSequence(const Sequence& sequence) {
+    const List& elements = materializeSequence(sequence);
+    return List(elements.begin(), elements.end(), allocationResource());
+}
+
+// Leading map, filter, take and skip steps whose functions have column
+// kernels run fused over batches of integers: each kernel runs once per
+// batch and the batch shrinks as it goes. The first step that cannot (or a
+// batch holding anything but integers) hands elements on one at a time.
+// A batch where a kernel fails, or a function returns nothing, is run
+// again element by element, so it fails exactly where a plain run would and
+// not on an element a later take never needs.
+void Interpreter::runSequence(const Sequence& sequence, const std::function<bool(Value&)>& sink) {
+    std::vector<Stage> stages;
+    const Sequence* node = &sequence;
+    for (; node->step != Step::SOURCE && !node->collected; node = node->input.get()) {
+        Stage stage;
+        stage.step = node->step;
+        if (auto* plain = std::get_if<std::shared_ptr<FunctionDefStmt>>(&node->argument)) {
+            stage.function = *plain;
+        } else if (auto* closure = std::get_if<std::shared_ptr<Closure>>(&node->argument)) {
+            stage.closure = closure->get();
+            stage.function = (*closure)->function;
+        } else if (auto* count = std::get_if<int64_t>(&node->argument)) {
+            stage.remaining = *count;
+        } else if (node->step == Step::ZIP) {
+            auto* chain = std::get_if<std::shared_ptr<const Sequence>>(&node->argument);
+            stage.partner = chain ? Value(collectSequence(**chain)) : node->argument;
+        }
+        stages.push_back(std::move(stage));
+    }
+    std::reverse(stages.begin(), stages.end());
+    const Value& source = node->collected ? *node->collected : node->argument;
+
+    size_t fused = 0;
+    for (auto& stage : stages) {
+        if (stage.step == Step::TAKE && stage.remaining == 0) return;
+        if (stage.step == Step::ZIP && listSize(stage.partner) == 0) return;
+    }
+    for (; fused < stages.size(); ++fused) {
+        Stage& stage = stages[fused];
+        if (stage.step == Step::TAKE || stage.step == Step::SKIP) continue;
+        if (stage.step != Step::MAP && stage.step != Step::FILTER) break;
+        if (stage.closure && !stage.closure->captured.empty()) break;
+        auto cached = columnKernels.find(stage.function.get());
+        if (cached == columnKernels.end()) {
+            cached = columnKernels.emplace(stage.function.get(), ColumnKernel::compile(*stage.function)).first;
+        }
+        stage.kernel = cached->second.get();
+        if (!stage.kernel) break;
+    }
+
+    bool finished = false;
+    auto apply = [&](Stage& stage, Value argument) {
+        std::vector<Value> args;
+        args.push_back(std::move(argument));
+        tick();
+        return invokeFunction(stage.function, stage.closure, args, -1);
+    };
+    // Runs one element through the stages from `first` on; false once the chain is done
+    auto push = [&](size_t first, Value value) {
+        for (size_t k = first; k < stages.size(); ++k) {
+            Stage& stage = stages[k];
+            switch (stage.step) {
+            case Step::MAP:
+                value = apply(stage, std::move(value));
+                break;
+            case Step::FILTER: {
+                Value keep = apply(stage, value);
+                if (!std::holds_alternative<int64_t>(keep)) {
+                    throw std::runtime_error("Filter function must return an integer");
+                }
+                if (std::get<int64_t>(keep) == 0) return true;
+                break;
+            }
+            case Step::TAKE:
+                if (--stage.remaining == 0) finished = true; // This element still goes on
+                break;
+            case Step::SKIP:
+                if (stage.remaining > 0) {
+                    --stage.remaining;
+                    return true;
+                }
+                break;
+            case Step::ENUMERATE: {
+                List pair(allocationResource());
+                pair.emplace_back(static_cast<int64_t>(stage.position++));
+                pair.push_back(std::move(value));
+                value = std::move(pair);
+                break;
+            }
+            case Step::ZIP: {
+                List pair(allocationResource());
+                pair.push_back(std::move(value));
+                pair.push_back(listElement(stage.partner, stage.position++));
+                value = std::move(pair);
+                if (stage.position == listSize(stage.partner)) finished = true;
+                break;
+            }
+            case Step::SOURCE:
+                break;
+            }
+        }
+        if (!sink(value)) finished = true;
+        return !finished;
+    };
+
+    std::vector<int64_t> values, results;
+    std::vector<uint8_t> returned;
+    std::vector<int64_t> saved(fused);
+    // False when the batch has to be run again element by element
+    auto runFused = [&]() {
+        for (size_t k = 0; k < fused; ++k) saved[k] = stages[k].remaining;
+        bool ending = false; // A take ran out within this batch
+        bool fallBack = false;
+        try {
+            for (size_t k = 0; k < fused && !values.empty() && !fallBack; ++k) {
+                Stage& stage = stages[k];
+                size_t rows = values.size();
+                if (stage.kernel) {
+                    results.resize(rows);
+                    returned.resize(rows);
+                    stage.kernel->run({values.data()}, rows, results.data(), returned.data());
+                    if (std::find(returned.begin(), returned.end(), 0) != returned.end()) {
+                        fallBack = true;
+                    } else if (stage.step == Step::MAP) {
+                        values.swap(results);
+                    } else {
+                        size_t kept = 0;
+                        for (size_t i = 0; i < rows; ++i) {
+                            values[kept] = values[i];
+                            kept += results[i] != 0;
+                        }
+                        values.resize(kept);
+                    }
+                } else if (stage.step == Step::TAKE) {
+                    if (static_cast<int64_t>(rows) >= stage.remaining) {
+                        values.resize(static_cast<size_t>(stage.remaining));
+                        stage.remaining = 0;
+                        ending = true;
+                    } else {
+                        stage.remaining -= static_cast<int64_t>(rows);
+                    }
+                } else {
+                    size_t dropped = static_cast<size_t>(std::min<int64_t>(stage.remaining, static_cast<int64_t>(rows)));
+                    values.erase(values.begin(), values.begin() + dropped);
+                    stage.remaining -= static_cast<int64_t>(dropped);
+                }
+            }
+        } catch (const std::runtime_error&) {
+            fallBack = true;
+        }
+        if (fallBack) {
+            for (size_t k = 0; k < fused; ++k) stages[k].remaining = saved[k];
+            return false;
+        }
+        for (int64_t number : values) {
+            if (!push(fused, Value(number))) return true;
+        }
+        if (ending) finished = true;
+        return true;
+    };
+
+    size_t total = listSize(source);
+    for (size_t start = 0; start < total && !finished; start += ColumnKernel::BATCH_ROWS) {
+        size_t rows = std::min(ColumnKernel::BATCH_ROWS, total - start);
+        if (fused > 0 && loadBatch(source, start, rows, values)) {
+            tick();
+            if (runFused()) continue;
+        }
+        for (size_t i = start; i < start + rows; ++i) {
+            if (!push(0, listElement(source, i))) break;
+        }
+    }
+}
+
+} // namespace MyCustomLang
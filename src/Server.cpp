@@ -0,0 +1,474 @@
+#include "Server.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace MyCustomLang {
+
+namespace {
+
+void writeField(std::string& message, const std::string& tag, const std::string& data) {
+    message += tag + " " + std::to_string(data.size()) + "\n" + data;
+}
+
+bool readField(const std::string& message, size_t& pos, std::string& tag, std::string& data) {
+    size_t space = message.find(' ', pos);
+    size_t newline = message.find('\n', pos);
+    if (space == std::string::npos || newline == std::string::npos || space > newline) {
+        return false;
+    }
+    std::string length = message.substr(space + 1, newline - space - 1);
+    if (length.empty() || length.size() > 18 || length.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    size_t size = std::stoull(length);
+    if (size > message.size() - newline - 1) {
+        return false;
+    }
+    tag = message.substr(pos, space - pos);
+    data = message.substr(newline + 1, size);
+    pos = newline + 1 + size;
+    return true;
+}
+
+sockaddr_un socketAddress(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+// Whether a server is accepting connections on the socket at `address`.
+// A full backlog refuses with EAGAIN, but someone is still listening.
+bool socketInUse(const sockaddr_un& address) {
+    int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) {
+        return false;
+    }
+    bool listening = ::connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0 ||
+                     errno == EAGAIN;
+    ::close(probe);
+    return listening;
+}
+
+bool writeAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Reads until the peer closes its side. Fails with errno set to EMSGSIZE
+// past `limit` bytes, or to ETIMEDOUT when the peer has not closed within
+// `timeoutMs`; 0 disables either bound.
+bool readAll(int fd, std::string& data, size_t limit = 0, size_t timeoutMs = 0) {
+    char chunk[64 * 1024];
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true) {
+        if (timeoutMs > 0) {
+            auto left =
+                std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            pollfd ready{fd, POLLIN, 0};
+            int polled = left.count() > 0 ? ::poll(&ready, 1, static_cast<int>(left.count())) : 0;
+            if (polled < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (polled == 0) {
+                errno = ETIMEDOUT;
+                return false;
+            }
+        }
+        ssize_t n = ::read(fd, chunk, sizeof(chunk));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            // A peer that closed with some of our data unread resets the
+            // connection, but everything it sent before that has arrived
+            return errno == ECONNRESET && !data.empty();
+        }
+        if (n == 0) return true;
+        if (limit > 0 && static_cast<size_t>(n) > limit - std::min(limit, data.size())) {
+            errno = EMSGSIZE;
+            return false;
+        }
+        data.append(chunk, static_cast<size_t>(n));
+    }
+}
+
+// Reads and drops what the peer still sends, until it closes or
+// `timeoutMs` passes. Closing with input unread would reset the connection
+// and discard a reply the peer has not read yet.
+void discardInput(int fd, size_t timeoutMs) {
+    char chunk[64 * 1024];
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (true) {
+        auto left =
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        pollfd ready{fd, POLLIN, 0};
+        int polled = left.count() > 0 ? ::poll(&ready, 1, static_cast<int>(left.count())) : 0;
+        if (polled < 0 && errno == EINTR) continue;
+        if (polled <= 0) return;
+        ssize_t n = ::read(fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+    }
+}
+
+// accept() failures from running out of descriptors or memory, which
+// clear up once other connections or processes release theirs
+bool exhaustedAcceptError(int error) {
+    return error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM;
+}
+
+constexpr long MAX_ACCEPT_BACKOFF_MS = 1000;
+
+// A worker that fails sooner than this after its fork counts as failing
+// to start; after this many in a row the supervisor gives up
+constexpr std::chrono::milliseconds MIN_WORKER_LIFETIME{1000};
+constexpr size_t MAX_EARLY_EXITS = 10;
+
+// Current resident set size of this process, or 0 when unknown
+size_t residentKb() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident)) {
+        return 0;
+    }
+    return resident * static_cast<size_t>(::sysconf(_SC_PAGESIZE)) / 1024;
+}
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void requestStop(int) { stopRequested = 1; }
+
+} // namespace
+
+std::string encodeRequest(const ScriptRequest& request) {
+    std::string message;
+    if (request.shutdown) {
+        writeField(message, "shutdown", "");
+        return message;
+    }
+    if (!request.path.empty()) {
+        writeField(message, "path", request.path);
+    } else {
+        writeField(message, "source", request.source);
+    }
+    for (const auto& binding : request.bindings) {
+        writeField(message, "bind", binding);
+    }
+    return message;
+}
+
+bool decodeRequest(const std::string& message, ScriptRequest& request) {
+    size_t pos = 0;
+    std::string tag, data;
+    while (pos < message.size()) {
+        if (!readField(message, pos, tag, data)) return false;
+        if (tag == "path") request.path = data;
+        else if (tag == "source") request.source = data;
+        else if (tag == "bind") request.bindings.push_back(data);
+        else if (tag == "shutdown") request.shutdown = true;
+        else return false;
+    }
+    return true;
+}
+
+std::string encodeResult(const RunResult& result) {
+    std::string message;
+    writeField(message, "status", std::to_string(result.status));
+    writeField(message, "out", result.output);
+    writeField(message, "err", result.errors);
+    return message;
+}
+
+// A reply without a status, such as the empty one left by a worker that
+// died, is not a result
+bool decodeResult(const std::string& message, RunResult& result) {
+    size_t pos = 0;
+    std::string tag, data;
+    bool hasStatus = false;
+    while (pos < message.size()) {
+        if (!readField(message, pos, tag, data)) return false;
+        if (tag == "status") {
+            result.status = std::atoi(data.c_str());
+            hasStatus = true;
+        } else if (tag == "out") {
+            result.output = data;
+        } else if (tag == "err") {
+            result.errors = data;
+        } else {
+            return false;
+        }
+    }
+    return hasStatus;
+}
+
+RunResult ScriptServer::handle(const ScriptRequest& request) {
+    RunResult result;
+    Bindings bindings;
+    for (const auto& binding : request.bindings) {
+        if (!parseBinding(binding, bindings)) {
+            result.status = 1;
+            result.errors = "Expected name=value after --bind, with integers in the 64-bit range, got '" + binding + "'.\n";
+            return result;
+        }
+    }
+    std::string source = request.source;
+    if (!request.path.empty()) {
+        std::ifstream file(request.path);
+        if (!file.is_open()) {
+            result.status = 1;
+            result.errors = "Could not open file '" + request.path + "'.\n";
+            return result;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        source = buffer.str();
+    }
+    return engine.execute(source, bindings);
+}
+
+int ScriptServer::serve() {
+    std::signal(SIGPIPE, SIG_IGN); // A client that hangs up early must not kill the server
+
+    sockaddr_un address = socketAddress(socketPath);
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::cerr << "Could not create socket: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    if (socketInUse(address)) {
+        std::cerr << "A server is already listening on '" << socketPath << "'\n";
+        ::close(listener);
+        return 1;
+    }
+    // Left behind by a server that did not shut down cleanly. Anything else
+    // at the path is left alone, and bind reports it.
+    struct stat info {};
+    if (::lstat(socketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        ::unlink(socketPath.c_str());
+    }
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        ::listen(listener, 64) < 0) {
+        std::cerr << "Could not listen on '" << socketPath << "': " << std::strerror(errno) << "\n";
+        ::close(listener);
+        return 1;
+    }
+
+    int status = 0;
+    if (options.workers == 0) {
+        std::cout << "Serving on " << socketPath << std::endl;
+        acceptLoop(listener, false);
+    } else {
+        status = superviseWorkers(listener);
+    }
+
+    ::close(listener);
+    ::unlink(socketPath.c_str());
+    return status;
+}
+
+bool ScriptServer::acceptLoop(int listener, bool worker) {
+    size_t handled = 0;
+    long backoffMs = 0;
+    while (!worker || !stopRequested) {
+        int connection = ::accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue; // Reset before it was taken
+            if (!exhaustedAcceptError(errno)) {
+                std::cerr << "Accept failed: " << std::strerror(errno) << "\n";
+                acceptFailed = true;
+                return false;
+            }
+            // Retiring would only have the supervisor fork a worker that
+            // fails the same way; wait for the condition to pass instead
+            if (backoffMs == 0) {
+                std::cerr << "Accept failed: " << std::strerror(errno) << "; retrying\n";
+            }
+            backoffMs = std::min(backoffMs == 0 ? 10 : backoffMs * 2, MAX_ACCEPT_BACKOFF_MS);
+            timespec delay{backoffMs / 1000, (backoffMs % 1000) * 1000000L};
+            ::nanosleep(&delay, nullptr); // A stop signal cuts it short
+            continue;
+        }
+        backoffMs = 0;
+        std::string message;
+        ScriptRequest request;
+        RunResult result;
+        bool shutdown = false;
+        bool unread = false; // Refused before the client finished sending
+        try {
+            if (!readAll(connection, message, options.maxRequestKb * 1024, options.requestTimeoutMs)) {
+                unread = errno == EMSGSIZE;
+                result.status = 1;
+                result.errors = unread ? "Request larger than " + std::to_string(options.maxRequestKb) + " KiB\n"
+                                       : "Malformed request\n";
+            } else if (!decodeRequest(message, request)) {
+                result.status = 1;
+                result.errors = "Malformed request\n";
+            } else if (request.shutdown) {
+                shutdown = true;
+            } else {
+                result = handle(request);
+            }
+        } catch (const std::exception& e) { // One bad request must not take the server down
+            result = RunResult{1, "", std::string("Error: ") + e.what() + "\n"};
+        }
+        writeAll(connection, encodeResult(result));
+        if (unread) {
+            ::shutdown(connection, SHUT_WR);
+            discardInput(connection, options.requestTimeoutMs > 0 ? options.requestTimeoutMs : 1000);
+        }
+        ::close(connection);
+        if (shutdown) {
+            return true;
+        }
+
+        handled++;
+        if (worker && ((options.maxRequests > 0 && handled >= options.maxRequests) ||
+                       (options.maxResidentKb > 0 && residentKb() > options.maxResidentKb))) {
+            return false; // Retire; the supervisor forks a fresh copy of the warm state
+        }
+    }
+    return false;
+}
+
+int ScriptServer::superviseWorkers(int listener) {
+    for (const auto& path : options.preload) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            std::cerr << "Could not open file '" << path << "'.\n";
+            return 1;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        try {
+            engine.compile(buffer.str());
+        } catch (const std::runtime_error& e) {
+            std::cerr << "Could not preload '" << path << "': " << e.what() << "\n";
+            return 1;
+        }
+    }
+
+    // No SA_RESTART: a stop must interrupt the supervisor's waitpid
+    struct sigaction stop {};
+    stop.sa_handler = requestStop;
+    sigemptyset(&stop.sa_mask);
+    ::sigaction(SIGTERM, &stop, nullptr);
+    ::sigaction(SIGINT, &stop, nullptr);
+
+    std::unordered_map<pid_t, std::chrono::steady_clock::time_point> workers; // Each with its start time
+    auto spawn = [&]() {
+        pid_t pid = ::fork();
+        if (pid == 0) {
+            struct sigaction fallback {};
+            fallback.sa_handler = SIG_DFL;
+            ::sigaction(SIGINT, &fallback, nullptr);
+            if (acceptLoop(listener, true)) {
+                ::kill(::getppid(), SIGTERM); // Shutdown was requested through this worker
+            }
+            std::cout.flush();
+            ::_exit(acceptFailed ? 1 : 0);
+        }
+        if (pid > 0) {
+            workers.emplace(pid, std::chrono::steady_clock::now());
+        } else {
+            std::cerr << "Fork failed: " << std::strerror(errno) << "\n";
+        }
+        return pid > 0;
+    };
+
+    for (size_t i = 0; i < options.workers; ++i) {
+        if (!spawn()) break;
+    }
+    std::cout << "Serving on " << socketPath << " with " << workers.size() << " worker(s)" << std::endl;
+
+    // Workers that exit right after starting would otherwise be replaced in
+    // a tight fork loop; replacements wait longer after each such exit
+    long backoffMs = 0;
+    size_t earlyExits = 0;
+    int result = 0;
+    while (!stopRequested && !workers.empty()) {
+        int status = 0;
+        pid_t pid = ::waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        auto worker = workers.find(pid);
+        if (worker == workers.end()) continue;
+        bool failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0; // Retiring workers exit with 0
+        bool early = failed && std::chrono::steady_clock::now() - worker->second < MIN_WORKER_LIFETIME;
+        workers.erase(worker);
+        if (!early) {
+            earlyExits = 0;
+            backoffMs = 0;
+        } else if (++earlyExits >= MAX_EARLY_EXITS) {
+            std::cerr << "Workers keep exiting right after they start; stopping\n";
+            result = 1;
+            break;
+        } else {
+            backoffMs = std::min(backoffMs == 0 ? 10 : backoffMs * 2, MAX_ACCEPT_BACKOFF_MS);
+            timespec delay{backoffMs / 1000, (backoffMs % 1000) * 1000000L};
+            ::nanosleep(&delay, nullptr); // A stop signal cuts it short
+        }
+        if (!stopRequested) {
+            spawn();
+        }
+    }
+
+    for (const auto& [pid, started] : workers) {
+        ::kill(pid, SIGTERM);
+    }
+    for (const auto& [pid, started] : workers) {
+        ::waitpid(pid, nullptr, 0);
+    }
+    return result;
+}
+
+RunResult sendRequest(const std::string& socketPath, const ScriptRequest& request) {
+    sockaddr_un address = socketAddress(socketPath);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        std::string reason = std::strerror(errno);
+        if (fd >= 0) ::close(fd);
+        throw std::runtime_error("Could not connect to '" + socketPath + "': " + reason);
+    }
+    std::string reply;
+    // A server that refuses the request stops reading it, but still replies
+    if (writeAll(fd, encodeRequest(request))) {
+        ::shutdown(fd, SHUT_WR);
+    }
+    bool received = readAll(fd, reply);
+    ::close(fd);
+    RunResult result;
+    if (!received || !decodeResult(reply, result)) {
+        throw std::runtime_error("No valid reply from '" + socketPath + "'");
+    }
+    return result;
+}
+
+} // namespace MyCustomLang
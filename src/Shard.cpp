@@ -0,0 +1,318 @@
+#include "Shard.h"
+#include "ValueCodec.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <poll.h>
+#include <signal.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace MyCustomLang {
+
+namespace {
+
+// Longest a side sleeps before looking again without being woken; it bounds
+// how long the driver takes to notice a shard that died without a frame
+constexpr int WAKE_TIMEOUT_MS = 100;
+
+// Wakes whoever waits on an eventfd; extra wakeups add up in its counter
+void signalEvent(int fd) {
+    uint64_t one = 1;
+    while (::write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+// Resets an eventfd's counter, before looking at what it announces, so a
+// signal sent after the look is not lost
+void clearEvent(int fd) {
+    uint64_t count;
+    while (::read(fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+    }
+}
+
+// Single-producer, single-consumer byte ring in memory that stays shared
+// across fork(). head and tail count bytes ever written and read, so the
+// free space is capacity - (head - tail) without any wrap-around flag.
+// Each side sleeps on an eventfd the other side signals: the consumer on
+// `readyEvent` until bytes arrive, the producer on `spaceEvent` until the
+// ring has room.
+class SharedRing {
+public:
+    explicit SharedRing(size_t bytes) : capacity(bytes) {
+        mappingSize = sizeof(Header) + capacity;
+        mapping = ::mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("Could not map shard ring: " + std::string(std::strerror(errno)));
+        }
+        header = new (mapping) Header();
+        data = static_cast<char*>(mapping) + sizeof(Header);
+        readyEvent = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        spaceEvent = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (readyEvent < 0 || spaceEvent < 0) {
+            std::string reason = std::strerror(errno);
+            closeEvents();
+            ::munmap(mapping, mappingSize);
+            throw std::runtime_error("Could not create shard ring events: " + reason);
+        }
+    }
+
+    SharedRing(const SharedRing&) = delete;
+    SharedRing& operator=(const SharedRing&) = delete;
+
+    ~SharedRing() {
+        closeEvents();
+        ::munmap(mapping, mappingSize);
+    }
+
+    // Producer side; sleeps while the ring is full
+    void write(const char* bytes, size_t size) {
+        uint64_t head = header->head.load(std::memory_order_relaxed);
+        while (size > 0) {
+            size_t space = capacity - (head - header->tail.load(std::memory_order_acquire));
+            if (space == 0) {
+                pollfd waiting{spaceEvent, POLLIN, 0};
+                ::poll(&waiting, 1, WAKE_TIMEOUT_MS);
+                clearEvent(spaceEvent);
+                continue;
+            }
+            size_t offset = head % capacity;
+            size_t chunk = std::min({size, space, capacity - offset});
+            std::memcpy(data + offset, bytes, chunk);
+            head += chunk;
+            bytes += chunk;
+            size -= chunk;
+            header->head.store(head, std::memory_order_release);
+            signalEvent(readyEvent);
+        }
+    }
+
+    // Consumer side: the unread bytes that are contiguous in memory
+    std::pair<const char*, size_t> readable() const {
+        uint64_t tail = header->tail.load(std::memory_order_relaxed);
+        size_t available = header->head.load(std::memory_order_acquire) - tail;
+        size_t offset = tail % capacity;
+        return {data + offset, std::min(available, capacity - offset)};
+    }
+
+    void consume(size_t size) {
+        header->tail.fetch_add(size, std::memory_order_release);
+        signalEvent(spaceEvent);
+    }
+
+    // Consumer side: the descriptor that becomes readable when bytes arrive
+    int ready() const { return readyEvent; }
+    void clearReady() { clearEvent(readyEvent); }
+
+private:
+    struct Header {
+        std::atomic<uint64_t> head{0};
+        std::atomic<uint64_t> tail{0};
+    };
+
+    size_t capacity;
+    size_t mappingSize;
+    void* mapping;
+    Header* header;
+    char* data;
+    int readyEvent = -1;
+    int spaceEvent = -1;
+
+    void closeEvents() {
+        if (readyEvent >= 0) ::close(readyEvent);
+        if (spaceEvent >= 0) ::close(spaceEvent);
+    }
+};
+
+// Frames on a ring: a kind byte, a payload length, then the payload
+enum class FrameKind : uint8_t { EMITTED, FINISHED };
+constexpr size_t FRAME_HEADER = sizeof(uint8_t) + sizeof(uint64_t);
+
+void sendFrame(SharedRing& ring, FrameKind kind, const std::string& payload) {
+    char frameHeader[FRAME_HEADER];
+    uint64_t size = payload.size();
+    frameHeader[0] = static_cast<char>(kind);
+    std::memcpy(frameHeader + 1, &size, sizeof(size));
+    ring.write(frameHeader, FRAME_HEADER);
+    ring.write(payload.data(), payload.size());
+}
+
+// Driver-side state of one shard
+struct ShardStream {
+    pid_t pid = -1;
+    std::string staging; // Frames split by the ring's wrap-around, reassembled
+    bool finished = false;
+    List emitted;
+    RunResult result;
+};
+
+void deliverFrame(ShardStream& stream, FrameKind kind, const char* payload, size_t size) {
+    const char* end = payload + size;
+    Value value = decodeValue(payload, end);
+    if (payload != end || (kind != FrameKind::EMITTED && kind != FrameKind::FINISHED)) {
+        throw std::runtime_error("Malformed shard frame");
+    }
+    if (kind == FrameKind::EMITTED) {
+        stream.emitted.push_back(std::move(value));
+        return;
+    }
+    const auto* fields = std::get_if<List>(&value);
+    if (!fields || fields->size() != 3 || !std::holds_alternative<int64_t>((*fields)[0]) ||
+        !std::holds_alternative<std::string>((*fields)[1]) || !std::holds_alternative<std::string>((*fields)[2])) {
+        throw std::runtime_error("Malformed shard frame");
+    }
+    stream.result.status = static_cast<int>(std::get<int64_t>((*fields)[0]));
+    stream.result.output = std::get<std::string>((*fields)[1]);
+    stream.result.errors = std::get<std::string>((*fields)[2]);
+    stream.finished = true;
+}
+
+// Reads every complete frame available on the ring. Frames lying whole in
+// the ring are decoded where they are; only frames that wrap around the
+// end of the ring are copied out first. Returns whether anything was read.
+bool drain(SharedRing& ring, ShardStream& stream) {
+    bool progress = false;
+    while (true) {
+        auto [bytes, size] = ring.readable();
+        if (size == 0) break;
+        progress = true;
+        if (stream.staging.empty() && size >= FRAME_HEADER) {
+            uint64_t payloadSize;
+            std::memcpy(&payloadSize, bytes + 1, sizeof(payloadSize));
+            if (size - FRAME_HEADER >= payloadSize) {
+                deliverFrame(stream, static_cast<FrameKind>(bytes[0]), bytes + FRAME_HEADER, payloadSize);
+                ring.consume(FRAME_HEADER + payloadSize);
+                continue;
+            }
+        }
+        stream.staging.append(bytes, size);
+        ring.consume(size);
+
+        size_t pos = 0;
+        while (stream.staging.size() - pos >= FRAME_HEADER) {
+            uint64_t payloadSize;
+            std::memcpy(&payloadSize, stream.staging.data() + pos + 1, sizeof(payloadSize));
+            if (stream.staging.size() - pos - FRAME_HEADER < payloadSize) break;
+            deliverFrame(stream, static_cast<FrameKind>(stream.staging[pos]),
+                         stream.staging.data() + pos + FRAME_HEADER, payloadSize);
+            pos += FRAME_HEADER + payloadSize;
+        }
+        stream.staging.erase(0, pos);
+    }
+    return progress;
+}
+
+// Kills and reaps every shard still running when the driver leaves early,
+// e.g. on a malformed frame, so no child outlives runSharded
+struct ShardReaper {
+    std::vector<ShardStream>& streams;
+
+    ~ShardReaper() {
+        for (auto& stream : streams) {
+            if (stream.pid <= 0) continue;
+            ::kill(stream.pid, SIGKILL);
+            while (::waitpid(stream.pid, nullptr, 0) < 0 && errno == EINTR) {
+            }
+            stream.pid = -1;
+        }
+    }
+};
+
+} // namespace
+
+ShardReport runSharded(Engine& engine, const std::string& source, size_t shards, size_t ringBytes) {
+    Bindings typeOnly{{"shard", int64_t(0)}, {"shards", int64_t(shards)}};
+    auto script = engine.compile(source, typeOnly); // Once, before forking, so every shard inherits it
+
+    std::vector<std::unique_ptr<SharedRing>> rings;
+    for (size_t i = 0; i < shards; ++i) {
+        rings.push_back(std::make_unique<SharedRing>(ringBytes));
+    }
+    std::vector<ShardStream> streams(shards);
+    ShardReaper reaper{streams};
+
+    std::cout.flush();
+    for (size_t i = 0; i < shards; ++i) {
+        pid_t pid = ::fork();
+        if (pid == 0) {
+            SharedRing& ring = *rings[i];
+            std::string payload;
+            Bindings globals{{"shard", static_cast<int64_t>(i)}, {"shards", static_cast<int64_t>(shards)}};
+            RunResult result = engine.execute(*script, globals, [&](Interpreter& interpreter) {
+                interpreter.setEmitHandler([&](const Value& value) {
+                    payload.clear();
+                    encodeValue(value, payload);
+                    sendFrame(ring, FrameKind::EMITTED, payload);
+                });
+            });
+            payload.clear();
+            List fields;
+            fields.emplace_back(static_cast<int64_t>(result.status));
+            fields.emplace_back(result.output);
+            fields.emplace_back(result.errors);
+            encodeValue(fields, payload);
+            sendFrame(ring, FrameKind::FINISHED, payload);
+            ::_exit(0);
+        }
+        if (pid < 0) {
+            streams[i].finished = true;
+            streams[i].result = RunResult{1, "", "Could not fork shard " + std::to_string(i) + "\n"};
+        }
+        streams[i].pid = pid;
+    }
+
+    size_t remaining = shards;
+    for (const auto& stream : streams) {
+        if (stream.finished) remaining--;
+    }
+    std::vector<pollfd> waiting;
+    while (remaining > 0) {
+        bool progress = false;
+        for (size_t i = 0; i < shards; ++i) {
+            ShardStream& stream = streams[i];
+            if (stream.finished) continue;
+            rings[i]->clearReady();
+            progress = drain(*rings[i], stream) || progress;
+            if (!stream.finished && ::waitpid(stream.pid, nullptr, WNOHANG) == stream.pid) {
+                stream.pid = -1;
+                drain(*rings[i], stream); // Whatever it sent before exiting
+                if (!stream.finished) {
+                    stream.finished = true;
+                    stream.result = RunResult{1, "", "Shard " + std::to_string(i) + " exited before finishing\n"};
+                }
+            }
+            if (stream.finished) remaining--;
+        }
+        if (!progress && remaining > 0) {
+            // Sleep until a shard writes; the timeout catches shards that
+            // die without writing anything
+            waiting.clear();
+            for (size_t i = 0; i < shards; ++i) {
+                if (!streams[i].finished) waiting.push_back(pollfd{rings[i]->ready(), POLLIN, 0});
+            }
+            ::poll(waiting.data(), waiting.size(), WAKE_TIMEOUT_MS);
+        }
+    }
+    for (auto& stream : streams) {
+        if (stream.pid <= 0) continue;
+        while (::waitpid(stream.pid, nullptr, 0) < 0 && errno == EINTR) {
+        }
+        stream.pid = -1;
+    }
+
+    ShardReport report;
+    for (auto& stream : streams) {
+        report.shards.push_back(std::move(stream.result));
+        for (auto& value : stream.emitted) {
+            report.results.push_back(std::move(value));
+        }
+    }
+    return report;
+}
+
+} // namespace MyCustomLang
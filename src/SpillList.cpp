@@ -0,0 +1,100 @@
+#include "SpillList.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+namespace MyCustomLang {
+
+namespace {
+
+constexpr size_t CHUNK_BYTES = SpillList::CHUNK_INTEGERS * sizeof(int64_t);
+
+[[noreturn]] void failSpill(const std::string& what) {
+    throw std::runtime_error("Spill file " + what + ": " + std::strerror(errno));
+}
+
+} // namespace
+
+SpillList::SpillList(const SpillOptions& opts) : options(opts) {
+    std::string directory = options.directory;
+    if (directory.empty()) {
+        const char* tmp = std::getenv("TMPDIR");
+        directory = tmp && *tmp ? tmp : "/tmp";
+    }
+    std::string path = directory + "/nova-spill-XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    fd = ::mkstemp(name.data());
+    if (fd < 0) {
+        failSpill("could not be created in " + directory);
+    }
+    ::unlink(name.data());
+    options.residentChunks = std::max<size_t>(1, options.residentChunks);
+}
+
+SpillList::~SpillList() {
+    for (const auto& mapping : resident) {
+        ::munmap(mapping.data, CHUNK_BYTES);
+    }
+    ::close(fd);
+}
+
+void SpillList::append(int64_t value) {
+    if (count == capacity) {
+        // Grown a chunk at a time; the new space is sparse until written
+        if (::ftruncate(fd, static_cast<off_t>((capacity + CHUNK_INTEGERS) * sizeof(int64_t))) != 0) {
+            failSpill("could not grow");
+        }
+        capacity += CHUNK_INTEGERS;
+    }
+    set(count++, value);
+}
+
+int64_t* SpillList::map(size_t number) {
+    auto found = byChunk.find(number);
+    if (found != byChunk.end()) {
+        resident.splice(resident.begin(), resident, found->second);
+    } else {
+        if (resident.size() >= options.residentChunks) {
+            // Dirty pages of the evicted chunk are written back by the kernel
+            ::munmap(resident.back().data, CHUNK_BYTES);
+            byChunk.erase(resident.back().chunk);
+            resident.pop_back();
+        }
+        void* data = ::mmap(nullptr, CHUNK_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                            static_cast<off_t>(number * CHUNK_BYTES));
+        if (data == MAP_FAILED) {
+            failSpill("could not be mapped");
+        }
+        ::madvise(data, CHUNK_BYTES, MADV_SEQUENTIAL);
+        resident.push_front(Mapping{number, static_cast<int64_t*>(data)});
+        byChunk[number] = resident.begin();
+    }
+    lastChunk = number;
+    lastData = resident.front().data;
+    return lastData;
+}
+
+std::shared_ptr<SpillList> SpillList::clone() {
+    auto copy = std::make_shared<SpillList>(options);
+    for (size_t i = 0; i < count; i += CHUNK_INTEGERS) {
+        size_t length = std::min(CHUNK_INTEGERS, count - i);
+        const int64_t* source = chunk(i);
+        if (copy->count == copy->capacity) {
+            if (::ftruncate(copy->fd, static_cast<off_t>((copy->capacity + CHUNK_INTEGERS) * sizeof(int64_t))) != 0) {
+                failSpill("could not grow");
+            }
+            copy->capacity += CHUNK_INTEGERS;
+        }
+        std::memcpy(copy->chunk(i), source, length * sizeof(int64_t));
+        copy->count += length;
+    }
+    return copy;
+}
+
+} // namespace MyCustomLang
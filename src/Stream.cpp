@@ -0,0 +1,426 @@
+#include "Stream.h"
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace MyCustomLang {
+
+namespace {
+
+// One JSON document per call; objects become dictionaries, arrays lists,
+// true and false 1 and 0, null nothing. Numbers that are not integers are
+// kept as their text. Objects and arrays nested more than MAX_DEPTH deep
+// are rejected, since parsing them (and later printing or freeing them)
+// recurses once per level.
+class JsonReader {
+public:
+    explicit JsonReader(const std::string& text) : text(text) {}
+
+    Value document() {
+        Value value = parseValue();
+        skipSpace();
+        if (pos != text.size()) fail();
+        return value;
+    }
+
+private:
+    static constexpr size_t MAX_DEPTH = 512;
+
+    const std::string& text;
+    size_t pos = 0;
+    size_t depth = 0; // Objects and arrays open around pos
+
+    [[noreturn]] void fail() const {
+        throw std::runtime_error("Malformed JSON at column " + std::to_string(pos + 1));
+    }
+
+    void skipSpace() {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r' || text[pos] == '\n')) {
+            pos++;
+        }
+    }
+
+    void expect(char c) {
+        skipSpace();
+        if (pos >= text.size() || text[pos] != c) fail();
+        pos++;
+    }
+
+    // Skips `c` if it comes next
+    bool next(char c) {
+        skipSpace();
+        if (pos >= text.size() || text[pos] != c) return false;
+        pos++;
+        return true;
+    }
+
+    bool consume(const char* word) {
+        size_t length = std::char_traits<char>::length(word);
+        if (text.compare(pos, length, word) != 0) return false;
+        pos += length;
+        return true;
+    }
+
+    void enterNested() {
+        if (++depth > MAX_DEPTH) {
+            throw std::runtime_error("Malformed JSON at column " + std::to_string(pos + 1) + ": nested more than " +
+                                     std::to_string(MAX_DEPTH) + " deep");
+        }
+    }
+
+    Value parseValue() {
+        skipSpace();
+        if (pos >= text.size()) fail();
+        char c = text[pos];
+        if (c == '{') {
+            enterNested();
+            pos++;
+            Dict dict;
+            skipSpace();
+            if (pos < text.size() && text[pos] == '}') {
+                pos++;
+                depth--;
+                return dict;
+            }
+            do {
+                skipSpace();
+                std::string key = parseString();
+                expect(':');
+                dict[key] = parseValue();
+            } while (next(','));
+            expect('}');
+            depth--;
+            return dict;
+        }
+        if (c == '[') {
+            enterNested();
+            pos++;
+            List list;
+            skipSpace();
+            if (pos < text.size() && text[pos] == ']') {
+                pos++;
+                depth--;
+                return list;
+            }
+            do {
+                list.push_back(parseValue());
+            } while (next(','));
+            expect(']');
+            depth--;
+            return list;
+        }
+        if (c == '"') return parseString();
+        if (consume("true")) return int64_t(1);
+        if (consume("false")) return int64_t(0);
+        if (consume("null")) return Value{};
+        return parseNumber();
+    }
+
+    std::string parseString() {
+        if (pos >= text.size() || text[pos] != '"') fail();
+        pos++;
+        std::string result;
+        while (pos < text.size() && text[pos] != '"') {
+            char c = text[pos++];
+            if (c != '\\') {
+                result += c;
+                continue;
+            }
+            if (pos >= text.size()) fail();
+            char escape = text[pos++];
+            switch (escape) {
+                case 'n': result += '\n'; break;
+                case 't': result += '\t'; break;
+                case 'r': result += '\r'; break;
+                case 'b': result += '\b'; break;
+                case 'f': result += '\f'; break;
+                case 'u': {
+                    unsigned code = 0;
+                    for (int digit = 0; digit < 4; ++digit, ++pos) {
+                        if (pos >= text.size() || !std::isxdigit(static_cast<unsigned char>(text[pos]))) fail();
+                        char h = text[pos];
+                        code = code * 16 + (std::isdigit(static_cast<unsigned char>(h)) ? h - '0' : (h | 0x20) - 'a' + 10);
+                    }
+                    // UTF-8; surrogate pairs are left as two separate code points
+                    if (code < 0x80) {
+                        result += static_cast<char>(code);
+                    } else if (code < 0x800) {
+                        result += static_cast<char>(0xC0 | (code >> 6));
+                        result += static_cast<char>(0x80 | (code & 0x3F));
+                    } else {
+                        result += static_cast<char>(0xE0 | (code >> 12));
+                        result += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                        result += static_cast<char>(0x80 | (code & 0x3F));
+                    }
+                    break;
+                }
+                default: result += escape; break; // \" \\ \/
+            }
+        }
+        if (pos >= text.size()) fail();
+        pos++;
+        return result;
+    }
+
+    Value parseNumber() {
+        size_t start = pos;
+        if (pos < text.size() && text[pos] == '-') pos++;
+        size_t digits = pos;
+        while (pos < text.size() && std::isdigit(static_cast<unsigned char>(text[pos]))) pos++;
+        if (pos == digits) fail();
+        bool integer = true;
+        while (pos < text.size() && (std::isdigit(static_cast<unsigned char>(text[pos])) || text[pos] == '.' ||
+                                     text[pos] == 'e' || text[pos] == 'E' || text[pos] == '+' || text[pos] == '-')) {
+            integer = false;
+            pos++;
+        }
+        std::string number = text.substr(start, pos - start);
+        if (integer) {
+            try {
+                return static_cast<int64_t>(std::stoll(number));
+            } catch (const std::out_of_range&) {
+            }
+        }
+        return number;
+    }
+};
+
+List parseCsv(const std::string& text) {
+    List fields;
+    std::string field;
+    bool quoted = false;
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (quoted) {
+            if (c == '"' && i + 1 < text.size() && text[i + 1] == '"') {
+                field += '"';
+                i++;
+            } else if (c == '"') {
+                quoted = false;
+            } else {
+                field += c;
+            }
+        } else if (c == '"') {
+            quoted = true;
+        } else if (c == ',') {
+            fields.emplace_back(std::move(field));
+            field.clear();
+        } else {
+            field += c;
+        }
+    }
+    fields.emplace_back(std::move(field));
+    return fields;
+}
+
+// Reads the next record's text. A CSV record continues onto the next line
+// while a quoted field is open.
+bool readRecord(std::istream& in, RecordFormat format, std::string& text) {
+    if (!std::getline(in, text)) return false;
+    if (!text.empty() && text.back() == '\r') text.pop_back();
+    if (format == RecordFormat::CSV) {
+        size_t quotes = std::count(text.begin(), text.end(), '"');
+        std::string more;
+        while (quotes % 2 == 1 && std::getline(in, more)) {
+            if (!more.empty() && more.back() == '\r') more.pop_back();
+            quotes += std::count(more.begin(), more.end(), '"');
+            text += '\n';
+            text += more;
+        }
+    }
+    return true;
+}
+
+// A run of consecutive records and what running them produced
+struct Chunk {
+    size_t first = 1; // Record number of records[0]
+    std::vector<std::string> records;
+    std::string output;
+    std::string errors;
+    size_t failed = 0;
+    bool done = false;
+};
+
+size_t readChunk(std::istream& in, RecordFormat format, size_t limit, Chunk& chunk) {
+    chunk.records.resize(limit);
+    size_t count = 0;
+    while (count < limit && readRecord(in, format, chunk.records[count])) {
+        count++;
+    }
+    chunk.records.resize(count);
+    return count;
+}
+
+// Runs records on one thread. The interpreter is kept from record to
+// record; the program redefines its globals every time it runs, so nothing
+// carries over. One that stopped on an error is replaced.
+class RecordRunner {
+public:
+    RecordRunner(const CompiledScript& script, RecordFormat format) : script(script), format(format) {}
+
+    void run(Chunk& chunk) {
+        buffer.str("");
+        for (size_t i = 0; i < chunk.records.size(); ++i) {
+            std::string number = std::to_string(chunk.first + i);
+            try {
+                if (!interpreter) {
+                    interpreter = std::make_unique<Interpreter>(script.symbols);
+                    interpreter->setOutput(buffer);
+                }
+                interpreter->define("record", parseRecord(chunk.records[i], format));
+                interpreter->define("record_number", static_cast<int64_t>(chunk.first + i));
+                interpreter->interpret(script.program);
+            } catch (const RuntimeError& e) {
+                chunk.errors += "Record " + number + ": Runtime error: " + e.what() + "\n" +
+                                interpreter->formatStackTrace(e);
+                chunk.failed++;
+                interpreter.reset();
+            } catch (const std::exception& e) {
+                // Anything else, e.g. bad_alloc, fails only this record; it
+                // must not escape the worker thread
+                chunk.errors += "Record " + number + ": " + e.what() + "\n";
+                chunk.failed++;
+                interpreter.reset();
+            }
+        }
+        chunk.output = buffer.str();
+    }
+
+private:
+    const CompiledScript& script;
+    RecordFormat format;
+    std::unique_ptr<Interpreter> interpreter;
+    std::ostringstream buffer;
+};
+
+void writeChunk(const Chunk& chunk, std::ostream& out, std::ostream& errors, StreamSummary& summary) {
+    out.write(chunk.output.data(), chunk.output.size());
+    errors.write(chunk.errors.data(), chunk.errors.size());
+    summary.records += chunk.records.size();
+    summary.failed += chunk.failed;
+}
+
+} // namespace
+
+Bindings streamGlobals(RecordFormat format) {
+    Bindings globals{{"record_number", int64_t(0)}};
+    switch (format) {
+        case RecordFormat::LINES: globals["record"] = std::string(); break;
+        case RecordFormat::CSV: globals["record"] = List(); break;
+        case RecordFormat::JSONL: globals["record"] = Dict(); break;
+    }
+    return globals;
+}
+
+Value parseRecord(const std::string& text, RecordFormat format) {
+    switch (format) {
+        case RecordFormat::CSV:
+            return parseCsv(text);
+        case RecordFormat::JSONL: {
+            Value value = JsonReader(text).document();
+            if (!std::holds_alternative<Dict>(value)) {
+                throw std::runtime_error("Expected a JSON object");
+            }
+            return value;
+        }
+        default:
+            return text;
+    }
+}
+
+StreamSummary runStream(const CompiledScript& script, std::istream& in, std::ostream& out, std::ostream& errors,
+                        const StreamOptions& options) {
+    StreamSummary summary;
+    size_t chunkRecords = std::max<size_t>(1, options.chunkRecords);
+    size_t next = 1;
+
+    if (options.jobs <= 1) {
+        RecordRunner runner(script, options.format);
+        Chunk chunk;
+        while (readChunk(in, options.format, chunkRecords, chunk) > 0) {
+            chunk.first = next;
+            next += chunk.records.size();
+            chunk.errors.clear();
+            chunk.failed = 0;
+            runner.run(chunk);
+            writeChunk(chunk, out, errors, summary);
+        }
+        return summary;
+    }
+
+    // The calling thread reads chunks and writes them out in order; the
+    // workers run them. At most a few chunks per worker are in flight, so
+    // memory stays bounded however long the input is.
+    std::mutex mutex;
+    std::condition_variable work, progress;
+    std::deque<std::shared_ptr<Chunk>> inFlight; // In input order
+    std::deque<Chunk*> waiting;
+    bool closing = false;
+    size_t maxInFlight = options.jobs * 4;
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < options.jobs; ++i) {
+        workers.emplace_back([&] {
+            RecordRunner runner(script, options.format);
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                work.wait(lock, [&] { return closing || !waiting.empty(); });
+                if (waiting.empty()) return;
+                Chunk* chunk = waiting.front();
+                waiting.pop_front();
+                lock.unlock();
+                runner.run(*chunk);
+                lock.lock();
+                chunk->done = true;
+                progress.notify_one();
+            }
+        });
+    }
+
+    // Writes out finished chunks from the front; with `all`, waits for every
+    // chunk, otherwise only until there is room for another
+    auto flush = [&](bool all) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!inFlight.empty()) {
+            if (!inFlight.front()->done) {
+                if (!all && inFlight.size() < maxInFlight) return;
+                progress.wait(lock);
+                continue;
+            }
+            auto chunk = std::move(inFlight.front());
+            inFlight.pop_front();
+            lock.unlock();
+            writeChunk(*chunk, out, errors, summary);
+            lock.lock();
+        }
+    };
+
+    while (true) {
+        auto chunk = std::make_shared<Chunk>();
+        if (readChunk(in, options.format, chunkRecords, *chunk) == 0) break;
+        chunk->first = next;
+        next += chunk->records.size();
+        flush(false);
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight.push_back(chunk);
+        waiting.push_back(chunk.get());
+        work.notify_one();
+    }
+    flush(true);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    work.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return summary;
+}
+
+} // namespace MyCustomLang
@@ -24,6 +24,19 @@ bool SymbolTable::symbolExists(const std::string& name) const {
     return false;
 }
 
+bool SymbolTable::declaredByScript(const std::string& name) const {
+    for (size_t i = scriptScope; i <= currentScope; ++i) {
+        if (scopes[i].find(name) != scopes[i].end()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SymbolTable::isBuiltin(const std::string& name) const {
+    return scriptScope > 0 && !declaredByScript(name) && scopes[0].find(name) != scopes[0].end();
+}
+
 bool SymbolTable::symbolExistsInCurrentScope(const std::string& name) const {
     return scopes[currentScope].find(name) != scopes[currentScope].end();
 }
@@ -41,7 +54,9 @@ void SymbolTable::updateSymbolType(const std::string& name, Type type) {
 }
 
 void SymbolTable::updateSymbolReturnType(const std::string& name, Type returnType) {
-    for (size_t i = 0; i < scopes.size(); i++) {
+    // A script function named like a builtin is the one being updated
+    size_t first = declaredByScript(name) ? scriptScope : 0;
+    for (size_t i = first; i < scopes.size(); i++) {
         auto sym = scopes[i].find(name);
         if (sym != scopes[i].end()) {
             sym->second.returnType = returnType;
@@ -51,4 +66,44 @@ void SymbolTable::updateSymbolReturnType(const std::string& name, Type returnTyp
     throw std::runtime_error("Symbol '" + name + "' not found for return type update");
 }
 
+void SymbolTable::updateSymbolModel(const std::string& name, const std::string& modelName) {
+    for (size_t i = currentScope; ; --i) {
+        auto sym = scopes[i].find(name);
+        if (sym != scopes[i].end()) {
+            sym->second.modelName = modelName;
+            return;
+        }
+        if (i == 0) break;
+    }
+    throw std::runtime_error("Symbol '" + name + "' not found for model update");
+}
+
+void SymbolTable::markConstant(const std::string& name) {
+    for (size_t i = currentScope; ; --i) {
+        auto sym = scopes[i].find(name);
+        if (sym != scopes[i].end()) {
+            sym->second.isConst = true;
+            return;
+        }
+        if (i == 0) break;
+    }
+    throw std::runtime_error("Symbol '" + name + "' not found for constant update");
+}
+
+void SymbolTable::updateModelFieldType(const std::string& model, size_t slot, Type type) {
+    for (size_t i = currentScope; ; --i) {
+        auto sym = scopes[i].find(model);
+        if (sym != scopes[i].end()) {
+            auto& fieldTypes = sym->second.fieldTypes;
+            if (fieldTypes.size() < sym->second.parameters.size()) {
+                fieldTypes.resize(sym->second.parameters.size(), Type::NONE);
+            }
+            fieldTypes.at(slot) = type;
+            return;
+        }
+        if (i == 0) break;
+    }
+    throw std::runtime_error("Model '" + model + "' not found for field type update");
+}
+
 } // namespace MyCustomLang
\ No newline at end of file
@@ -0,0 +1,306 @@
+#include "ValueCodec.h"
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+
+namespace MyCustomLang {
+
+namespace {
+
+enum class Tag : uint8_t { NOTHING, INTEGER, STRING, PACKED_INTEGERS, LIST, DICT, FUNCTION, CLOSURE, MODEL, RECORD, SEQUENCE, MATRIX, SPILLED };
+
+// Encoding appends to a string, or writes straight to a stream so that
+// large state never has to fit in memory twice
+void append(std::string& out, const char* data, size_t size) {
+    out.append(data, size);
+}
+
+void append(std::ostream& out, const char* data, size_t size) {
+    out.write(data, static_cast<std::streamsize>(size));
+}
+
+void reserve(std::string& out, size_t more) {
+    out.reserve(out.size() + more);
+}
+
+void reserve(std::ostream&, size_t) {}
+
+template <typename T, typename Out>
+void put(Out& out, T value) {
+    append(out, reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T take(const char*& data, const char* end) {
+    if (static_cast<size_t>(end - data) < sizeof(T)) {
+        throw std::runtime_error("Truncated value");
+    }
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return value;
+}
+
+template <typename Out>
+void putString(Out& out, const std::string& text) {
+    put<uint64_t>(out, text.size());
+    append(out, text.data(), text.size());
+}
+
+std::string takeString(const char*& data, const char* end) {
+    uint64_t size = take<uint64_t>(data, end);
+    if (static_cast<uint64_t>(end - data) < size) {
+        throw std::runtime_error("Truncated value");
+    }
+    std::string text(data, size);
+    data += size;
+    return text;
+}
+
+const ProgramReferences& requireReferences(const ProgramReferences* references) {
+    if (!references) {
+        throw std::runtime_error("Malformed value");
+    }
+    return *references;
+}
+
+template <typename Out>
+void encodeTo(const Value& value, Out& out, const ProgramReferences* references) {
+    if (std::holds_alternative<std::monostate>(value)) {
+        put(out, Tag::NOTHING);
+    } else if (auto* i = std::get_if<int64_t>(&value)) {
+        put(out, Tag::INTEGER);
+        put(out, *i);
+    } else if (auto* text = std::get_if<std::string>(&value)) {
+        put(out, Tag::STRING);
+        putString(out, *text);
+    } else if (auto* spilled = std::get_if<std::shared_ptr<SpillList>>(&value)) {
+        // Spilled again where the decoder can make spill lists; another
+        // process gets an ordinary list
+        SpillList& list = **spilled;
+        bool respill = references && references->spillList;
+        put(out, respill ? Tag::SPILLED : Tag::PACKED_INTEGERS);
+        put<uint64_t>(out, list.size());
+        reserve(out, list.size() * sizeof(int64_t));
+        for (size_t i = 0; i < list.size();) {
+            size_t length = 0;
+            const int64_t* run = list.run(i, length);
+            append(out, reinterpret_cast<const char*>(run), length * sizeof(int64_t));
+            i += length;
+        }
+    } else if (auto* list = std::get_if<List>(&value)) {
+        bool packed = true;
+        for (const auto& element : *list) {
+            if (!std::holds_alternative<int64_t>(element)) {
+                packed = false;
+                break;
+            }
+        }
+        put(out, packed ? Tag::PACKED_INTEGERS : Tag::LIST);
+        put<uint64_t>(out, list->size());
+        if (packed) {
+            reserve(out, list->size() * sizeof(int64_t));
+            for (const auto& element : *list) {
+                put(out, std::get<int64_t>(element));
+            }
+        } else {
+            for (const auto& element : *list) {
+                encodeTo(element, out, references);
+            }
+        }
+    } else if (auto* matrix = std::get_if<std::shared_ptr<Matrix>>(&value)) {
+        const Matrix& m = **matrix;
+        put(out, Tag::MATRIX);
+        put<uint64_t>(out, m.rows());
+        put<uint64_t>(out, m.cols());
+        if (m.rows() > 0) {
+            append(out, reinterpret_cast<const char*>(m.row(0)), m.rows() * m.cols() * sizeof(int64_t));
+        }
+    } else if (auto* dict = std::get_if<Dict>(&value)) {
+        put(out, Tag::DICT);
+        put<uint64_t>(out, dict->size());
+        for (const auto& [key, element] : *dict) {
+            putString(out, key);
+            encodeTo(element, out, references);
+        }
+    } else if (auto* persistent = std::get_if<PersistentDict>(&value)) {
+        put(out, Tag::DICT); // Decoded as an ordinary dictionary
+        put<uint64_t>(out, persistent->size());
+        persistent->forEach([&](const std::string& key, const Value& element) {
+            putString(out, key);
+            encodeTo(element, out, references);
+        });
+    } else if (std::holds_alternative<std::shared_ptr<const Sequence>>(value) && !references) {
+        throw std::runtime_error("Cannot pass a lazy sequence to another process; collect it first");
+    } else if (!references) {
+        throw std::runtime_error("Cannot pass a " + typeToString(valueType(value)) + " value to another process");
+    } else if (auto* function = std::get_if<std::shared_ptr<FunctionDefStmt>>(&value)) {
+        put(out, Tag::FUNCTION);
+        put<uint64_t>(out, references->functionNumber(**function));
+    } else if (auto* closure = std::get_if<std::shared_ptr<Closure>>(&value)) {
+        put(out, Tag::CLOSURE);
+        put<uint64_t>(out, references->functionNumber(*(*closure)->function));
+        put<uint64_t>(out, (*closure)->captured.size());
+        for (const auto& captured : (*closure)->captured) {
+            encodeTo(captured, out, references);
+        }
+    } else if (auto* model = std::get_if<std::shared_ptr<ModelDefStmt>>(&value)) {
+        put(out, Tag::MODEL);
+        putString(out, (*model)->name.lexeme);
+    } else if (auto* record = std::get_if<Record>(&value)) {
+        put(out, Tag::RECORD);
+        putString(out, record->model->name.lexeme);
+        put<uint64_t>(out, record->slots.size());
+        for (const auto& slot : record->slots) {
+            encodeTo(slot, out, references);
+        }
+    } else if (auto* sequence = std::get_if<std::shared_ptr<const Sequence>>(&value)) {
+        // Steps from the source out, so decoding can build each on the last
+        std::vector<const Sequence*> steps;
+        for (const Sequence* step = sequence->get(); step; step = step->input.get()) {
+            steps.push_back(step);
+        }
+        put(out, Tag::SEQUENCE);
+        put<uint64_t>(out, steps.size());
+        for (auto step = steps.rbegin(); step != steps.rend(); ++step) {
+            put(out, (*step)->step);
+            encodeTo((*step)->argument, out, references);
+        }
+    } else {
+        throw std::runtime_error("Cannot pass a " + typeToString(valueType(value)) + " value to another process");
+    }
+}
+
+} // namespace
+
+void encodeValue(const Value& value, std::string& out, const ProgramReferences* references) {
+    encodeTo(value, out, references);
+}
+
+void encodeValue(const Value& value, std::ostream& out, const ProgramReferences* references) {
+    encodeTo(value, out, references);
+}
+
+Value decodeValue(const char*& data, const char* end, const ProgramReferences* references) {
+    switch (take<Tag>(data, end)) {
+    case Tag::NOTHING:
+        return Value{};
+    case Tag::INTEGER:
+        return take<int64_t>(data, end);
+    case Tag::STRING:
+        return takeString(data, end);
+    case Tag::PACKED_INTEGERS: {
+        uint64_t count = take<uint64_t>(data, end);
+        if (static_cast<uint64_t>(end - data) / sizeof(int64_t) < count) {
+            throw std::runtime_error("Truncated value");
+        }
+        List list;
+        list.reserve(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            int64_t element;
+            std::memcpy(&element, data + i * sizeof(int64_t), sizeof(int64_t));
+            list.emplace_back(element);
+        }
+        data += count * sizeof(int64_t);
+        return list;
+    }
+    case Tag::SPILLED: {
+        uint64_t count = take<uint64_t>(data, end);
+        if (static_cast<uint64_t>(end - data) / sizeof(int64_t) < count) {
+            throw std::runtime_error("Truncated value");
+        }
+        if (!requireReferences(references).spillList) {
+            throw std::runtime_error("Malformed value");
+        }
+        std::shared_ptr<SpillList> list = references->spillList();
+        for (uint64_t i = 0; i < count; ++i) {
+            int64_t element;
+            std::memcpy(&element, data + i * sizeof(int64_t), sizeof(int64_t));
+            list->append(element);
+        }
+        data += count * sizeof(int64_t);
+        return list;
+    }
+    case Tag::MATRIX: {
+        uint64_t rows = take<uint64_t>(data, end);
+        uint64_t cols = take<uint64_t>(data, end);
+        uint64_t available = static_cast<uint64_t>(end - data) / sizeof(int64_t);
+        if (cols != 0 && rows > available / cols) {
+            throw std::runtime_error("Truncated value");
+        }
+        auto matrix = std::make_shared<Matrix>(rows, cols);
+        if (rows > 0) {
+            std::memcpy(matrix->row(0), data, rows * cols * sizeof(int64_t));
+        }
+        data += rows * cols * sizeof(int64_t);
+        return matrix;
+    }
+    case Tag::LIST: {
+        uint64_t count = take<uint64_t>(data, end);
+        List list;
+        for (uint64_t i = 0; i < count; ++i) {
+            list.push_back(decodeValue(data, end, references));
+        }
+        return list;
+    }
+    case Tag::DICT: {
+        uint64_t count = take<uint64_t>(data, end);
+        Dict dict;
+        for (uint64_t i = 0; i < count; ++i) {
+            std::string key = takeString(data, end);
+            dict[key] = decodeValue(data, end, references);
+        }
+        return dict;
+    }
+    case Tag::FUNCTION:
+        return requireReferences(references).function(take<uint64_t>(data, end));
+    case Tag::CLOSURE: {
+        auto closure = std::make_shared<Closure>();
+        closure->function = requireReferences(references).function(take<uint64_t>(data, end));
+        uint64_t count = take<uint64_t>(data, end);
+        if (!closure->function || count != closure->function->captures.size()) {
+            throw std::runtime_error("Malformed value");
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            closure->captured.push_back(decodeValue(data, end, references));
+        }
+        return closure;
+    }
+    case Tag::MODEL:
+        return requireReferences(references).model(takeString(data, end));
+    case Tag::RECORD: {
+        Record record;
+        record.model = requireReferences(references).model(takeString(data, end));
+        uint64_t count = take<uint64_t>(data, end);
+        if (!record.model || count != record.model->fields.size()) {
+            throw std::runtime_error("Malformed value");
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            record.slots.push_back(decodeValue(data, end, references));
+        }
+        return record;
+    }
+    case Tag::SEQUENCE: {
+        requireReferences(references);
+        uint64_t count = take<uint64_t>(data, end);
+        std::shared_ptr<const Sequence> chain;
+        for (uint64_t i = 0; i < count; ++i) {
+            auto step = std::make_shared<Sequence>();
+            step->step = take<Sequence::Step>(data, end);
+            if ((step->step == Sequence::Step::SOURCE) != (i == 0) || step->step > Sequence::Step::ENUMERATE) {
+                throw std::runtime_error("Malformed value");
+            }
+            step->input = chain;
+            step->argument = decodeValue(data, end, references);
+            chain = std::move(step);
+        }
+        if (!chain) {
+            throw std::runtime_error("Malformed value");
+        }
+        return chain;
+    }
+    }
+    throw std::runtime_error("Malformed value");
+}
+
+} // namespace MyCustomLang
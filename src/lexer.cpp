@@ -1,4 +1,4 @@
-#include "lexer.h"
+#include "Lexer.h"
 #include <cctype>
 #include <unordered_map>
 #include <iostream>
@@ -7,6 +7,7 @@ namespace MyCustomLang {
 
 static const std::unordered_map<std::string, TokenType> keywords = {
     {"let", TokenType::LET},
+    {"const", TokenType::CONST},
     {"set", TokenType::SET},
     {"be", TokenType::BE},
     {"as", TokenType::AS},
@@ -60,7 +61,8 @@ static const std::unordered_map<char, TokenType> singleCharTokens = {
     {']', TokenType::RIGHT_BRACKET},
     {';', TokenType::SEMICOLON},
     {',', TokenType::COMMA},
-    {':', TokenType::COLON}
+    {':', TokenType::COLON},
+    {'.', TokenType::DOT}
 };
 
 Lexer::Lexer(const std::string& source)
@@ -160,10 +162,8 @@ Token Lexer::stringLiteral() {
 
 Token Lexer::getNextToken() {
     // Handle pending dedents
-    if (pendingDedents > 0) {
+    if (pendingDedents > 0) { // Their levels were popped with the first
         pendingDedents--;
-        indent_stack.pop_back();
-        indent_level--;
         Token token(TokenType::DEDENT, "", line);
         previousToken = token;
         return token;
@@ -219,11 +219,18 @@ Token Lexer::getNextToken() {
             indent_stack.pop_back();
             indent_level--;
             pendingDedents = 0;
-            while (indent_count < indent_stack.back() && indent_stack.size() > 1) {
+            while (indent_stack.size() > 1 && indent_count < indent_stack.back()) {
                 indent_stack.pop_back();
                 indent_level--;
                 pendingDedents++;
             }
+            if (indent_count != indent_stack.back()) {
+                std::cerr << "Dedent to a level no enclosing block uses at line " << line << std::endl;
+                pendingDedents = 0;
+                Token token(TokenType::UNKNOWN, "", line);
+                previousToken = token;
+                return token;
+            }
             Token token(TokenType::DEDENT, "", line);
             previousToken = token;
             return token;
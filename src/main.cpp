@@ -7,7 +7,25 @@
 #include "SymbolTable.h"
 #include "SemanticAnalyzer.h"
 #include "Interpreter.h" // Added for interpreter phase
+#include "Optimizer.h"
 #include "Type.h"
+#include "Engine.h"
+#include "Server.h"
+#include "Batch.h"
+#include "Shard.h"
+#include "Scheduler.h"
+#include "Stream.h"
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
 
 namespace MyCustomLang {
 
@@ -36,9 +54,9 @@ void printAST(const Program& program) {
 void printSymbolTable(const SymbolTable& symbolTable) {
     std::cout << "Symbol Table:\n";
     const auto& scopes = symbolTable.getScopes();
-    for (size_t i = 0; i < scopes.size(); ++i) {
+    for (size_t i = 1; i < scopes.size(); ++i) { // Scope 0 holds the builtins
         if (scopes[i].empty()) continue; // Skip empty scopes
-        std::cout << "Scope " << i << ":\n";
+        std::cout << "Scope " << i - 1 << ":\n";
         for (const auto& [name, symbol] : scopes[i]) {
             std::cout << "  Variable: " << name 
                       << " (Type: " << typeToString(symbol.type);
@@ -52,18 +70,458 @@ void printSymbolTable(const SymbolTable& symbolTable) {
                     if (j < symbol.parameters.size() - 1) std::cout << ", ";
                 }
                 std::cout << "], Return Type: " << typeToString(symbol.returnType);
+            } else if (symbol.type == Type::MODEL) {
+                std::cout << ", Fields: [";
+                for (size_t j = 0; j < symbol.parameters.size(); ++j) {
+                    std::cout << symbol.parameters[j].lexeme;
+                    if (j < symbol.fieldTypes.size()) std::cout << ": " << typeToString(symbol.fieldTypes[j]);
+                    if (j < symbol.parameters.size() - 1) std::cout << ", ";
+                }
+                std::cout << "]";
+            } else if (!symbol.modelName.empty()) {
+                std::cout << ", Model: " << symbol.modelName;
             }
             std::cout << ", Line: " << symbol.name.line << ")\n";
         }
     }
 }
 
+// Usage: serve [socket path] [--workers n] [--max-requests n] [--max-rss-kb n] [--cache-size n]
+//              [--max-request-kb n] [--request-timeout-ms n] [--preload file.ns ...]
+int runServer(int argc, char* argv[]) {
+    std::string socketPath = DEFAULT_SOCKET_PATH;
+    ServerOptions options;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (arg == "--workers" && hasValue) {
+                options.workers = std::stoul(argv[++i]);
+            } else if (arg == "--max-requests" && hasValue) {
+                options.maxRequests = std::stoul(argv[++i]);
+            } else if (arg == "--max-rss-kb" && hasValue) {
+                options.maxResidentKb = std::stoul(argv[++i]);
+            } else if (arg == "--cache-size" && hasValue) {
+                options.cacheCapacity = std::stoul(argv[++i]);
+            } else if (arg == "--max-request-kb" && hasValue) {
+                options.maxRequestKb = std::stoul(argv[++i]);
+            } else if (arg == "--request-timeout-ms" && hasValue) {
+                options.requestTimeoutMs = std::stoul(argv[++i]);
+            } else if (arg == "--preload" && hasValue) {
+                options.preload.push_back(argv[++i]);
+            } else {
+                socketPath = arg;
+            }
+        } catch (const std::logic_error&) {
+            std::cerr << "Expected a number after " << arg << ", got '" << argv[i] << "'.\n";
+            return 1;
+        }
+    }
+    ScriptServer server(socketPath, options);
+    return server.serve();
+}
+
+// Usage: batch [--jobs n] [--quiet] (file.ns | glob | manifest) ...
+// Prints each script's output or errors under a header with its status and
+// time, then a summary. Exits with 1 if any script failed.
+int runBatchCommand(int argc, char* argv[]) {
+    size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+    bool quiet = false;
+    std::vector<std::string> inputs;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--jobs" && i + 1 < argc) {
+            try {
+                jobs = std::stoul(argv[++i]);
+            } catch (const std::logic_error&) {
+                std::cerr << "Expected a number after --jobs, got '" << argv[i] << "'.\n";
+                return 1;
+            }
+        } else if (arg == "--quiet") {
+            quiet = true;
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+
+    std::vector<std::string> paths;
+    try {
+        paths = expandBatchInputs(inputs);
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    Engine engine;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<BatchEntry> entries = runBatch(engine, paths, jobs);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    size_t failed = 0;
+    for (const auto& entry : entries) {
+        if (entry.result.status != 0) failed++;
+        std::cout << "== " << entry.path << ": " << (entry.result.status == 0 ? "ok" : "failed") << ", "
+                  << std::fixed << std::setprecision(2) << entry.milliseconds << " ms\n";
+        if (!quiet) {
+            std::cout << entry.result.output << entry.result.errors;
+        }
+    }
+    std::cout << "Ran " << entries.size() << " script(s) on " << std::min(jobs, std::max<size_t>(1, entries.size()))
+              << " thread(s) in " << std::fixed << std::setprecision(2) << elapsed.count() << " ms: "
+              << entries.size() - failed << " ok, " << failed << " failed, " << engine.cachedVariants()
+              << " distinct compiled\n";
+    return failed == 0 ? 0 : 1;
+}
+
+// Usage: shard [--shards n] [--ring-kb n] [--reduce reduce.ns] file.ns
+// Prints each shard's output in shard order, then either the gathered
+// values one per line or the output of the reduce script, which sees them
+// as the list global `results`.
+int runShardCommand(int argc, char* argv[]) {
+    size_t shards = std::max(1u, std::thread::hardware_concurrency());
+    size_t ringKb = 1024;
+    std::string path = "code.ns";
+    std::string reducePath;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (arg == "--shards" && hasValue) {
+                shards = std::max<size_t>(1, std::stoul(argv[++i]));
+            } else if (arg == "--ring-kb" && hasValue) {
+                ringKb = std::max<size_t>(1, std::stoul(argv[++i]));
+            } else if (arg == "--reduce" && hasValue) {
+                reducePath = argv[++i];
+            } else {
+                path = arg;
+            }
+        } catch (const std::logic_error&) {
+            std::cerr << "Expected a number after " << arg << ", got '" << argv[i] << "'.\n";
+            return 1;
+        }
+    }
+
+    auto readSource = [](const std::string& file, std::string& source) {
+        std::ifstream in(file);
+        if (!in.is_open()) {
+            std::cerr << "Could not open file '" << file << "'.\n";
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        source = buffer.str();
+        return true;
+    };
+    std::string source, reduceSource;
+    if (!readSource(path, source) || (!reducePath.empty() && !readSource(reducePath, reduceSource))) {
+        return 1;
+    }
+
+    Engine engine;
+    ShardReport report;
+    try {
+        report = runSharded(engine, source, shards, ringKb * 1024);
+    } catch (const std::runtime_error& e) {
+        std::cerr << formatCompileError(e);
+        return 1;
+    }
+    int status = 0;
+    for (const auto& shard : report.shards) {
+        std::cout << shard.output;
+        std::cerr << shard.errors;
+        status = std::max(status, shard.status);
+    }
+
+    if (reducePath.empty()) {
+        for (const auto& value : report.results) {
+            std::cout << valueToString(value) << "\n";
+        }
+        return status;
+    }
+    Bindings globals{{"results", std::move(report.results)}, {"shards", static_cast<int64_t>(shards)}};
+    RunResult reduced = engine.execute(reduceSource, globals);
+    std::cout << reduced.output;
+    std::cerr << reduced.errors;
+    return std::max(status, reduced.status);
+}
+
+// Usage: schedule [--workers n] [--quantum n] [--tenant name[:weight[:priority]] ...] [--quiet] manifest
+// Each manifest line is `<tenant> <script path>`. Prints each task's
+// status and timings (and output unless quiet) in manifest order, then
+// what each tenant used.
+int runScheduleCommand(int argc, char* argv[]) {
+    SchedulerOptions options;
+    options.workers = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> tenantSpecs;
+    std::string manifestPath;
+    bool quiet = false;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        try {
+            if (arg == "--workers" && hasValue) {
+                options.workers = std::stoul(argv[++i]);
+            } else if (arg == "--quantum" && hasValue) {
+                options.quantum = std::max<size_t>(1, std::stoul(argv[++i]));
+            } else if (arg == "--tenant" && hasValue) {
+                tenantSpecs.push_back(argv[++i]);
+            } else if (arg == "--quiet") {
+                quiet = true;
+            } else {
+                manifestPath = arg;
+            }
+        } catch (const std::logic_error&) {
+            std::cerr << "Expected a number after " << arg << ", got '" << argv[i] << "'.\n";
+            return 1;
+        }
+    }
+
+    Engine engine;
+    Scheduler scheduler(engine, options);
+    for (const auto& spec : tenantSpecs) {
+        std::stringstream fields(spec);
+        std::string name, weight, priority;
+        std::getline(fields, name, ':');
+        std::getline(fields, weight, ':');
+        std::getline(fields, priority, ':');
+        try {
+            scheduler.addTenant(name, weight.empty() ? 1 : std::stoul(weight), priority.empty() ? 0 : std::stoi(priority));
+        } catch (const std::logic_error&) {
+            std::cerr << "Expected name[:weight[:priority]] after --tenant, got '" << spec << "'.\n";
+            return 1;
+        }
+    }
+
+    std::ifstream manifest(manifestPath);
+    if (!manifest.is_open()) {
+        std::cerr << "Could not open manifest '" << manifestPath << "'.\n";
+        return 1;
+    }
+    std::string line;
+    while (std::getline(manifest, line)) {
+        std::stringstream fields(line);
+        std::string tenant, path;
+        if (!(fields >> tenant >> path) || tenant[0] == '#') continue;
+        std::ifstream file(path);
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        if (!file.is_open()) {
+            std::cerr << "Could not open file '" << path << "'.\n";
+            return 1;
+        }
+        scheduler.submit(tenant, path, buffer.str());
+    }
+
+    std::vector<TaskReport> reports = scheduler.run();
+    int status = 0;
+    for (const auto& report : reports) {
+        status = std::max(status, report.result.status);
+        std::cout << "== " << report.tenant << " " << report.name << ": "
+                  << (report.result.status == 0 ? "ok" : "failed") << std::fixed << std::setprecision(2)
+                  << ", waited " << report.waitMs << " ms, took " << report.wallMs << " ms, cpu " << report.cpuMs
+                  << " ms, " << report.slices << " slice(s), done at slice " << report.doneAtSlice << "\n";
+        if (!quiet) {
+            std::cout << report.result.output << report.result.errors;
+        }
+    }
+    for (const auto& tenant : scheduler.usage()) {
+        std::cout << "Tenant " << tenant.name << " (weight " << tenant.weight << ", priority " << tenant.priority
+                  << "): " << tenant.tasks << " task(s), " << tenant.slices << " slice(s), cpu " << std::fixed
+                  << std::setprecision(2) << tenant.cpuMs << " ms\n";
+    }
+    return status;
+}
+
+// Usage: stream [--format lines|csv|jsonl] [--jobs n] (-e 'script' | file.ns) < input
+// Compiles the script once and runs it for every record on standard input,
+// with the record in `record` and its number in `record_number`. Output
+// comes out in input order; errors go to stderr and the stream carries on.
+int runStreamCommand(int argc, char* argv[]) {
+    StreamOptions options;
+    std::string source;
+    std::string path;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-e" && hasValue) {
+            source = argv[++i];
+        } else if (arg == "--format" && hasValue) {
+            std::string format = argv[++i];
+            if (format == "lines") options.format = RecordFormat::LINES;
+            else if (format == "csv") options.format = RecordFormat::CSV;
+            else if (format == "jsonl") options.format = RecordFormat::JSONL;
+            else {
+                std::cerr << "Expected lines, csv or jsonl after --format, got '" << format << "'.\n";
+                return 1;
+            }
+        } else if (arg == "--jobs" && hasValue) {
+            try {
+                options.jobs = std::max<size_t>(1, std::stoul(argv[++i]));
+            } catch (const std::logic_error&) {
+                std::cerr << "Expected a number after --jobs, got '" << argv[i] << "'.\n";
+                return 1;
+            }
+        } else {
+            path = arg;
+        }
+    }
+    if (!path.empty()) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            std::cerr << "Could not open file '" << path << "'.\n";
+            return 1;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        source = buffer.str();
+    }
+
+    Engine engine;
+    std::shared_ptr<const CompiledScript> script;
+    try {
+        script = engine.compile(source, streamGlobals(options.format));
+    } catch (const std::runtime_error& e) {
+        std::cerr << formatCompileError(e);
+        return 1;
+    }
+    std::ios::sync_with_stdio(false); // Buffered reads and writes; nothing else touches stdio here
+    StreamSummary summary = runStream(*script, std::cin, std::cout, std::cerr, options);
+    std::cout.flush();
+    return summary.failed == 0 ? 0 : 1;
+}
+
+// Usage: client [--socket path] [--stop] [file.ns | -] [--bind name=value ...]
+// Runs the script on a `serve` process and reports its output and status
+// as a direct run would, without the compiler's diagnostic listing.
+int runClient(int argc, char* argv[]) {
+    std::string socketPath = DEFAULT_SOCKET_PATH;
+    std::string path = "code.ns";
+    ScriptRequest request;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (arg == "--stop") {
+            request.shutdown = true;
+        } else if (arg == "--bind" && i + 1 < argc) {
+            request.bindings.push_back(argv[++i]);
+        } else {
+            path = arg;
+        }
+    }
+
+    if (!request.shutdown) {
+        if (path == "-") {
+            std::stringstream buffer;
+            buffer << std::cin.rdbuf();
+            request.source = buffer.str();
+        } else {
+            // The server resolves relative paths against its own directory
+            char resolved[PATH_MAX];
+            if (!realpath(path.c_str(), resolved)) {
+                std::cerr << "Could not open file '" << path << "'.\n";
+                return 1;
+            }
+            request.path = resolved;
+        }
+    }
+
+    try {
+        RunResult result = sendRequest(socketPath, request);
+        std::cout << result.output;
+        std::cerr << result.errors;
+        return result.status;
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
+
+// A file mapped read-only; empty when it cannot be opened or holds nothing.
+// A checkpoint is resumed from its mapping, so the spilled lists in it are
+// paged in as they are decoded rather than read into memory up front.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info {};
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapping = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                bytes = static_cast<const char*>(mapping);
+                length = static_cast<size_t>(info.st_size);
+            }
+        }
+        ::close(fd);
+    }
+    ~MappedFile() {
+        if (bytes) ::munmap(const_cast<char*>(bytes), length);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+};
+
 } // namespace MyCustomLang
 
-int main() {
-    std::ifstream file("code.ns");
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "serve") {
+        return MyCustomLang::runServer(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "schedule") {
+        return MyCustomLang::runScheduleCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "shard") {
+        return MyCustomLang::runShardCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "batch") {
+        return MyCustomLang::runBatchCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "stream") {
+        return MyCustomLang::runStreamCommand(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "client") {
+        return MyCustomLang::runClient(argc, argv);
+    }
+
+    // Usage: main [file.ns] [--bind name=value ...] [--checkpoint file [--checkpoint-every seconds]]
+    //             [--spill-dir dir] [--spill-threshold integers]
+    std::string path = "code.ns";
+    MyCustomLang::Bindings bindings;
+    MyCustomLang::SpillOptions spillOptions;
+    std::string checkpointPath;
+    long checkpointSeconds = 300;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpointPath = argv[++i];
+        } else if (arg == "--checkpoint-every" && i + 1 < argc) {
+            checkpointSeconds = std::atol(argv[++i]);
+        } else if (arg == "--spill-dir" && i + 1 < argc) {
+            spillOptions.directory = argv[++i];
+        } else if (arg == "--spill-threshold" && i + 1 < argc) {
+            spillOptions.threshold = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--bind" && i + 1 < argc) {
+            std::string binding = argv[++i];
+            if (!MyCustomLang::parseBinding(binding, bindings)) {
+                std::cerr << "Expected name=value after --bind, with integers in the 64-bit range, got '" << binding << "'.\n";
+                return 1;
+            }
+        } else {
+            path = arg;
+        }
+    }
+
+    std::ifstream file(path);
     if (!file.is_open()) {
-        std::cerr << "Could not open file 'code.ns'.\n";
+        std::cerr << "Could not open file '" << path << "'.\n";
         return 1;
     }
 
@@ -88,6 +546,10 @@ int main() {
 
     try {
         MyCustomLang::Parser parser(tokens);
+        for (const auto& [name, value] : bindings) {
+            parser.getSymbolTable().addSymbol(MyCustomLang::Token(MyCustomLang::TokenType::IDENTIFIER, name, 0),
+                                              MyCustomLang::valueType(value), false);
+        }
         MyCustomLang::Program ast = parser.parse();
         std::cout << "Parsing successful!\n";
         std::cout << "Parsed " << tokens.size() << " tokens into " 
@@ -101,10 +563,53 @@ int main() {
 
         MyCustomLang::printSymbolTable(analyzer.getSymbolTable()); // Changed to use analyzer's symbol table
 
+        MyCustomLang::Optimizer optimizer(analyzer.getSymbolTable());
+        MyCustomLang::OptimizerStats stats = optimizer.optimize(ast, bindings);
+        std::cout << "Optimization: folded " << stats.foldedCalls << " constant call(s), removed "
+                  << stats.removedStatements << " statement(s), unrolled " << stats.unrolledLoops
+                  << " loop(s), peeled " << stats.peeledIterations << " iteration(s), dropped "
+                  << stats.removedChecks << " runtime check(s), propagated " << stats.propagatedConstants
+                  << " constant(s), built " << stats.jumpTables << " jump table(s)\n";
+
         // Add interpreter phase
         std::cout << "\nInterpreting program...\n";
         MyCustomLang::Interpreter interpreter(analyzer.getSymbolTable());
-        interpreter.interpret(ast);
+        interpreter.setSpillOptions(spillOptions);
+        for (const auto& [name, value] : bindings) {
+            interpreter.define(name, value);
+        }
+        std::unique_ptr<MyCustomLang::MappedFile> savedState;
+        // The clock is read only every few hundred safe points. Both outlive
+        // the hook, which runs for the whole interpretation.
+        auto last = std::chrono::steady_clock::now();
+        size_t sinceCheck = 0;
+        if (!checkpointPath.empty()) {
+            savedState = std::make_unique<MyCustomLang::MappedFile>(checkpointPath);
+            interpreter.setSafePointHook([&]() {
+                if (++sinceCheck < 256) return;
+                sinceCheck = 0;
+                auto now = std::chrono::steady_clock::now();
+                if (now - last < std::chrono::seconds(checkpointSeconds)) return;
+                last = now;
+                std::string temporary = checkpointPath + ".tmp";
+                std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+                interpreter.checkpoint(out);
+                out.close();
+                if (out) std::rename(temporary.c_str(), checkpointPath.c_str());
+            });
+        }
+        try {
+            if (savedState && savedState->size() > 0) {
+                std::cout << "Resuming from checkpoint '" << checkpointPath << "'\n";
+                interpreter.resume(ast, savedState->data(), savedState->size());
+            } else {
+                interpreter.interpret(ast);
+            }
+            if (!checkpointPath.empty()) std::remove(checkpointPath.c_str());
+        } catch (const MyCustomLang::RuntimeError& e) {
+            std::cerr << "Runtime error: " << e.what() << "\n" << interpreter.formatStackTrace(e);
+            return 1;
+        }
         std::cout << "Interpretation successful!\n";
 
     } catch (const MyCustomLang::ParserError& e) {
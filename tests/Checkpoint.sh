@@ -0,0 +1,40 @@
+#!/bin/sh
+# A run that fails leaves its last checkpoint behind; once the cause is
+# fixed, a rerun resumes from it instead of starting over, and removes it
+# when it finishes.
+main=$1
+work=${TMPDIR:-/tmp}/nova-checkpoint-$$
+mkdir -p "$work"
+cp "$2/resume.ns" "$work/"
+cd "$work" || exit 1
+
+status=0
+if "$main" resume.ns --checkpoint state.ckpt --checkpoint-every 0 >first.txt 2>&1; then
+    echo "The first run should have failed"
+    status=1
+fi
+if ! grep -q '^early$' first.txt || [ ! -s state.ckpt ]; then
+    echo "The first run left no checkpoint:"
+    cat first.txt
+    status=1
+fi
+
+echo 1000000 >marker.txt
+if ! "$main" resume.ns --checkpoint state.ckpt --checkpoint-every 0 >second.txt 2>&1; then
+    echo "The resumed run failed:"
+    cat second.txt
+    status=1
+fi
+if ! grep -q "^Resuming from checkpoint 'state.ckpt'$" second.txt || grep -q '^early$' second.txt ||
+    ! grep -q '^1500500$' second.txt; then
+    echo "The second run did not resume where the first left off:"
+    cat second.txt
+    status=1
+fi
+if [ -e state.ckpt ]; then
+    echo "The checkpoint was not removed after the run finished"
+    status=1
+fi
+
+cd / && rm -rf "$work"
+exit $status
@@ -0,0 +1,36 @@
+#!/bin/sh
+# A pool of prefork workers that each retire after two requests must keep
+# answering, with the preloaded script's output unchanged, until stopped.
+main=$1
+scripts=$2
+socket=${TMPDIR:-/tmp}/nova-prefork-$$.sock
+
+"$main" serve "$socket" --workers 2 --max-requests 2 --preload "$scripts/greeting.ns" >/dev/null 2>&1 &
+server=$!
+tries=0
+until [ -S "$socket" ]; do
+    tries=$((tries + 1))
+    if [ $tries -gt 100 ]; then
+        echo "The server did not start"
+        kill $server
+        exit 1
+    fi
+    sleep 0.05
+done
+
+status=0
+for request in 1 2 3 4 5 6 7; do
+    output=$("$main" client --socket "$socket" "$scripts/greeting.ns" | tr '\n' ' ')
+    if [ "$output" != "hello 55 " ]; then
+        echo "Request $request got '$output'"
+        status=1
+    fi
+done
+if [ "$(echo 'say 6 * n' | "$main" client --socket "$socket" - --bind n=7)" != "42" ]; then
+    echo "A script sent on standard input with a binding was not run"
+    status=1
+fi
+"$main" client --socket "$socket" --stop
+wait $server || status=1
+rm -f "$socket"
+exit $status
@@ -0,0 +1,32 @@
+# Runs MAIN with the arguments in <name>.args, from the directory of ARGS,
+# feeding it <name>.in when there is one. Its standard output must match
+# <name>.out and its exit status <name>.status (0 when there is none).
+# Times vary from run to run, so each "<number>.<number> ms" reads as
+# "<time>" on both sides.
+get_filename_component(directory ${ARGS} DIRECTORY)
+get_filename_component(name ${ARGS} NAME_WE)
+
+file(READ ${ARGS} arguments)
+separate_arguments(arguments UNIX_COMMAND "${arguments}")
+set(input "")
+if(EXISTS ${directory}/${name}.in)
+    set(input INPUT_FILE ${directory}/${name}.in)
+endif()
+set(expected_status 0)
+if(EXISTS ${directory}/${name}.status)
+    file(READ ${directory}/${name}.status expected_status)
+    string(STRIP "${expected_status}" expected_status)
+endif()
+
+execute_process(COMMAND ${MAIN} ${arguments} ${input}
+    RESULT_VARIABLE status OUTPUT_VARIABLE output ERROR_VARIABLE errors)
+if(NOT status EQUAL expected_status)
+    message(FATAL_ERROR "Exited with ${status}, expected ${expected_status}:\n${output}${errors}")
+endif()
+
+file(READ ${directory}/${name}.out expected)
+string(REGEX REPLACE "[0-9]+\\.[0-9]+ ms" "<time>" output "${output}")
+string(REGEX REPLACE "[0-9]+\\.[0-9]+ ms" "<time>" expected "${expected}")
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "Expected:\n${expected}\nGot:\n${output}")
+endif()
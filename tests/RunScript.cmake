@@ -0,0 +1,41 @@
+# Runs SCRIPT with MAIN and checks it against the .out or .err file next to
+# it. Only what the program itself prints is compared, not the driver's
+# token, AST and symbol listings around it.
+get_filename_component(directory ${SCRIPT} DIRECTORY)
+get_filename_component(name ${SCRIPT} NAME_WE)
+
+# <name>.args holds any further command-line arguments
+set(arguments "")
+if(EXISTS ${directory}/${name}.args)
+    file(READ ${directory}/${name}.args arguments)
+    separate_arguments(arguments UNIX_COMMAND "${arguments}")
+endif()
+
+execute_process(COMMAND ${MAIN} ${SCRIPT} ${arguments}
+    RESULT_VARIABLE status OUTPUT_VARIABLE output ERROR_VARIABLE errors)
+
+if(EXISTS ${directory}/${name}.err)
+    file(READ ${directory}/${name}.err expected)
+    string(STRIP "${expected}" expected)
+    string(FIND "${errors}" "${expected}" found)
+    if(status EQUAL 0 OR found EQUAL -1)
+        message(FATAL_ERROR "Expected failure with '${expected}', got status ${status} and:\n${errors}")
+    endif()
+    return()
+endif()
+
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "Exited with ${status}:\n${errors}")
+endif()
+string(FIND "${output}" "Interpreting program...\n" begin)
+string(FIND "${output}" "Interpretation successful!" end REVERSE)
+if(begin EQUAL -1 OR end EQUAL -1)
+    message(FATAL_ERROR "No program output in:\n${output}")
+endif()
+math(EXPR begin "${begin} + 24")
+math(EXPR length "${end} - ${begin}")
+string(SUBSTRING "${output}" ${begin} ${length} actual)
+file(READ ${directory}/${name}.out expected)
+if(NOT actual STREQUAL expected)
+    message(FATAL_ERROR "Expected:\n${expected}\nGot:\n${actual}")
+endif()
@@ -0,0 +1,38 @@
+# Runs `main schedule` on one worker with MANIFEST and checks how the
+# tenants' tasks were ordered, from the slice each one finished at. Slices
+# are a fixed number of interpreter steps, so unlike the reported times the
+# counts do not depend on how loaded the machine is.
+#   weights:    `heavy` has 100 times the weight of `light` and the same
+#               work, so it finishes after little more than its own slices,
+#               while `light` finishes after both
+#   priorities: `high` outranks `low`, so no slice of `low` runs before
+#               `high` is done
+execute_process(COMMAND ${MAIN} schedule --workers 1 --quantum 2000 --quiet ${TENANTS} ${MANIFEST}
+    RESULT_VARIABLE status OUTPUT_VARIABLE output ERROR_VARIABLE errors)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "Exited with ${status}:\n${output}${errors}")
+endif()
+
+string(REGEX MATCHALL "== [a-z]+ [^:]+: ok, [^\n]* [0-9]+ slice\\(s\\), done at slice [0-9]+" tasks "${output}")
+foreach(task ${tasks})
+    string(REGEX REPLACE "== ([a-z]+) .* ([0-9]+) slice\\(s\\), done at slice ([0-9]+)" "\\1;\\2;\\3" fields "${task}")
+    list(GET fields 0 tenant)
+    list(GET fields 1 slices_${tenant})
+    list(GET fields 2 done_${tenant})
+endforeach()
+
+if(CHECK STREQUAL "weights")
+    # Proportional sharing has heavy done at about 0.5 of light's slices;
+    # sharing evenly would have it at about 1
+    math(EXPR scaled_heavy "${done_heavy} * 100")
+    math(EXPR scaled_light "${done_light} * 62")
+    if(NOT scaled_heavy LESS scaled_light)
+        message(FATAL_ERROR "heavy was done at slice ${done_heavy} against light's ${done_light}:\n${output}")
+    endif()
+elseif(CHECK STREQUAL "priorities")
+    if(NOT done_high EQUAL slices_high)
+        message(FATAL_ERROR "high took ${slices_high} slices but was done at slice ${done_high}:\n${output}")
+    endif()
+else()
+    message(FATAL_ERROR "Unknown CHECK '${CHECK}'")
+endif()
@@ -0,0 +1,46 @@
+#!/bin/sh
+# A second `main serve` on a socket a server is listening on must refuse
+# to start and leave the first server reachable.
+main=$1
+socket=${TMPDIR:-/tmp}/nova-serve-twice-$$.sock
+
+"$main" serve "$socket" >/dev/null 2>&1 &
+first=$!
+tries=0
+until [ -S "$socket" ]; do
+    tries=$((tries + 1))
+    if [ $tries -gt 100 ]; then
+        echo "The first server did not start"
+        kill $first
+        exit 1
+    fi
+    sleep 0.05
+done
+
+status=0
+"$main" serve "$socket" >/dev/null 2>&1 &
+second=$!
+tries=0
+while kill -0 $second 2>/dev/null; do
+    tries=$((tries + 1))
+    if [ $tries -gt 40 ]; then
+        echo "The second server started on a socket in use"
+        kill $second
+        status=1
+        break
+    fi
+    sleep 0.05
+done
+if wait $second; then
+    echo "The second server exited successfully"
+    status=1
+fi
+
+if [ "$(echo 'say 1 + 2' | "$main" client --socket "$socket" -)" != "3" ]; then
+    echo "The first server no longer answers"
+    status=1
+fi
+kill $first
+wait $first
+rm -f "$socket"
+exit $status